@@ -0,0 +1,233 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// anim.cpp: tile animation scheduler
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "anim.h"
+#include "mem.h"
+#include "config.h"
+#include "debug.h"
+
+// initial capacity of slot and changed arrays
+#define ANIM_MIN_CAPACITY 64
+
+
+/**
+ *  Constructor. There are no cells until resize().
+ */
+Animator::Animator()
+{
+	int i;
+
+	for(i = 0; i < ANIM_SLOTS; i++)
+	{
+		this->slots[i] = NULL;
+		this->counts[i] = 0;
+		this->capacities[i] = 0;
+	}
+	this->due = NULL;
+	this->frame = NULL;
+	this->frames = NULL;
+	this->period = NULL;
+	this->cells = 0;
+	this->tick = 0;
+
+	this->changed = NULL;
+	this->changedCount = 0;
+	this->changedCapacity = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Animator::~Animator()
+{
+	int i;
+
+	this->free();
+	for(i = 0; i < ANIM_SLOTS; i++)
+		MEM_DELETE(MEM_UI, this->slots[i], this->capacities[i]);
+	MEM_DELETE(MEM_UI, this->changed, this->changedCapacity);
+}
+
+/**
+ *  Sets number of cells, no cell is animated afterwards.
+ *  \param cells        number of cells
+ */
+void Animator::resize(int cells)
+{
+	assert(cells >= 0);
+
+	this->free();
+	this->due = MEM_NEW(MEM_UI, unsigned int, cells);
+	this->frame = MEM_NEW(MEM_UI, unsigned char, cells);
+	this->frames = MEM_NEW(MEM_UI, unsigned char, cells);
+	this->period = MEM_NEW(MEM_UI, unsigned char, cells);
+	this->cells = cells;
+	this->clear();
+}
+
+/**
+ *  Stops animation of all cells.
+ */
+void Animator::clear()
+{
+	int i;
+
+	if(this->cells)
+		memset(this->frames, 0, this->cells);
+	for(i = 0; i < ANIM_SLOTS; i++)
+		this->counts[i] = 0;
+	this->changedCount = 0;
+}
+
+/**
+ *  Starts animation of cell. Frame depends only on current tick and phase,
+ *  so cell added again later goes on as if it was animated all the time.
+ *  \param cell         cell index
+ *  \param frames       frames of animation (1 stops animation)
+ *  \param period       ticks per frame (1 to ANIM_SLOTS - 1)
+ *  \param phase        ticks animation of cell is ahead of others
+ *  \return             current frame
+ */
+int Animator::add(int cell, int frames, int period, unsigned int phase)
+{
+	assert(cell >= 0 && cell < this->cells);
+	assert(frames >= 1 && frames <= 0xff);
+	assert(period >= 1 && period < ANIM_SLOTS);
+
+	if(frames == 1)
+	{
+		this->frames[cell] = 0;
+		return 0;
+	}
+
+	unsigned int t = this->tick + phase;
+	this->frame[cell] = (t / period) % frames;
+	this->frames[cell] = frames;
+	this->period[cell] = period;
+	this->due[cell] = this->tick + period - t % period;
+	this->schedule(cell);
+
+	return this->frame[cell];
+}
+
+/**
+ *  Stops animation of cell (its entry in wheel is skipped when it comes).
+ *  \param cell         cell index
+ */
+void Animator::remove(int cell)
+{
+	assert(cell >= 0 && cell < this->cells);
+
+	this->frames[cell] = 0;
+}
+
+/**
+ *  Moves to next tick and advances frames of cells in its slot.
+ *  \return             number of cells whose frame changed (see getChanged())
+ */
+int Animator::advance()
+{
+	int slot = ++this->tick & (ANIM_SLOTS - 1);
+	int i;
+
+	// cells are rescheduled to other slots only (period < ANIM_SLOTS); cell
+	// added twice for one tick is advanced once, its due moves on
+	this->changedCount = 0;
+	for(i = 0; i < this->counts[slot]; i++)
+	{
+		int cell = this->slots[slot][i];
+
+		if(!this->frames[cell] || this->due[cell] != this->tick)
+			continue;
+
+		this->frame[cell] = (this->frame[cell] + 1) % this->frames[cell];
+		this->due[cell] += this->period[cell];
+		this->schedule(cell);
+
+		if(this->changedCount == this->changedCapacity)
+			this->changed = Animator::grow(this->changed, this->changedCount,
+				&this->changedCapacity);
+		this->changed[this->changedCount++] = cell;
+	}
+	this->counts[slot] = 0;
+
+	return this->changedCount;
+}
+
+/**
+ *  Frees cell arrays (wheel keeps its capacity).
+ */
+void Animator::free()
+{
+	MEM_DELETE(MEM_UI, this->due, this->cells);
+	MEM_DELETE(MEM_UI, this->frame, this->cells);
+	MEM_DELETE(MEM_UI, this->frames, this->cells);
+	MEM_DELETE(MEM_UI, this->period, this->cells);
+	this->due = NULL;
+	this->frame = NULL;
+	this->frames = NULL;
+	this->period = NULL;
+	this->cells = 0;
+	this->clear();
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Puts cell to wheel slot of its due tick.
+ *  \param cell         cell index
+ */
+void Animator::schedule(int cell)
+{
+	int slot = this->due[cell] & (ANIM_SLOTS - 1);
+
+	if(this->counts[slot] == this->capacities[slot])
+		this->slots[slot] = Animator::grow(this->slots[slot],
+			this->counts[slot], &this->capacities[slot]);
+	this->slots[slot][this->counts[slot]++] = cell;
+}
+
+/**
+ *  Doubles capacity of array.
+ *  \param array        array (deleted)
+ *  \param count        used items
+ *  \param capacity     pointer to capacity (updated)
+ *  \return             new array
+ */
+int* Animator::grow(int* array, int count, int* capacity)
+{
+	int size = *capacity ? *capacity * 2 : ANIM_MIN_CAPACITY;
+	int* bigger = MEM_NEW(MEM_UI, int, size);
+
+	if(count)
+		memcpy(bigger, array, sizeof(int) * count);
+	MEM_DELETE(MEM_UI, array, *capacity);
+	*capacity = size;
+
+	return bigger;
+}
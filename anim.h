@@ -0,0 +1,87 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// anim.h: tile animation scheduler headers
+
+#ifndef __ANIM_H
+#define __ANIM_H
+
+// slots of timing wheel (power of two, longest period is one less)
+#define ANIM_SLOTS 64
+
+
+/**
+ *  Schedules animation frames of cells. Every animated cell waits in slot of
+ *  timing wheel for tick of its next frame, so advance() visits only cells
+ *  whose frame changes on that tick, not all animated cells. Removed cells
+ *  are not searched for in wheel, they are skipped once their slot comes.
+ */
+class Animator
+{
+private:
+	int* slots[ANIM_SLOTS];     // cells waiting for tick (slot = tick & mask)
+	int counts[ANIM_SLOTS];
+	int capacities[ANIM_SLOTS];
+	unsigned int* due;          // tick of next frame of cell
+	unsigned char* frame;       // current frame of cell
+	unsigned char* frames;      // frames of cell animation (0 if not animated)
+	unsigned char* period;      // ticks per frame
+	int cells;
+	unsigned int tick;
+
+	// cells whose frame changed on last advance()
+	int* changed;
+	int changedCount;
+	int changedCapacity;
+
+	void schedule(int cell);
+	static int* grow(int* array, int count, int* capacity);
+public:
+	Animator();
+	~Animator();
+	void resize(int cells);
+	void clear();
+	int add(int cell, int frames, int period, unsigned int phase);
+	void remove(int cell);
+	int advance();
+	void free();
+
+	/**
+	 *  Returns i-th cell whose frame changed on last advance().
+	 *  \param i            index (from 0)
+	 *  \return             cell index
+	 */
+	inline int getChanged(int i)
+	{
+		return this->changed[i];
+	}
+
+	/**
+	 *  Returns current frame of cell.
+	 *  \param cell         cell index
+	 *  \return             frame (0 if cell is not animated)
+	 */
+	inline int getFrame(int cell)
+	{
+		return this->frames[cell] ? this->frame[cell] : 0;
+	}
+};
+
+
+#endif /* __ANIM_H */
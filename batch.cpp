@@ -0,0 +1,471 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// batch.cpp: batched lockstep environment
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+#include "batch.h"
+#include "pool.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+
+/**
+ *  Constructor. Allocates all environments empty (walls only) and ended,
+ *  load() them before stepping.
+ *  \param width        width of maps
+ *  \param height       height of maps
+ *  \param count        number of environments
+ *  \param threads      number of worker threads (0 means one per CPU)
+ */
+BatchEnv::BatchEnv(int width, int height, int count, int threads)
+{
+	int i;
+
+	assert(width > 0 && height > 0 && count > 0);
+
+	this->width = width;
+	this->height = height;
+	this->count = count;
+	this->blocks = (count + BATCH_LANES - 1) / BATCH_LANES;
+	this->pool = new Pool(threads);
+
+	size_t cells = (size_t)this->blocks * width * height * BATCH_LANES;
+	this->type = new Uint8[cells];
+	this->falling = new Uint8[cells];
+	this->initType = new Uint8[cells];
+	this->initFalling = new Uint8[cells];
+	memset(this->type, CELL_WALL, cells);
+	memset(this->falling, 0, cells);
+	memset(this->initType, CELL_WALL, cells);
+	memset(this->initFalling, 0, cells);
+
+	// lanes of last block past count stay unused
+	int lanes = this->blocks * BATCH_LANES;
+	this->px = new int[lanes];
+	this->py = new int[lanes];
+	this->diamonds = new int[lanes];
+	this->initDiamonds = new int[lanes];
+	this->state = new MAPSTATE[lanes];
+	this->reward = new int[lanes];
+	for(i = 0; i < lanes; i++)
+	{
+		this->px[i] = this->py[i] = 0;
+		this->diamonds[i] = this->initDiamonds[i] = 0;
+		this->state[i] = MAP_LOST;
+		this->reward[i] = 0;
+	}
+	this->actions = NULL;
+}
+
+/**
+ *  Destructor.
+ */
+BatchEnv::~BatchEnv()
+{
+	delete this->pool;
+	delete[] this->type;
+	delete[] this->falling;
+	delete[] this->initType;
+	delete[] this->initFalling;
+	delete[] this->px;
+	delete[] this->py;
+	delete[] this->diamonds;
+	delete[] this->initDiamonds;
+	delete[] this->state;
+	delete[] this->reward;
+}
+
+/**
+ *  Copies loaded map into environment. It also becomes state restored by
+ *  reset().
+ *  \param env          environment index
+ *  \param map          loaded map of the same size as batch
+ *  \return             true if success
+ */
+bool BatchEnv::load(int env, Map* map)
+{
+	int x, y;
+	int players = 0;
+
+	assert(env >= 0 && env < this->count);
+	assert(map);
+
+	if(map->getWidth() != this->width || map->getHeight() != this->height)
+	{
+		error(false, "batch: map is %dx%d, batch is %dx%d", map->getWidth(),
+			map->getHeight(), this->width, this->height);
+		return false;
+	}
+
+	for(y = 0; y < this->height; y++)
+		for(x = 0; x < this->width; x++)
+		{
+			Tile* tile = map->getTileXY(x, y);
+			size_t i = this->cell(env, x, y);
+			Uint8 code = CELL_EMPTY;
+
+			if(tile)
+			{
+				switch(tile->getType())
+				{
+				case TILE_WALL:
+					code = CELL_WALL;
+					break;
+				case TILE_SAND:
+					code = CELL_SAND;
+					break;
+				case TILE_BOULDER:
+					code = CELL_BOULDER;
+					break;
+				case TILE_DIAMOND:
+					code = CELL_DIAMOND;
+					break;
+				case TILE_PLAYER:
+					code = CELL_PLAYER;
+					this->px[env] = x;
+					this->py[env] = y;
+					players++;
+					break;
+				case TILE_EXIT:
+					code = CELL_EXIT;
+					break;
+				}
+			}
+			this->initType[i] = code;
+			this->initFalling[i] = tile && tile->isFalling();
+		}
+
+	if(players != 1)
+	{
+		error(false, "batch: map must have exactly one player");
+		return false;
+	}
+
+	this->initDiamonds[env] = map->getDiamonds();
+	this->reset(env);
+
+	return true;
+}
+
+/**
+ *  Restores environment to state it was loaded in.
+ *  \param env          environment index
+ */
+void BatchEnv::reset(int env)
+{
+	int x, y;
+
+	assert(env >= 0 && env < this->count);
+
+	for(y = 0; y < this->height; y++)
+		for(x = 0; x < this->width; x++)
+		{
+			size_t i = this->cell(env, x, y);
+
+			this->type[i] = this->initType[i];
+			this->falling[i] = this->initFalling[i];
+			if(this->type[i] == CELL_PLAYER)
+			{
+				this->px[env] = x;
+				this->py[env] = y;
+			}
+		}
+
+	this->diamonds[env] = this->initDiamonds[env];
+	this->state[env] = MAP_NONE;
+	this->reward[env] = 0;
+}
+
+/**
+ *  Steps all environments by one tick: moves player by action and applies
+ *  gravity. Ended environments are left untouched until reset().
+ *  \param actions      action of each environment
+ *  \param states       state of each environment after step (filled in)
+ *  \param rewards      diamonds collected in step (filled in)
+ *  \param done         true if environment has ended (filled in)
+ */
+void BatchEnv::step(const UIINPUT* actions, MAPSTATE* states, int* rewards,
+	bool* done)
+{
+	int i;
+
+	assert(actions);
+	TRACE_SCOPE("BatchEnv::step");
+
+	this->actions = actions;
+	this->pool->run(BatchEnv::job, this, this->blocks);
+	this->actions = NULL;
+
+	for(i = 0; i < this->count; i++)
+	{
+		if(states)
+			states[i] = this->state[i];
+		if(rewards)
+			rewards[i] = this->reward[i];
+		if(done)
+			done[i] = this->state[i] != MAP_NONE;
+	}
+}
+
+/**
+ *  Returns number of environments.
+ *  \return             number of environments
+ */
+int BatchEnv::getCount()
+{
+	return this->count;
+}
+
+/**
+ *  Returns cell of environment.
+ *  \param env          environment index
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             cell code
+ */
+BATCHCELL BatchEnv::getCell(int env, int x, int y)
+{
+	assert(env >= 0 && env < this->count);
+	assert(x >= 0 && x < this->width && y >= 0 && y < this->height);
+
+	return (BATCHCELL)this->type[this->cell(env, x, y)];
+}
+
+/**
+ *  Returns number of remaining diamonds of environment.
+ *  \param env          environment index
+ *  \return             remaining diamonds
+ */
+int BatchEnv::getDiamonds(int env)
+{
+	assert(env >= 0 && env < this->count);
+
+	return this->diamonds[env];
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Pool job stepping one block of environments.
+ *  \param batch        pointer to BatchEnv
+ *  \param block        block index
+ */
+void BatchEnv::job(void* batch, int block)
+{
+	BatchEnv* self = (BatchEnv*)batch;
+	int env = block * BATCH_LANES;
+	int end = env + BATCH_LANES;
+
+	if(end > self->count)
+		end = self->count;
+
+	for(; env < end; env++)
+	{
+		self->reward[env] = 0;
+		if(self->state[env] == MAP_NONE)
+			self->move(env);
+	}
+
+	self->gravity(block);
+}
+
+/**
+ *  Moves player of environment by its action (see Map::movePlayer()).
+ *  \param env          environment index
+ */
+void BatchEnv::move(int env)
+{
+	int x = this->px[env], y = this->py[env];
+	int tx = x, ty = y;
+
+	switch(this->actions[env])
+	{
+	case INPUT_UP:
+		ty--;
+		break;
+	case INPUT_DOWN:
+		ty++;
+		break;
+	case INPUT_LEFT:
+		tx--;
+		break;
+	case INPUT_RIGHT:
+		tx++;
+		break;
+	default:
+		return;
+	}
+	if(tx < 0 || ty < 0 || tx >= this->width || ty >= this->height)
+		return;
+
+	size_t from = this->cell(env, x, y);
+	size_t to = this->cell(env, tx, ty);
+	switch(this->type[to])
+	{
+	case CELL_DIAMOND:
+		this->diamonds[env]--;
+		this->reward[env]++;
+		// fall through
+	case CELL_EMPTY:
+	case CELL_SAND:
+		break;
+	case CELL_EXIT:
+		if(this->diamonds[env] > 0)
+			return;
+		this->type[from] = CELL_EMPTY;
+		this->state[env] = MAP_WON;
+		return;
+	default:
+		return;
+	}
+
+	this->type[to] = CELL_PLAYER;
+	this->falling[to] = 0;
+	this->type[from] = CELL_EMPTY;
+	this->falling[from] = 0;
+	this->px[env] = tx;
+	this->py[env] = ty;
+}
+
+/**
+ *  Applies gravity to block of environments (see Map::doGravity()). Rows
+ *  are scanned top down so objects fall all the way in one tick; all lanes
+ *  of cell are processed at once without branches (SSE2 if available,
+ *  otherwise loop over lanes left to compiler).
+ *  \param block        block index
+ */
+void BatchEnv::gravity(int block)
+{
+	size_t cells = (size_t)this->width * this->height;
+	size_t row = (size_t)this->width * BATCH_LANES;
+	Uint8* type = this->type + block * cells * BATCH_LANES;
+	Uint8* falling = this->falling + block * cells * BATCH_LANES;
+	Uint8 active[BATCH_LANES];
+	Uint8 killed[BATCH_LANES];
+	int x, y, l;
+
+	// lanes of ended environments are masked out
+	for(l = 0; l < BATCH_LANES; l++)
+	{
+		int env = block * BATCH_LANES + l;
+
+		active[l] = env < this->count && this->state[env] == MAP_NONE
+			? 0xff : 0;
+		killed[l] = 0;
+	}
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i boulder = _mm_set1_epi8(CELL_BOULDER);
+	const __m128i diamond = _mm_set1_epi8(CELL_DIAMOND);
+	const __m128i player = _mm_set1_epi8(CELL_PLAYER);
+	__m128i act = _mm_loadu_si128((__m128i*)active);
+	__m128i kil = zero;
+#endif /* __SSE2__ */
+
+	for(y = 0; y + 1 < this->height; y++)
+	{
+		Uint8* t = type + y * row;
+		Uint8* f = falling + y * row;
+
+		for(x = 0; x < this->width; x++)
+		{
+#ifdef __SSE2__
+			__m128i c = _mm_loadu_si128((__m128i*)t);
+			__m128i b = _mm_loadu_si128((__m128i*)(t + row));
+			__m128i fl = _mm_loadu_si128((__m128i*)f);
+			__m128i fb = _mm_loadu_si128((__m128i*)(f + row));
+			// masks are 0x00 or 0xff
+			__m128i obj = _mm_and_si128(act, _mm_or_si128(
+				_mm_cmpeq_epi8(c, boulder), _mm_cmpeq_epi8(c, diamond)));
+			__m128i fall = _mm_and_si128(obj, _mm_cmpeq_epi8(b, zero));
+			__m128i kill = _mm_andnot_si128(_mm_cmpeq_epi8(fl, zero),
+				_mm_and_si128(obj, _mm_cmpeq_epi8(b, player)));
+			__m128i moved = _mm_or_si128(fall, kill);
+
+			_mm_storeu_si128((__m128i*)(t + row), _mm_or_si128(
+				_mm_andnot_si128(moved, b), _mm_and_si128(moved, c)));
+			_mm_storeu_si128((__m128i*)(f + row), _mm_or_si128(
+				_mm_andnot_si128(moved, fb), _mm_and_si128(moved, one)));
+			_mm_storeu_si128((__m128i*)t, _mm_andnot_si128(moved, c));
+			// object either moved away or stopped falling
+			_mm_storeu_si128((__m128i*)f, _mm_andnot_si128(obj, fl));
+			kil = _mm_or_si128(kil, kill);
+#else
+			Uint8* tb = t + row;
+			Uint8* fb = f + row;
+
+			for(l = 0; l < BATCH_LANES; l++)
+			{
+				Uint8 c = t[l], b = tb[l], fl = f[l];
+				// masks are 0x00 or 0xff
+				Uint8 obj = -(Uint8)((c == CELL_BOULDER) | (c == CELL_DIAMOND))
+					& active[l];
+				Uint8 fall = obj & -(Uint8)(b == CELL_EMPTY);
+				Uint8 kill = obj & -(Uint8)(b == CELL_PLAYER) & -(Uint8)(fl != 0);
+				Uint8 moved = fall | kill;
+
+				tb[l] = (b & ~moved) | (c & moved);
+				fb[l] = (fb[l] & ~moved) | (moved & 1);
+				t[l] = c & ~moved;
+				// object either moved away or stopped falling
+				f[l] = fl & ~obj;
+				killed[l] |= kill;
+			}
+#endif /* __SSE2__ */
+
+			t += BATCH_LANES;
+			f += BATCH_LANES;
+		}
+	}
+
+#ifdef __SSE2__
+	_mm_storeu_si128((__m128i*)killed, kil);
+#endif /* __SSE2__ */
+	for(l = 0; l < BATCH_LANES; l++)
+		if(killed[l])
+			this->state[block * BATCH_LANES + l] = MAP_LOST;
+}
+
+/**
+ *  Returns index of cell of environment in cell arrays.
+ *  \param env          environment index
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             index into type and falling arrays
+ */
+size_t BatchEnv::cell(int env, int x, int y)
+{
+	size_t cells = (size_t)this->width * this->height;
+
+	return ((env / BATCH_LANES) * cells + (size_t)y * this->width + x)
+		* BATCH_LANES + env % BATCH_LANES;
+}
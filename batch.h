@@ -0,0 +1,104 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// batch.h: batched lockstep environment headers
+
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include "SDL/SDL.h"        // libSDL (Uint8)
+#include "map.h"
+#include "tile.h"
+#include "ui.h"
+
+class Pool;     // pool.h
+
+// environments stored interleaved in one block (SSE2 vector width)
+#define BATCH_LANES 16
+
+
+/**
+ *  Compact cell codes used by BatchEnv.
+ */
+typedef enum
+{
+	CELL_EMPTY      = 0,
+	CELL_WALL,
+	CELL_SAND,
+	CELL_BOULDER,
+	CELL_DIAMOND,
+	CELL_PLAYER,
+	CELL_EXIT
+} BATCHCELL;
+
+
+/**
+ *  Batch of same sized maps stepped in lockstep. Maps are stored as
+ *  structure of arrays in blocks of BATCH_LANES environments where the same
+ *  cell of all environments of block is adjacent in memory, so gravity of
+ *  whole block is applied by vector operations over lanes. Blocks are
+ *  stepped in parallel on worker pool.
+ *
+ *  Rules are the same as Map::movePlayer() followed by Map::doGravity() with
+ *  RuleSet::basic() (objects don't roll), exit is open once all diamonds of
+ *  environment are collected. Creatures are not simulated, their cells are
+ *  loaded as empty.
+ */
+class BatchEnv
+{
+private:
+	int width;
+	int height;
+	int count;              // number of environments
+	int blocks;
+	Pool* pool;
+
+	// per block cells: [block][y * width + x][lane]
+	Uint8* type;
+	Uint8* falling;
+	Uint8* initType;
+	Uint8* initFalling;
+
+	// per environment state
+	int* px;
+	int* py;
+	int* diamonds;
+	int* initDiamonds;
+	MAPSTATE* state;
+	int* reward;
+	const UIINPUT* actions; // actions of current step
+
+	static void job(void* batch, int block);
+	void move(int env);
+	void gravity(int block);
+	size_t cell(int env, int x, int y);
+public:
+	BatchEnv(int width, int height, int count, int threads);
+	~BatchEnv();
+	bool load(int env, Map* map);
+	void reset(int env);
+	void step(const UIINPUT* actions, MAPSTATE* states, int* rewards,
+		bool* done);
+	int getCount();
+	BATCHCELL getCell(int env, int x, int y);
+	int getDiamonds(int env);
+};
+
+
+#endif /* __BATCH_H */
@@ -0,0 +1,432 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// bench.cpp: microbenchmarks of map and UI hot paths
+
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include "tile.h"
+#include "map.h"
+#include "entity.h"
+#include "ui_sdl.h"
+#include "timer.h"
+#include "config.h"
+#include "debug.h"
+
+// minimal time spent measuring one benchmark (ns)
+#define BENCH_MIN_TIME 200000000LL
+// maximal number of iterations of one benchmark
+#define BENCH_MAX_ITERATIONS 100000
+
+
+/**
+ *  Density of synthetic map content (probabilities in per mille).
+ */
+typedef struct
+{
+	const char* name;
+	int sand;
+	int boulders;
+	int diamonds;
+	int creatures;
+} BENCHDENSITY;
+
+/**
+ *  Result of single benchmark run.
+ */
+typedef struct
+{
+	const char* name;
+	int width;
+	int height;
+	const char* density;
+	long long iterations;
+	double nsPerOp;
+	double cellsPerSecond;
+	double allocsPerOp;
+	double bytesPerOp;
+} BENCHRESULT;
+
+/**
+ *  Shared state of benchmarked operation.
+ */
+typedef struct
+{
+	Map* map;
+	SDLUI* ui;
+	const char* filename;
+	int step;
+} BENCHCONTEXT;
+
+typedef void (*BENCHOP)(BENCHCONTEXT* ctx);
+
+
+static const BENCHDENSITY densities[] =
+{
+	{ "sparse", 100, 20, 10, 5 },
+	{ "dense", 500, 200, 50, 5 }
+};
+
+static const int sizes[] = { 64, 256, 1024, 4096, 8192 };
+
+// allocation counters (see operator new below)
+static long long allocCount = 0;
+static long long allocBytes = 0;
+
+
+/**
+ *  Counting replacement of global operator new. Map allocates every tile
+ *  separately so allocations are worth watching.
+ */
+void* operator new(size_t size)
+{
+	void* p = malloc(size ? size : 1);
+	if(!p)
+		throw bad_alloc();
+
+	__sync_fetch_and_add(&allocCount, 1);
+	__sync_fetch_and_add(&allocBytes, (long long)size);
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+/**
+ *  Writes synthetic map of given size and density. Map is surrounded by wall,
+ *  player is in the middle of map with free space around and exit is in the
+ *  bottom right corner so findTileType() has to scan whole map to find it.
+ *  \param filename     map filename
+ *  \param width        map width
+ *  \param height       map height
+ *  \param density      map content density
+ *  \return             true if success
+ */
+static bool writeMap(const char* filename, int width, int height,
+	const BENCHDENSITY* density)
+{
+	FILE* f = fopen(filename, "w");
+	char* line;
+	unsigned int seed = 0x5eed;
+	int x, y;
+
+	if(!f)
+	{
+		error(false, "couldn't create map file: %s", filename);
+		return false;
+	}
+
+	line = new char[width + 2];
+	for(y = 0; y < height; y++)
+	{
+		for(x = 0; x < width; x++)
+		{
+			int r;
+
+			seed = seed * 1103515245 + 12345;
+			r = (seed >> 16) % 1000;
+
+			if(x == 0 || y == 0 || x == width - 1 || y == height - 1)
+				line[x] = TILE_WALL;
+			else if(r < density->boulders)
+				line[x] = TILE_BOULDER;
+			else if(r < density->boulders + density->diamonds)
+				line[x] = TILE_DIAMOND;
+			else if(r < density->boulders + density->diamonds + density->sand)
+				line[x] = TILE_SAND;
+			else if(r < density->boulders + density->diamonds + density->sand +
+				density->creatures)
+				line[x] = r & 1 ? ENTITY_FIREFLY : ENTITY_BUTTERFLY;
+			else
+				line[x] = ' ';
+
+			// free space for player to walk
+			if(y == height / 2 && x >= width / 2 - 1 && x <= width / 2 + 1)
+				line[x] = ' ';
+			if(y == height / 2 - 1 && x >= width / 2 - 1 && x <= width / 2 + 1)
+				line[x] = TILE_WALL;
+		}
+		if(y == height / 2)
+			line[width / 2] = TILE_PLAYER;
+		if(y == height - 2)
+			line[width - 2] = TILE_EXIT;
+
+		line[width] = '\n';
+		line[width + 1] = '\0';
+		fputs(line, f);
+	}
+	delete[] line;
+	fclose(f);
+
+	return true;
+}
+
+/**
+ *  Runs operation repeatedly (at least once, at least BENCH_MIN_TIME) and
+ *  measures time and allocations.
+ *  \param name         benchmark name
+ *  \param op           benchmarked operation
+ *  \param ctx          operation context
+ *  \param cells        number of map cells processed by one operation
+ *  \param result       pointer to result (filled in)
+ */
+static void measure(const char* name, BENCHOP op, BENCHCONTEXT* ctx,
+	long long cells, BENCHRESULT* result)
+{
+	long long iterations = 0;
+	long long start, elapsed;
+	long long allocs = allocCount;
+	long long bytes = allocBytes;
+
+	start = timerNow();
+	do
+	{
+		op(ctx);
+		iterations++;
+		elapsed = timerNow() - start;
+	}
+	while(elapsed < BENCH_MIN_TIME && iterations < BENCH_MAX_ITERATIONS);
+
+	result->name = name;
+	result->iterations = iterations;
+	result->nsPerOp = (double)elapsed / iterations;
+	result->cellsPerSecond = cells * 1e9 / result->nsPerOp;
+	result->allocsPerOp = (double)(allocCount - allocs) / iterations;
+	result->bytesPerOp = (double)(allocBytes - bytes) / iterations;
+}
+
+// benchmarked operations
+
+static void opLoad(BENCHCONTEXT* ctx)
+{
+	ctx->map->load(ctx->filename);
+}
+
+static void opGravity(BENCHCONTEXT* ctx)
+{
+	ctx->map->doGravity();
+}
+
+static void opCreatures(BENCHCONTEXT* ctx)
+{
+	ctx->map->moveCreatures();
+}
+
+static void opMove(BENCHCONTEXT* ctx)
+{
+	// step left and back right
+	ctx->map->movePlayer(ctx->step & 1 ? 1 : -1, 0);
+	ctx->step++;
+}
+
+static void opFind(BENCHCONTEXT* ctx)
+{
+	int x = 0, y = 0;
+	ctx->map->findTileType(TILE_EXIT, &x, &y);
+}
+
+static void opDraw(BENCHCONTEXT* ctx)
+{
+	ctx->ui->draw(ctx->map);
+}
+
+/**
+ *  Prints result as human readable line.
+ *  \param r            benchmark result
+ */
+static void printResult(const BENCHRESULT* r)
+{
+	printf("%-9s %5dx%-5d %-7s %10lld it %14.0f ns/op %14.0f cells/s "
+		"%10.1f allocs/op %12.0f B/op\n",
+		r->name, r->width, r->height, r->density, r->iterations,
+		r->nsPerOp, r->cellsPerSecond, r->allocsPerOp, r->bytesPerOp);
+	fflush(stdout);
+}
+
+/**
+ *  Writes all results as JSON document.
+ *  \param filename     output filename
+ *  \param results      benchmark results
+ *  \param count        number of results
+ *  \return             true if success
+ */
+static bool writeJson(const char* filename, const BENCHRESULT* results,
+	int count)
+{
+	FILE* f = fopen(filename, "w");
+	int i;
+
+	if(!f)
+	{
+		error(false, "couldn't create json file: %s", filename);
+		return false;
+	}
+
+	fprintf(f, "{\n\t\"version\": \"%s\",\n", VERSION);
+#ifdef DEBUG
+	fprintf(f, "\t\"debug\": true,\n");
+#else
+	fprintf(f, "\t\"debug\": false,\n");
+#endif /* DEBUG */
+	fprintf(f, "\t\"benchmarks\": [\n");
+	for(i = 0; i < count; i++)
+	{
+		const BENCHRESULT* r = &results[i];
+
+		fprintf(f, "\t\t{\"name\": \"%s\", \"width\": %d, \"height\": %d, "
+			"\"density\": \"%s\", \"iterations\": %lld, "
+			"\"ns_per_op\": %.1f, \"cells_per_s\": %.1f, "
+			"\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}%s\n",
+			r->name, r->width, r->height, r->density, r->iterations,
+			r->nsPerOp, r->cellsPerSecond, r->allocsPerOp, r->bytesPerOp,
+			i + 1 < count ? "," : "");
+	}
+	fprintf(f, "\t]\n}\n");
+	fclose(f);
+
+	return true;
+}
+
+/**
+ *  Prints usage.
+ *  \param argv0        program name
+ *  \return             EXIT_FAILURE
+ */
+static int usage(const char* argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [-s max_size] [-b benchmark] [-j results.json]\n"
+		"  -s max_size   largest synthetic map edge (64..8192, default 8192)\n"
+		"  -b benchmark  run only load, gravity, creatures, move, find or draw\n"
+		"  -j file       write results as JSON\n",
+		argv0
+	);
+
+	return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv)
+{
+	static const struct
+	{
+		const char* name;
+		BENCHOP op;
+	} benchmarks[] =
+	{
+		{ "load",    opLoad },
+		{ "gravity", opGravity },
+		{ "creatures", opCreatures },
+		{ "move",    opMove },
+		{ "find",    opFind },
+		{ "draw",    opDraw }
+	};
+	const int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+	const int ndensities = sizeof(densities) / sizeof(densities[0]);
+	const int nbenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	int maxSize = 8192;
+	const char* only = NULL;
+	const char* json = NULL;
+	char filename[64];
+	int i, s, d, b;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-s") && i + 1 < argc)
+			maxSize = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+			only = argv[++i];
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+			json = argv[++i];
+		else
+			return usage(argv[0]);
+	}
+
+	// draw into offscreen surface, no window needed
+	SDL_putenv((char*)"SDL_VIDEODRIVER=dummy");
+	SDLUI* ui = new SDLUI();
+
+	BENCHRESULT* results = new BENCHRESULT[nsizes * ndensities * nbenchmarks];
+	int count = 0;
+
+	snprintf(filename, sizeof(filename), "/tmp/cppdash_bench_%d.txt",
+		(int)getpid());
+
+	for(s = 0; s < nsizes && sizes[s] <= maxSize; s++)
+		for(d = 0; d < ndensities; d++)
+		{
+			if(!writeMap(filename, sizes[s], sizes[s], &densities[d]))
+				return EXIT_FAILURE;
+
+			for(b = 0; b < nbenchmarks; b++)
+			{
+				BENCHCONTEXT ctx;
+				BENCHRESULT* r = &results[count];
+
+				if(only && strcmp(only, benchmarks[b].name))
+					continue;
+
+				// every benchmark starts with freshly loaded map
+				ctx.map = new Map();
+				ctx.ui = ui;
+				ctx.filename = filename;
+				ctx.step = 0;
+				if(ctx.map->load(filename) < 0)
+					return EXIT_FAILURE;
+				// let everything fall so gravity measures steady state
+				if(benchmarks[b].op == opGravity)
+					ctx.map->doGravity();
+
+				measure(benchmarks[b].name, benchmarks[b].op, &ctx,
+					(long long)sizes[s] * sizes[s], r);
+				r->width = sizes[s];
+				r->height = sizes[s];
+				r->density = densities[d].name;
+				printResult(r);
+				count++;
+
+				delete ctx.map;
+			}
+		}
+	unlink(filename);
+
+	if(json && !writeJson(json, results, count))
+		return EXIT_FAILURE;
+
+	delete[] results;
+	delete ui;
+
+	return EXIT_SUCCESS;
+}
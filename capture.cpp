@@ -0,0 +1,324 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// capture.cpp: asynchronous video capture
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+#include "capture.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+// stdio buffer of output file
+#define CAPTURE_BUFFER (4 << 20)
+
+
+/**
+ *  Constructor.
+ */
+Capture::Capture()
+{
+	this->file = NULL;
+	this->buffer = NULL;
+	this->y4m = false;
+	this->width = 0;
+	this->height = 0;
+	this->pool = NULL;
+	this->palettes = NULL;
+	this->head = 0;
+	this->tail = 0;
+	this->freeFrames = NULL;
+	this->fullFrames = NULL;
+	this->thread = NULL;
+	this->failed = false;
+	this->yuv = NULL;
+	this->chroma = NULL;
+	this->captured = 0;
+	this->dropped = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Capture::~Capture()
+{
+	this->close();
+}
+
+/**
+ *  Creates output file, allocates frame pool and starts writer thread.
+ *  \param filename     output filename (.y4m for Y4M, otherwise raw I420)
+ *  \param width        frame width (even)
+ *  \param height       frame height (even)
+ *  \return             true if success
+ */
+bool Capture::open(const char* filename, int width, int height)
+{
+	assert(filename);
+	assert(width > 0 && height > 0 && !(width & 1) && !(height & 1));
+
+	this->close();
+
+	this->file = fopen(filename, "wb");
+	if(!this->file)
+	{
+		error(false, "couldn't create capture file: %s", filename);
+		return false;
+	}
+	this->buffer = new char[CAPTURE_BUFFER];
+	setvbuf(this->file, this->buffer, _IOFBF, CAPTURE_BUFFER);
+
+	size_t len = strlen(filename);
+	this->y4m = len >= 4 && !strcmp(filename + len - 4, ".y4m");
+	if(this->y4m)
+		fprintf(this->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+			width, height, CAPTURE_FPS);
+
+	this->width = width;
+	this->height = height;
+	this->pool = new Uint8[(size_t)CAPTURE_FRAMES * width * height];
+	this->palettes = new Uint32[CAPTURE_FRAMES * 256];
+	this->yuv = new Uint8[(size_t)width * height * 3 / 2];
+	this->chroma = new Uint16[width * 2];
+	this->head = 0;
+	this->tail = 0;
+	this->failed = false;
+	this->captured = 0;
+	this->dropped = 0;
+
+	this->freeFrames = SDL_CreateSemaphore(CAPTURE_FRAMES);
+	this->fullFrames = SDL_CreateSemaphore(0);
+	this->thread = SDL_CreateThread(Capture::writer, this);
+
+	info("capturing %dx%d %s video: %s", width, height,
+		this->y4m ? "Y4M" : "raw I420", filename);
+	return true;
+}
+
+/**
+ *  Copies presented frame into pool for writer. Never blocks, frame is
+ *  dropped if writer is CAPTURE_FRAMES frames behind.
+ *  \param surface      frame (8 bit surface of capture size, locked if needed)
+ */
+void Capture::frame(SDL_Surface* surface)
+{
+	assert(surface);
+
+	if(!this->file)
+		return;
+
+	SDL_Palette* palette = surface->format->palette;
+	if(!palette || surface->format->BytesPerPixel != 1 ||
+		surface->w < this->width || surface->h < this->height)
+		return;
+
+	TRACE_SCOPE("Capture::frame");
+
+	if(SDL_SemTryWait(this->freeFrames) != 0)
+	{
+		this->dropped++;
+		return;
+	}
+
+	unsigned int i = this->tail % CAPTURE_FRAMES;
+	Uint8* pixels = this->pool + (size_t)i * this->width * this->height;
+	Uint32* colors = this->palettes + i * 256;
+	int y, c;
+
+	for(c = 0; c < 256; c++)
+		colors[c] = c < palette->ncolors ? palette->colors[c].r << 16 |
+			palette->colors[c].g << 8 | palette->colors[c].b : 0;
+	for(y = 0; y < this->height; y++)
+		memcpy(pixels + y * this->width,
+			(Uint8*)surface->pixels + y * surface->pitch, this->width);
+
+	this->tail++;
+	this->captured++;
+	SDL_SemPost(this->fullFrames);
+}
+
+/**
+ *  Writes all queued frames, stops writer and closes file.
+ *  \return             true if all frames were written
+ */
+bool Capture::close()
+{
+	if(!this->file)
+		return true;
+
+	// writer finds no frame for this post and quits
+	SDL_SemPost(this->fullFrames);
+	SDL_WaitThread(this->thread, NULL);
+	SDL_DestroySemaphore(this->freeFrames);
+	SDL_DestroySemaphore(this->fullFrames);
+
+	bool ok = !this->failed;
+	if(fclose(this->file) != 0)
+	{
+		error(false, "couldn't write capture file");
+		ok = false;
+	}
+	info("%lld frames captured, %lld dropped", this->captured, this->dropped);
+
+	delete[] this->buffer;
+	delete[] this->pool;
+	delete[] this->palettes;
+	delete[] this->yuv;
+	delete[] this->chroma;
+	this->file = NULL;
+	this->buffer = NULL;
+	this->pool = NULL;
+	this->palettes = NULL;
+	this->yuv = NULL;
+	this->chroma = NULL;
+	this->thread = NULL;
+	this->freeFrames = NULL;
+	this->fullFrames = NULL;
+
+	return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Writer thread. Converts and writes frames in order until close().
+ *  \param capture      pointer to Capture
+ *  \return             0
+ */
+int Capture::writer(void* capture)
+{
+	Capture* self = (Capture*)capture;
+	size_t frame = (size_t)self->width * self->height;
+
+	for(;;)
+	{
+		SDL_SemWait(self->fullFrames);
+		if(self->head == self->tail)
+			break;
+
+		unsigned int i = self->head % CAPTURE_FRAMES;
+		if(!self->failed)
+		{
+			self->convert(self->pool + i * frame, self->palettes + i * 256);
+			if((self->y4m && fputs("FRAME\n", self->file) == EOF) ||
+				fwrite(self->yuv, frame * 3 / 2, 1, self->file) != 1)
+			{
+				error(false, "couldn't write capture file");
+				self->failed = true;
+			}
+		}
+
+		self->head++;
+		SDL_SemPost(self->freeFrames);
+	}
+
+	return 0;
+}
+
+/**
+ *  Converts frame of palette indices to planar YUV 4:2:0 (BT.601 studio
+ *  range). Palette is converted once to luma and chroma tables, chroma of
+ *  2x2 block is average of vertical averages of its two columns.
+ *  \param pixels       frame
+ *  \param palette      0xRRGGBB palette of frame
+ */
+void Capture::convert(const Uint8* pixels, const Uint32* palette)
+{
+	TRACE_SCOPE("Capture::convert");
+
+	Uint8 luma[256];
+	Uint16 uv[256];         // U | V << 8
+	int w = this->width, h = this->height;
+	Uint8* yp = this->yuv;
+	Uint8* up = yp + w * h;
+	Uint8* vp = up + w * h / 4;
+	int i, x, y;
+
+	for(i = 0; i < 256; i++)
+	{
+		int r = palette[i] >> 16 & 255;
+		int g = palette[i] >> 8 & 255;
+		int b = palette[i] & 255;
+
+		luma[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		uv[i] = (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128) |
+			(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128) << 8;
+	}
+
+	for(y = 0; y < h; y += 2)
+	{
+		const Uint8* p0 = pixels + y * w;
+		const Uint8* p1 = p0 + w;
+		Uint16* c0 = this->chroma;
+		Uint16* c1 = c0 + w;
+
+		for(x = 0; x < w; x++)
+		{
+			yp[x] = luma[p0[x]];
+			yp[x + w] = luma[p1[x]];
+			c0[x] = uv[p0[x]];
+			c1[x] = uv[p1[x]];
+		}
+		yp += 2 * w;
+
+		x = 0;
+#ifdef __SSE2__
+		// 16 source pixels (8 per register) make 8 chroma samples
+		const __m128i mask = _mm_set1_epi32(0xff);
+		for(; x + 16 <= w; x += 16)
+		{
+			__m128i a = _mm_avg_epu8(_mm_loadu_si128((__m128i*)(c0 + x)),
+				_mm_loadu_si128((__m128i*)(c1 + x)));
+			__m128i b = _mm_avg_epu8(_mm_loadu_si128((__m128i*)(c0 + x + 8)),
+				_mm_loadu_si128((__m128i*)(c1 + x + 8)));
+			// average column pairs into low half of 32 bit lanes
+			a = _mm_avg_epu8(a, _mm_srli_epi32(a, 16));
+			b = _mm_avg_epu8(b, _mm_srli_epi32(b, 16));
+			__m128i u = _mm_packs_epi32(_mm_and_si128(a, mask),
+				_mm_and_si128(b, mask));
+			__m128i v = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask),
+				_mm_and_si128(_mm_srli_epi32(b, 8), mask));
+			_mm_storel_epi64((__m128i*)(up + x / 2), _mm_packus_epi16(u, u));
+			_mm_storel_epi64((__m128i*)(vp + x / 2), _mm_packus_epi16(v, v));
+		}
+#endif /* __SSE2__ */
+		for(; x < w; x += 2)
+		{
+			// same rounding as SSE2 path
+			int u0 = ((c0[x] & 255) + (c1[x] & 255) + 1) >> 1;
+			int u1 = ((c0[x + 1] & 255) + (c1[x + 1] & 255) + 1) >> 1;
+			int v0 = ((c0[x] >> 8) + (c1[x] >> 8) + 1) >> 1;
+			int v1 = ((c0[x + 1] >> 8) + (c1[x + 1] >> 8) + 1) >> 1;
+
+			up[x / 2] = (u0 + u1 + 1) >> 1;
+			vp[x / 2] = (v0 + v1 + 1) >> 1;
+		}
+		up += w / 2;
+		vp += w / 2;
+	}
+}
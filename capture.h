@@ -0,0 +1,75 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// capture.h: asynchronous video capture headers
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+#include <cstdio>
+#include "SDL/SDL.h"        // libSDL
+
+// frames in pool (frames are dropped when writer is this many behind)
+#define CAPTURE_FRAMES 16
+// nominal frame rate written to Y4M header (frames are not timed)
+#define CAPTURE_FPS 60
+
+
+/**
+ *  Video capture of presented frames. Game thread copies 8 bit frame and its
+ *  palette into preallocated pool and never waits: if pool is full, frame is
+ *  dropped. Background writer converts frames to YUV 4:2:0 (BT.601, chroma
+ *  averaged over 2x2 pixels by SSE2 where available) and streams them to
+ *  Y4M file (if name ends with .y4m) or raw I420 planes.
+ */
+class Capture
+{
+private:
+	FILE* file;
+	char* buffer;               // stdio buffer (large sequential writes)
+	bool y4m;
+	int width;
+	int height;
+
+	Uint8* pool;                // CAPTURE_FRAMES frames of palette indices
+	Uint32* palettes;           // 0xRRGGBB palette of each pool frame
+	volatile unsigned int head; // next frame written by writer
+	volatile unsigned int tail; // next frame filled by game
+	SDL_sem* freeFrames;
+	SDL_sem* fullFrames;
+	SDL_Thread* thread;
+	volatile bool failed;
+
+	Uint8* yuv;                 // converted frame
+	Uint16* chroma;             // U | V << 8 of two source rows
+	long long captured;
+	long long dropped;
+
+	static int writer(void* capture);
+	void convert(const Uint8* pixels, const Uint32* palette);
+public:
+	Capture();
+	~Capture();
+	bool open(const char* filename, int width, int height);
+	void frame(SDL_Surface* surface);
+	bool close();
+};
+
+
+#endif /* __CAPTURE_H */
@@ -26,6 +26,15 @@
 // Enable debugging
 #cmakedefine DEBUG
 
+// Lowest log level built in (0 debug, 1 info, 2 warning, 3 error)
+#define LOG_LEVEL           @LOG_LEVEL@
+
+// Enable trace points
+#cmakedefine TRACE
+
+// Enable memory accounting
+#cmakedefine MEMSTATS
+
 // Version
 #cmakedefine VERSION        "@VERSION@"
 
@@ -23,16 +23,449 @@ using namespace std;
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "tile.h"
 #include "map.h"
 #include "ui_sdl.h"
+#include "ui_term.h"
+#include "game.h"
+#include "validate.h"
+#include "gen.h"
+#include "host.h"
+#include "batch.h"
+#include "ui_script.h"
+#include "stats.h"
+#include "publish.h"
+#include "capture.h"
+#include "watch.h"
+#include "pack.h"
+#include "rewind.h"
+#include "path.h"
+#include "timer.h"
+#include "mem.h"
+#include "trace.h"
+#include "log.h"
 #include "config.h"
 #include "debug.h"
 
+// default rewind history of interactive game (MB)
+#define PLAY_REWIND_MB 16
+// wake up period of idle game (animations, watched file)
+#define PLAY_IDLE_MS 100
 
-int main(int argc, char** argv)
+
+/**
+ *  Prints usage.
+ *  \param argv0        program name
+ *  \return             EXIT_FAILURE
+ */
+static int usage(const char* argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [--hud] [--metrics metrics.csv|.json] [--replay moves.txt]\n"
+		"           [--publish /name] [--capture video.y4m|.yuv] [--watch]\n"
+		"           [--rewind MB] [--zoom 1-4] [--term] /path/to/map.txt\n"
+		"       %s [options] --level n|name levels.pack\n"
+		"       %s --pack-build levels.pack map.txt...\n"
+		"       %s --validate [-j threads] [-o report.jsonl] map.txt...\n"
+		"       %s --generate [-w width] [-h height] [-s seed] [-j threads]\n"
+		"           [--boulders n] [--diamonds n] [--walls n] [--sand n]\n"
+		"           [--caves n] [--creatures n] out.txt\n"
+		"       %s --host [-n games] [-j threads] [-r rounds] [-p period]\n"
+		"           [-i script.txt] map.txt...\n"
+		"       %s --batch [-b envs] [-j threads] [-s steps] map.txt\n"
+		"       %s --spectate /name\n"
+		"Global options (any mode):\n"
+		"  --trace file  record trace in Chrome trace event format\n"
+		"  --mem         print memory usage of subsystems at exit\n",
+		argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0
+	);
+
+	return EXIT_FAILURE;
+}
+
+/**
+ *  Validates map files given on command line in parallel and writes report
+ *  (one JSON object per map and line) to stdout or file.
+ *  \param argc         number of arguments (after --validate)
+ *  \param argv         arguments (after --validate)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if all maps are playable
+ */
+static int validate(int argc, char** argv, const char* argv0)
+{
+	int threads = 0;
+	const char* output = NULL;
+	FILE* f = stdout;
+	int i;
+
+	// options
+	for(i = 0; i < argc && argv[i][0] == '-'; i++)
+	{
+		if(!strcmp(argv[i], "-j") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+			return usage(argv0);
+	}
+	if(i == argc)
+		return usage(argv0);
+
+	long long start = timerNow();
+	Validator validator(threads);
+	int failed = validator.run(argv + i, argc - i);
+	long long elapsed = timerNow() - start;
+
+	if(output && !(f = fopen(output, "w")))
+	{
+		error(false, "couldn't open report file: %s", output);
+		return EXIT_FAILURE;
+	}
+	validator.report(f);
+	if(f != stdout)
+		fclose(f);
+
+	validator.summary(stderr);
+	fprintf(stderr, "validated in %.3f s\n", elapsed / 1e9);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ *  Generates map file with given size, seed and densities (per mille).
+ *  \param argc         number of arguments (after --generate)
+ *  \param argv         arguments (after --generate)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if map was written
+ */
+static int generate(int argc, char** argv, const char* argv0)
+{
+	GENPARAMS params;
+	int threads = 0;
+	int i;
+
+	Generator::defaults(&params);
+
+	// options
+	for(i = 0; i < argc - 1 && argv[i][0] == '-'; i++)
+	{
+		const char* o = argv[i];
+		int v = atoi(argv[++i]);
+
+		if(!strcmp(o, "-w"))
+			params.width = v;
+		else if(!strcmp(o, "-h"))
+			params.height = v;
+		else if(!strcmp(o, "-s"))
+			params.seed = (unsigned int)strtoul(argv[i], NULL, 0);
+		else if(!strcmp(o, "-j"))
+			threads = v;
+		else if(!strcmp(o, "--boulders"))
+			params.boulders = v;
+		else if(!strcmp(o, "--diamonds"))
+			params.diamonds = v;
+		else if(!strcmp(o, "--walls"))
+			params.walls = v;
+		else if(!strcmp(o, "--sand"))
+			params.sand = v;
+		else if(!strcmp(o, "--caves"))
+			params.caves = v;
+		else if(!strcmp(o, "--creatures"))
+			params.creatures = v;
+		else
+			return usage(argv0);
+	}
+	if(i != argc - 1)
+		return usage(argv0);
+	if(params.width < 4 || params.height < 4)
+	{
+		error(false, "map must be at least 4x4 tiles");
+		return EXIT_FAILURE;
+	}
+
+	long long start = timerNow();
+	Generator generator(&params, threads);
+	if(!generator.write(argv[i]))
+		return EXIT_FAILURE;
+
+	fprintf(stderr, "generated %dx%d map in %.3f s\n",
+		params.width, params.height, (timerNow() - start) / 1e9);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *  Packs map files into level pack.
+ *  \param argc         number of arguments (after --pack-build)
+ *  \param argv         arguments (after --pack-build)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if pack was written
+ */
+static int packBuild(int argc, char** argv, const char* argv0)
+{
+	if(argc < 2)
+		return usage(argv0);
+
+	return LevelPack::build(argv[0], argv + 1, argc - 1) ?
+		EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *  Runs many games in one process on worker pool and reports aggregate tick
+ *  rate. Games cycle through given maps, each game reads its own copy of
+ *  move script or (without script) moves randomly.
+ *  \param argc         number of arguments (after --host)
+ *  \param argv         arguments (after --host)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if all maps were loaded
+ */
+static int host(int argc, char** argv, const char* argv0)
+{
+	int games = 1000;
+	int threads = 0;
+	long long rounds = 1000;
+	int period = 1;
+	char* script = NULL;
+	int i, g;
+
+	// options
+	for(i = 0; i < argc - 1 && argv[i][0] == '-'; i++)
+	{
+		const char* o = argv[i++];
+
+		if(!strcmp(o, "-n"))
+			games = atoi(argv[i]);
+		else if(!strcmp(o, "-j"))
+			threads = atoi(argv[i]);
+		else if(!strcmp(o, "-r"))
+			rounds = atoll(argv[i]);
+		else if(!strcmp(o, "-p"))
+			period = atoi(argv[i]);
+		else if(!strcmp(o, "-i"))
+		{
+			delete[] script;
+			if(!(script = ScriptUI::load(argv[i])))
+				return EXIT_FAILURE;
+		}
+		else
+			return usage(argv0);
+	}
+	if(i == argc || games < 1)
+		return usage(argv0);
+
+	Host host(threads);
+	for(g = 0; g < games; g++)
+	{
+		Map* map = new Map();
+		if(map->load(argv[i + g % (argc - i)]) < 0)
+		{
+			delete map;
+			delete[] script;
+			return EXIT_FAILURE;
+		}
+
+		if(script)
+			host.add(map, new ScriptUI(script), period);
+		else
+			host.add(map, new ScriptUI((unsigned int)g), period);
+	}
+
+	long long start = timerNow();
+	host.run(rounds);
+	host.report(stderr, (timerNow() - start) / 1e9);
+
+	delete[] script;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *  Steps batch of environments made of the same map with random actions
+ *  (ended environments are reset) and reports environment steps per second.
+ *  \param argc         number of arguments (after --batch)
+ *  \param argv         arguments (after --batch)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if map was loaded
+ */
+static int batch(int argc, char** argv, const char* argv0)
+{
+	int envs = 256;
+	int threads = 0;
+	int steps = 1000;
+	unsigned int seed = 1;
+	int i, s;
+
+	// options
+	for(i = 0; i < argc - 1 && argv[i][0] == '-'; i++)
+	{
+		const char* o = argv[i++];
+
+		if(!strcmp(o, "-b"))
+			envs = atoi(argv[i]);
+		else if(!strcmp(o, "-j"))
+			threads = atoi(argv[i]);
+		else if(!strcmp(o, "-s"))
+			steps = atoi(argv[i]);
+		else
+			return usage(argv0);
+	}
+	if(i != argc - 1 || envs < 1)
+		return usage(argv0);
+
+	Map map;
+	if(map.load(argv[i]) < 0)
+		return EXIT_FAILURE;
+
+	BatchEnv env(map.getWidth(), map.getHeight(), envs, threads);
+	for(i = 0; i < envs; i++)
+		if(!env.load(i, &map))
+			return EXIT_FAILURE;
+
+	UIINPUT* actions = new UIINPUT[envs];
+	bool* done = new bool[envs];
+	int* rewards = new int[envs];
+	long long diamonds = 0, episodes = 0;
+
+	long long start = timerNow();
+	for(s = 0; s < steps; s++)
+	{
+		for(i = 0; i < envs; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			actions[i] = (UIINPUT)((seed >> 16) % 4);
+		}
+
+		env.step(actions, NULL, rewards, done);
+
+		for(i = 0; i < envs; i++)
+		{
+			diamonds += rewards[i];
+			if(done[i])
+			{
+				episodes++;
+				env.reset(i);
+			}
+		}
+	}
+	double seconds = (timerNow() - start) / 1e9;
+
+	fprintf(stderr, "%d envs, %d steps in %.3f s (%.0f env steps/s), "
+		"%lld episodes ended, %lld diamonds collected\n",
+		envs, steps, seconds, seconds > 0 ? envs * (double)steps / seconds : 0.0,
+		episodes, diamonds);
+
+	delete[] actions;
+	delete[] done;
+	delete[] rewards;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *  Attaches to frames published by running game (--publish) and reports
+ *  them once per second until game ends. Slots are read in place, torn reads
+ *  (slot rewritten while read) are counted and skipped.
+ *  \param argc         number of arguments (after --spectate)
+ *  \param argv         arguments (after --spectate)
+ *  \param argv0        program name
+ *  \return             EXIT_SUCCESS if game was found
+ */
+static int spectate(int argc, char** argv, const char* argv0)
 {
+	Spectator spectator;
+	Uint32 last = 0;
+	long long frames = 0, missed = 0, torn = 0;
+	long long report = 0;
+
+	if(argc != 1)
+		return usage(argv0);
+	if(!spectator.attach(argv[0]))
+		return EXIT_FAILURE;
+
+	const PUBLISHHEADER* header = spectator.getHeader();
+	fprintf(stderr, "attached to %s: frame %ux%u, map %ux%u\n", argv[0],
+		header->frameWidth, header->frameHeight, header->gridWidth,
+		header->gridHeight);
+
+	while(!header->closed)
+	{
+		Uint32 seq;
+		const PUBLISHSLOT* slot = spectator.latest(&seq);
+		if(!slot || slot->frame == last)
+		{
+			SDL_Delay(1);
+			continue;
+		}
+
+		// diamonds lying on map (straight from shared grid)
+		const char* grid = spectator.getGrid(slot);
+		Uint32 cells = header->gridWidth * header->gridHeight;
+		Uint32 i, lying = 0;
+		for(i = 0; i < cells; i++)
+			if(grid[i] == TILE_DIAMOND)
+				lying++;
+
+		Uint32 frame = slot->frame;
+		int state = slot->state;
+		int x = slot->playerX, y = slot->playerY;
+		Uint32 creatures = slot->creatures;
+		if(!spectator.valid(slot, seq))
+		{
+			torn++;
+			continue;
+		}
+
+		if(last)
+			missed += frame - last - 1;
+		last = frame;
+		frames++;
+
+		long long now = timerNow();
+		if(now >= report || state != MAP_NONE)
+		{
+			printf("frame %u: player %d,%d, %u diamonds on map, "
+				"%u creatures, %s\n", frame, x, y, lying, creatures,
+				state == MAP_WON ? "won" : state == MAP_LOST ? "lost" :
+				"playing");
+			fflush(stdout);
+			report = now + 1000000000LL;
+		}
+	}
+
+	fprintf(stderr, "game closed: %lld frames read, %lld missed, %lld torn\n",
+		frames, missed, torn);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *  Interactive game.
+ *  \param argc         number of arguments (after program name)
+ *  \param argv         arguments (map file)
+ *  \param argv0        program name
+ *  \return             exit status
+ */
+static int play(int argc, char** argv, const char* argv0)
+{
+	FrameStats stats;
+	Publisher publisher;
+	const char* publish = NULL;
+	Capture capture;
+	const char* video = NULL;
+	FileWatch watch;
+	bool reload = false;
+	LevelPack pack;
+	const char* level = NULL;
+	int rewind = PLAY_REWIND_MB;
+	int zoom = 1;
+	Rewind* history = NULL;
+	Path path;
+	MAPSTATE state = MAP_NONE;
+	ScriptUI* replay = NULL;
+	char* script = NULL;
+	bool hud = false;
+	bool term = false;
+	bool winnable = true;
 	int done = 0;
+	int i;
 
 	printf("C++dash (%s) - Yet another `Boulder Dash' clone\n"
 		"Author: Ondrej Balaz <ondra@blami.net>\n"
@@ -41,79 +474,313 @@ int main(int argc, char** argv)
 		VERSION);
 
 	// process arguments
-	if(argc < 2)
+	for(i = 0; i < argc - 1 && argv[i][0] == '-'; i++)
 	{
-		fprintf(stderr,
-			"error: path to map file is missing!\n"
-			"Usage: %s /path/to/map.txt\n",
-			argv[0]
-		);
-
-		return EXIT_FAILURE;
+		if(!strcmp(argv[i], "--hud"))
+			hud = true;
+		else if(!strcmp(argv[i], "--term"))
+			term = true;
+		else if(!strcmp(argv[i], "--metrics") && i + 2 < argc)
+		{
+			if(!stats.openMetrics(argv[++i]))
+				return EXIT_FAILURE;
+		}
+		else if(!strcmp(argv[i], "--replay") && i + 2 < argc)
+		{
+			delete[] script;
+			if(!(script = ScriptUI::load(argv[++i])))
+				return EXIT_FAILURE;
+		}
+		else if(!strcmp(argv[i], "--publish") && i + 2 < argc)
+			publish = argv[++i];
+		else if(!strcmp(argv[i], "--capture") && i + 2 < argc)
+			video = argv[++i];
+		else if(!strcmp(argv[i], "--watch"))
+			reload = true;
+		else if(!strcmp(argv[i], "--level") && i + 2 < argc)
+			level = argv[++i];
+		else if(!strcmp(argv[i], "--rewind") && i + 2 < argc)
+			rewind = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "--zoom") && i + 2 < argc &&
+			(zoom = atoi(argv[i + 1])) >= 1 && zoom <= SDLUI_MAX_ZOOM)
+			i++;
+		else
+			return usage(argv0);
+	}
+	if(i == argc)
+	{
+		fprintf(stderr, "error: path to map file is missing!\n");
+		return usage(argv0);
 	}
 
 	debug("init");
 
 	// initialize map
 	Map* map = new Map();
-	map->load(argv[1]);
+	if(level)
+	{
+		// level by number (from 1) or by name
+		if(!pack.open(argv[i]))
+		{
+			delete map;
+			return EXIT_FAILURE;
+		}
+		int n = atoi(level) - 1;
+		if(n < 0 || n >= pack.getCount())
+			n = pack.find(level);
+		if(n < 0)
+			error(false, "there is no level %s in pack: %s", level, argv[i]);
+		if(n < 0 || map->load(&pack, n) < 0)
+		{
+			delete map;
+			return EXIT_FAILURE;
+		}
+		if(reload)
+			warning("levels of pack are not watched");
+		reload = false;
+	}
+	else
+		map->load(argv[i]);
+	if(reload)
+		watch.open(argv[i]);
+	if(rewind > 0)
+	{
+		history = new Rewind((size_t)rewind << 20);
+		map->setRewind(history);
+	}
+	map->setPath(&path);
 
-	// initialize ui
-	SDLUI* ui = new SDLUI();
+	// initialize ui (terminal shows game messages in its status line, they
+	// are not printed over it)
+	UI* ui;
+	if(term)
+	{
+		if(hud || zoom > 1 || publish || video)
+			warning("--hud, --zoom, --publish and --capture need SDL window");
+		ui = new TermUI();
+	}
+	else
+	{
+		SDLUI* sdl = new SDLUI();
+		if(zoom > 1)
+			sdl->setZoom(zoom);
+		if(hud)
+			sdl->setHud(&stats);
+		if(publish && publisher.open(publish, SDLUI_WIDTH, SDLUI_HEIGHT,
+			map->getWidth(), map->getHeight()))
+			sdl->setPublisher(&publisher);
+		if(video && capture.open(video, SDLUI_WIDTH, SDLUI_HEIGHT))
+			sdl->setCapture(&capture);
+		ui = sdl;
+	}
+	if(script)
+		replay = new ScriptUI(script);
 
 	while(!done)
 	{
-		// handle input and move player
-		switch(ui->input())
-		{
-		case INPUT_UP:
-			map->movePlayer(0, -1);
-			break;
-		case INPUT_DOWN:
-			map->movePlayer(0, 1);
-			break;
-		case INPUT_LEFT:
-			map->movePlayer(-1, 0);
-			break;
-		case INPUT_RIGHT:
-			map->movePlayer(1, 0);
-			break;
-		case INPUT_QUIT:
+		TRACE_SCOPE("frame");
+		stats.frame();
+		memTick();
+
+		// handle input and move player (replay overrides keyboard, window
+		// can still be closed)
+		UIINPUT input = ui->input();
+		if(replay && input != INPUT_QUIT)
+			input = replay->input();
+		int x, y;
+		if(input == INPUT_TRAVEL && ui->getTarget(&x, &y) &&
+			map->getState() == MAP_NONE && !map->travel(x, y) && !term)
+			printf("No way there!\n");
+		if(!gameInput(map, input))
 			done = -1;
-			break;
+		if(input == INPUT_REWIND)
+			winnable = true;
+
+		// edited map file shows up in this frame
+		if(watch.changed() && map->reload(argv[i]) > 0)
+			winnable = true;
+		stats.mark(PHASE_INPUT);
+
+		// tasks done once upon time (not every tick), time stands still
+		// while rewinding and once game is over; settled map would stay as
+		// it is, only its tick is recorded
+		if(input != INPUT_REWIND && map->getState() == MAP_NONE)
+		{
+			if(!map->isSettled())
+			{
+				map->doGravity();
+				map->moveCreatures();
+			}
+			map->record();
 		}
+		stats.mark(PHASE_GRAVITY);
 
-		// tasks done once upon time (not every tick)
-		map->doGravity();
+		// tell player once there is no way to win
+		if(winnable && !map->isWinnable())
+		{
+			if(!term)
+				printf("---------------\n" \
+					"  NO WAY OUT!\n" \
+					"---------------\n");
+			winnable = false;
+		}
 
 		// redraw map
 		ui->draw(map);
+		stats.mark(PHASE_DRAW);
 
-		// check map state
-		switch(map->getState())
+		// check map state (lost game goes on while it can be rewound)
+		if(map->getState() != state)
 		{
-		case MAP_WON:
-			printf("---------------\n" \
-				"    PERFECT!\n" \
-				"---------------\n");
-			done = -1;
-			break;
-		case MAP_LOST:
-			printf("---------------\n" \
-				"   BAD LUCK!\n" \
-				"---------------\n");
-			done = -1;
-			break;
+			state = map->getState();
+			switch(state)
+			{
+			case MAP_WON:
+				if(!term)
+					printf("---------------\n" \
+						"    PERFECT!\n" \
+						"---------------\n");
+				done = -1;
+				break;
+			case MAP_LOST:
+				if(!term)
+					printf("---------------\n" \
+						"   BAD LUCK!\n" \
+						"---------------\n");
+				if(history && history->getTicks())
+				{
+					if(!term)
+						printf("(hold backspace to rewind)\n");
+				}
+				else
+					done = -1;
+				break;
+			default:
+				break;
+			}
+		}
 
-			break;
+		// nothing moves until player does (replay feeds input every frame):
+		// sleep until event, timer wakes animations and watched file
+		if(!done && !replay && input == INPUT_UNKNOWN &&
+			(map->isSettled() || map->getState() != MAP_NONE))
+		{
+			stats.pause();
+			ui->wait(PLAY_IDLE_MS);
 		}
 	}
 
 	debug("exit");
 
-	// cleanup
+	// cleanup (queued frames are written before SDL goes away)
+	bool captured = capture.close();
+	delete replay;
+	delete[] script;
 	delete ui;
 	delete map;
+	delete history;
 
-	return EXIT_SUCCESS;
+	return captured ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *  Removes option with value from arguments.
+ *  \param argc         pointer to number of arguments (updated)
+ *  \param argv         arguments (updated)
+ *  \param name         option name
+ *  \return             option value or NULL if not present
+ */
+static const char* takeOption(int* argc, char** argv, const char* name)
+{
+	const char* value = NULL;
+	int i;
+
+	for(i = 1; i + 1 < *argc; i++)
+	{
+		if(strcmp(argv[i], name))
+			continue;
+
+		value = argv[i + 1];
+		for(; i + 2 < *argc; i++)
+			argv[i] = argv[i + 2];
+		*argc -= 2;
+		argv[*argc] = NULL;
+		break;
+	}
+
+	return value;
+}
+
+/**
+ *  Removes flag from arguments.
+ *  \param argc         pointer to number of arguments (updated)
+ *  \param argv         arguments (updated)
+ *  \param name         flag name
+ *  \return             true if flag was present
+ */
+static bool takeFlag(int* argc, char** argv, const char* name)
+{
+	int i;
+
+	for(i = 1; i < *argc; i++)
+	{
+		if(strcmp(argv[i], name))
+			continue;
+
+		for(; i + 1 < *argc; i++)
+			argv[i] = argv[i + 1];
+		*argc -= 1;
+		argv[*argc] = NULL;
+		return true;
+	}
+
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	const char* trace = takeOption(&argc, argv, "--trace");
+	bool mem = takeFlag(&argc, argv, "--mem");
+	int r;
+
+	// print log records on background thread
+	logStart();
+
+	if(trace)
+	{
+#ifndef TRACE
+		error(false, "built without TRACE, trace will be empty");
+#endif /* TRACE */
+		traceStart();
+	}
+
+	// batch modes (no UI, no banner)
+	if(argc >= 2 && !strcmp(argv[1], "--validate"))
+		r = validate(argc - 2, argv + 2, argv[0]);
+	else if(argc >= 2 && !strcmp(argv[1], "--generate"))
+		r = generate(argc - 2, argv + 2, argv[0]);
+	else if(argc >= 2 && !strcmp(argv[1], "--host"))
+		r = host(argc - 2, argv + 2, argv[0]);
+	else if(argc >= 2 && !strcmp(argv[1], "--batch"))
+		r = batch(argc - 2, argv + 2, argv[0]);
+	else if(argc >= 2 && !strcmp(argv[1], "--spectate"))
+		r = spectate(argc - 2, argv + 2, argv[0]);
+	else if(argc >= 2 && !strcmp(argv[1], "--pack-build"))
+		r = packBuild(argc - 2, argv + 2, argv[0]);
+	else
+		r = play(argc - 1, argv + 1, argv[0]);
+
+	if(trace)
+	{
+		traceStop();
+		if(!traceWrite(trace))
+			r = EXIT_FAILURE;
+	}
+
+	// everything is freed by now, bytes left are leaks
+	if(mem)
+		memReport(stderr);
+
+	logStop();
+	return r;
 }
@@ -25,35 +25,54 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
+#include "log.h"
+#include "config.h"
 
 
-#ifdef DEBUG
-/** Debug macro. If is macro DEBUG defined outputs debug messages, otherwise
- *  does nothing.
+#if LOG_LEVEL <= 0
+/** Debug macro. Queues debug message if LOG_LEVEL allows debug messages,
+ *  otherwise does nothing.
  *  \param format       debug message format
  *  \param arg...       n arguments used as wildcards in format message */
 #define debug(format, arg...) \
-{ \
-	fprintf(stderr, "debug: [%s:%.4d] %s(): " format "\n",\
-		__FILE__, __LINE__, __func__, ##arg); \
-}
+	logWrite(LOG_DEBUG, __FILE__, __LINE__, __func__, 0, format, ##arg)
 #else
 	#define debug(format, arg...)
-#endif /* DEBUG */
+#endif /* LOG_LEVEL <= 0 */
+
+#if LOG_LEVEL <= 1
+/** Info macro. Queues informational message.
+ *  \param format       message format
+ *  \param arg...       n arguments used as wildcards in format message */
+#define info(format, arg...) \
+	logWrite(LOG_INFO, __FILE__, __LINE__, __func__, 0, format, ##arg)
+#else
+	#define info(format, arg...)
+#endif /* LOG_LEVEL <= 1 */
+
+#if LOG_LEVEL <= 2
+/** Warning macro. Queues warning message.
+ *  \param format       message format
+ *  \param arg...       n arguments used as wildcards in format message */
+#define warning(format, arg...) \
+	logWrite(LOG_WARNING, __FILE__, __LINE__, __func__, 0, format, ##arg)
+#else
+	#define warning(format, arg...)
+#endif /* LOG_LEVEL <= 2 */
 
-/** Error macro. Macro prints formated error and if it's error bit set also
- *  calls perror().
+/** Error macro. Macro queues formated error (with description of errno if
+ *  set). Fatal error waits for queued messages to be printed and exits.
  *  \param fatal        if set to 'true' then exits with EXIT_ERROR
  *  \param format       error message format
  *  \param arg...       n arguments used as wildcards in format message */
 #define error(fatal, format, arg...) \
 { \
-	fprintf(stderr, "error: [%s:%.4d] %s(): " format "\n",\
-		__FILE__, __LINE__, __func__, ##arg); \
-	if(errno) \
-		perror("error"); \
+	logWrite(LOG_ERROR, __FILE__, __LINE__, __func__, errno, format, ##arg); \
 	if(fatal) \
+	{ \
+		logFlush(); \
 		exit(-1); \
+	} \
 }
 
 
@@ -0,0 +1,207 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// entity.cpp: moving creatures
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "entity.h"
+#include "config.h"
+#include "debug.h"
+
+// initial capacity of creature arrays
+#define ENTITY_MIN_CAPACITY 64
+
+
+/**
+ *  Constructor.
+ */
+Entities::Entities()
+{
+	this->count = 0;
+	this->capacity = 0;
+	this->x = NULL;
+	this->y = NULL;
+	this->type = NULL;
+	this->dir = NULL;
+	this->cells = NULL;
+	this->width = 0;
+	this->height = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Entities::~Entities()
+{
+	this->free();
+}
+
+/**
+ *  Removes all creatures and sets size of map they live in.
+ *  \param width        map width
+ *  \param height       map height
+ */
+void Entities::reset(int width, int height)
+{
+	this->free();
+	this->width = width;
+	this->height = height;
+}
+
+/**
+ *  Adds creature to empty cell.
+ *  \param type         creature type
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \param dir          initial direction
+ *  \return             creature index
+ */
+int Entities::add(ENTITYTYPE type, int x, int y, DIRECTION dir)
+{
+	assert(x >= 0 && x < this->width && y >= 0 && y < this->height);
+
+	if(!this->cells)
+	{
+		this->cells = new int[this->width * this->height];
+		memset(this->cells, 0, sizeof(int) * this->width * this->height);
+	}
+	assert(this->cells[y * this->width + x] == 0);
+
+	if(this->count == this->capacity)
+		this->grow();
+
+	int i = this->count++;
+	this->x[i] = x;
+	this->y[i] = y;
+	this->type[i] = type;
+	this->dir[i] = dir;
+	this->cells[y * this->width + x] = i + 1;
+
+	return i;
+}
+
+/**
+ *  Removes creature. Last creature takes its index.
+ *  \param i            creature index
+ */
+void Entities::remove(int i)
+{
+	assert(i >= 0 && i < this->count);
+
+	int last = --this->count;
+	this->cells[this->y[i] * this->width + this->x[i]] = 0;
+	if(i != last)
+	{
+		this->x[i] = this->x[last];
+		this->y[i] = this->y[last];
+		this->type[i] = this->type[last];
+		this->dir[i] = this->dir[last];
+		this->cells[this->y[i] * this->width + this->x[i]] = i + 1;
+	}
+}
+
+/**
+ *  Moves creature to empty cell.
+ *  \param i            creature index
+ *  \param x            new x coordinate
+ *  \param y            new y coordinate
+ */
+void Entities::move(int i, int x, int y)
+{
+	assert(i >= 0 && i < this->count);
+	assert(x >= 0 && x < this->width && y >= 0 && y < this->height);
+	assert(this->cells[y * this->width + x] == 0);
+
+	this->cells[this->y[i] * this->width + this->x[i]] = 0;
+	this->cells[y * this->width + x] = i + 1;
+	this->x[i] = x;
+	this->y[i] = y;
+}
+
+/**
+ *  Returns creature in cell.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             creature index or -1 if cell has no creature
+ */
+int Entities::find(int x, int y)
+{
+	assert(x >= 0 && x < this->width && y >= 0 && y < this->height);
+
+	if(!this->cells)
+		return -1;
+	return this->cells[y * this->width + x] - 1;
+}
+
+/**
+ *  Removes all creatures and frees memory.
+ */
+void Entities::free()
+{
+	delete[] this->x;
+	delete[] this->y;
+	delete[] this->type;
+	delete[] this->dir;
+	delete[] this->cells;
+	this->x = NULL;
+	this->y = NULL;
+	this->type = NULL;
+	this->dir = NULL;
+	this->cells = NULL;
+	this->count = 0;
+	this->capacity = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Doubles capacity of creature arrays.
+ */
+void Entities::grow()
+{
+	int capacity = this->capacity ? this->capacity * 2 : ENTITY_MIN_CAPACITY;
+	int* x = new int[capacity];
+	int* y = new int[capacity];
+	unsigned char* type = new unsigned char[capacity];
+	unsigned char* dir = new unsigned char[capacity];
+
+	if(this->count)
+	{
+		memcpy(x, this->x, sizeof(int) * this->count);
+		memcpy(y, this->y, sizeof(int) * this->count);
+		memcpy(type, this->type, this->count);
+		memcpy(dir, this->dir, this->count);
+	}
+	delete[] this->x;
+	delete[] this->y;
+	delete[] this->type;
+	delete[] this->dir;
+
+	this->x = x;
+	this->y = y;
+	this->type = type;
+	this->dir = dir;
+	this->capacity = capacity;
+}
@@ -0,0 +1,138 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// entity.h: moving creatures headers
+
+#ifndef __ENTITY_H
+#define __ENTITY_H
+
+
+/**
+ *  Enumeration of creature types (values are map glyphs like TILETYPE).
+ */
+typedef enum
+{
+	ENTITY_FIREFLY      = '*',  // follows wall on its left
+	ENTITY_BUTTERFLY    = '%'   // follows wall on its right, leaves diamond
+} ENTITYTYPE;
+
+/**
+ *  Directions in clockwise order (turning is +1 or -1 modulo 4).
+ */
+typedef enum
+{
+	DIR_UP      = 0,
+	DIR_RIGHT,
+	DIR_DOWN,
+	DIR_LEFT
+} DIRECTION;
+
+
+/**
+ *  Creatures of one map stored as structure of arrays, so update of all of
+ *  them is one linear sweep. Removing creature moves last one into its slot.
+ *  Grid of map size maps cells to creatures for collisions, it is allocated
+ *  once first creature is added so maps without creatures don't pay for it.
+ */
+class Entities
+{
+private:
+	int count;
+	int capacity;
+	int* x;
+	int* y;
+	unsigned char* type;
+	unsigned char* dir;
+	int* cells;         // creature index + 1 of each cell (0 for none)
+	int width;
+	int height;
+
+	void grow();
+public:
+	Entities();
+	~Entities();
+	void reset(int width, int height);
+	int add(ENTITYTYPE type, int x, int y, DIRECTION dir);
+	void remove(int i);
+	void move(int i, int x, int y);
+	int find(int x, int y);
+	void free();
+
+	/**
+	 *  Returns number of creatures.
+	 *  \return             number of creatures
+	 */
+	inline int getCount()
+	{
+		return this->count;
+	}
+
+	/**
+	 *  Returns type of i-th creature.
+	 *  \param i            creature index
+	 *  \return             creature type
+	 */
+	inline ENTITYTYPE getType(int i)
+	{
+		return (ENTITYTYPE)this->type[i];
+	}
+
+	/**
+	 *  Returns direction of i-th creature.
+	 *  \param i            creature index
+	 *  \return             direction
+	 */
+	inline DIRECTION getDir(int i)
+	{
+		return (DIRECTION)this->dir[i];
+	}
+
+	/**
+	 *  Sets direction of i-th creature.
+	 *  \param i            creature index
+	 *  \param dir          direction
+	 */
+	inline void setDir(int i, DIRECTION dir)
+	{
+		this->dir[i] = dir;
+	}
+
+	/**
+	 *  Returns x coordinate of i-th creature.
+	 *  \param i            creature index
+	 *  \return             x coordinate
+	 */
+	inline int getX(int i)
+	{
+		return this->x[i];
+	}
+
+	/**
+	 *  Returns y coordinate of i-th creature.
+	 *  \param i            creature index
+	 *  \return             y coordinate
+	 */
+	inline int getY(int i)
+	{
+		return this->y[i];
+	}
+};
+
+
+#endif /* __ENTITY_H */
@@ -0,0 +1,79 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// game.cpp: game loop helpers shared by all hosts of Map
+
+using namespace std;
+
+#include <cstdio>
+#include <cassert>
+#include "game.h"
+#include "map.h"
+#include "config.h"
+#include "debug.h"
+
+
+/**
+ *  Applies input command to map (moves player or rewinds one tick). Player
+ *  travelling to target (see Map::travel()) makes its next step unless other
+ *  command stops it. Player of finished game doesn't move.
+ *  \param map          map
+ *  \param input        input command
+ *  \return             false if input asks to quit game, otherwise true
+ */
+bool gameInput(Map* map, UIINPUT input)
+{
+	assert(map);
+
+	if(map->getState() != MAP_NONE && input != INPUT_QUIT &&
+		input != INPUT_REWIND)
+		return true;
+
+	switch(input)
+	{
+	case INPUT_UP:
+		map->travel(-1, -1);
+		map->movePlayer(0, -1);
+		break;
+	case INPUT_DOWN:
+		map->travel(-1, -1);
+		map->movePlayer(0, 1);
+		break;
+	case INPUT_LEFT:
+		map->travel(-1, -1);
+		map->movePlayer(-1, 0);
+		break;
+	case INPUT_RIGHT:
+		map->travel(-1, -1);
+		map->movePlayer(1, 0);
+		break;
+	case INPUT_REWIND:
+		map->travel(-1, -1);
+		map->rewind(1);
+		break;
+	case INPUT_QUIT:
+		return false;
+	default:
+		// travelling player goes on by itself
+		map->travelStep();
+		break;
+	}
+
+	return true;
+}
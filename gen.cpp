@@ -0,0 +1,285 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// gen.cpp: procedural map generator
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "gen.h"
+#include "pool.h"
+#include "tile.h"
+#include "entity.h"
+#include "config.h"
+#include "debug.h"
+
+// rows generated by one job
+#define GEN_BAND_ROWS 64
+// bands generated in one batch per thread (bounds memory use)
+#define GEN_BANDS_PER_THREAD 4
+// creatures keep at least this far (x + y) from player start
+#define GEN_CREATURE_DISTANCE 8
+// cave noise lattice spacing (coarse and fine octave)
+#define GEN_CAVE_SCALE 32
+#define GEN_DETAIL_SCALE 8
+
+
+/**
+ *  Batch of bands generated in parallel.
+ */
+typedef struct
+{
+	Generator* generator;
+	char* buffer;
+	int y;              // first row of batch
+	int rows;           // rows in batch
+	int stride;         // bytes per row (including newline)
+} GENBATCH;
+
+
+/**
+ *  Constructor.
+ *  \param params       generator parameters
+ *  \param threads      number of generating threads (0 means one per CPU)
+ */
+Generator::Generator(const GENPARAMS* params, int threads)
+{
+	assert(params);
+	assert(params->width >= 4 && params->height >= 4);
+
+	this->params = *params;
+	this->threads = threads;
+}
+
+/**
+ *  Fills parameters with default values (64x32 map with moderate density).
+ *  \param params       parameters to fill
+ */
+void Generator::defaults(GENPARAMS* params)
+{
+	params->width = 64;
+	params->height = 32;
+	params->seed = 1;
+	params->boulders = 80;
+	params->diamonds = 20;
+	params->walls = 10;
+	params->sand = 850;
+	params->caves = 350;
+	params->creatures = 0;
+}
+
+/**
+ *  Generates given rows of map. Each row is terminated by newline.
+ *  \param y            first row
+ *  \param rows         number of rows
+ *  \param buffer       output buffer (rows * (width + 1) bytes)
+ */
+void Generator::generateRows(int y, int rows, char* buffer)
+{
+	int x, i;
+	int* cave = new int[this->params.width];
+
+	for(i = 0; i < rows; i++)
+	{
+		// cave noise of whole row (coarse octave weighs three times more)
+		for(x = 0; x < this->params.width; x++)
+			cave[x] = 0;
+		this->noiseRow(y + i, GEN_CAVE_SCALE, 3, cave);
+		this->noiseRow(y + i, GEN_DETAIL_SCALE, 1, cave);
+
+		for(x = 0; x < this->params.width; x++)
+			*buffer++ = this->cell(x, y + i, cave[x] / 4 < this->params.caves);
+		*buffer++ = '\n';
+	}
+
+	delete[] cave;
+}
+
+/**
+ *  Generates whole map and writes it to file. Rows are generated in bands in
+ *  parallel and written in order.
+ *  \param filename     output map filename
+ *  \return             true if success
+ */
+bool Generator::write(const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+	GENBATCH batch;
+	int batchRows;
+
+	if(!f)
+	{
+		error(false, "couldn't create map file: %s", filename);
+		return false;
+	}
+
+	Pool pool(this->threads);
+	batchRows = GEN_BAND_ROWS * GEN_BANDS_PER_THREAD * pool.getSize();
+
+	batch.generator = this;
+	batch.stride = this->params.width + 1;
+	batch.buffer = new char[(size_t)batchRows * batch.stride];
+
+	for(batch.y = 0; batch.y < this->params.height; batch.y += batchRows)
+	{
+		batch.rows = this->params.height - batch.y;
+		if(batch.rows > batchRows)
+			batch.rows = batchRows;
+
+		pool.run(Generator::job, &batch,
+			(batch.rows + GEN_BAND_ROWS - 1) / GEN_BAND_ROWS);
+
+		if(fwrite(batch.buffer, batch.stride, batch.rows, f)
+			!= (size_t)batch.rows)
+		{
+			error(false, "couldn't write map file: %s", filename);
+			break;
+		}
+	}
+
+	delete[] batch.buffer;
+	bool ok = batch.y >= this->params.height;
+	if(fclose(f) != 0)
+		ok = false;
+
+	debug("map %dx%d generated: %s", this->params.width, this->params.height,
+		filename);
+	return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Pool job generating one band of rows.
+ *  \param batch        pointer to GENBATCH
+ *  \param index        index of band in batch
+ */
+void Generator::job(void* batch, int index)
+{
+	GENBATCH* b = (GENBATCH*)batch;
+	int y = index * GEN_BAND_ROWS;
+	int rows = GEN_BAND_ROWS;
+
+	if(y + rows > b->rows)
+		rows = b->rows - y;
+
+	b->generator->generateRows(b->y + y, rows,
+		b->buffer + (size_t)y * b->stride);
+}
+
+/**
+ *  Hashes seed and coordinates into pseudo-random number.
+ *  \param seed         seed
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             pseudo-random number
+ */
+unsigned int Generator::hash(unsigned int seed, int x, int y)
+{
+	unsigned int h = seed;
+
+	h ^= (unsigned int)x * 0x9e3779b1u;
+	h = (h ^ (h >> 16)) * 0x85ebca6bu;
+	h ^= (unsigned int)y * 0xc2b2ae35u;
+	h = (h ^ (h >> 13)) * 0x27d4eb2fu;
+	h ^= h >> 16;
+
+	return h;
+}
+
+/**
+ *  Adds value noise of one row to accumulator. Noise is made of
+ *  pseudo-random values on lattice with given spacing interpolated bilinearly
+ *  in between, lattice columns are interpolated vertically only once.
+ *  \param y            row
+ *  \param scale        lattice spacing
+ *  \param weight       weight of noise in accumulator
+ *  \param acc          accumulator (width values, each gets 0 to 999 times
+ *                      weight added)
+ */
+void Generator::noiseRow(int y, int scale, int weight, int* acc)
+{
+	int ly = y / scale, fy = y % scale;
+	int columns = this->params.width / scale + 2;
+	unsigned int s = this->params.seed + scale;
+	int* column = new int[columns];
+	int x, lx;
+
+	for(lx = 0; lx < columns; lx++)
+		column[lx] = (Generator::hash(s, lx, ly) % 1000) * (scale - fy)
+			+ (Generator::hash(s, lx, ly + 1) % 1000) * fy;
+
+	for(x = 0; x < this->params.width; x++)
+	{
+		int fx = x % scale;
+		lx = x / scale;
+		acc[x] += weight * ((column[lx] * (scale - fx) + column[lx + 1] * fx)
+			/ (scale * scale));
+	}
+
+	delete[] column;
+}
+
+/**
+ *  Returns glyph of map cell.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \param cave         true if cell lies in cave
+ *  \return             tile glyph
+ */
+char Generator::cell(int x, int y, bool cave)
+{
+	const GENPARAMS* p = &this->params;
+	int r;
+
+	// border
+	if(x == 0 || y == 0 || x == p->width - 1 || y == p->height - 1)
+		return TILE_WALL;
+
+	// player, exit and tunnel between them (top row, right column)
+	if(x == 1 && y == 1)
+		return TILE_PLAYER;
+	if(x == p->width - 2 && y == p->height - 2)
+		return TILE_EXIT;
+	if(y == 1 || x == p->width - 2)
+		return TILE_SAND;
+
+	if(cave)
+	{
+		r = Generator::hash(~p->seed, x, y) % 1000;
+		if(r < p->creatures && x + y > GEN_CREATURE_DISTANCE)
+			return r & 1 ? ENTITY_FIREFLY : ENTITY_BUTTERFLY;
+		return ' ';
+	}
+
+	r = Generator::hash(p->seed, x, y) % 1000;
+	if((r -= p->boulders) < 0)
+		return TILE_BOULDER;
+	if((r -= p->diamonds) < 0)
+		return TILE_DIAMOND;
+	if((r -= p->walls) < 0)
+		return TILE_WALL;
+	if((r -= p->sand) < 0)
+		return TILE_SAND;
+	return ' ';
+}
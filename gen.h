@@ -0,0 +1,69 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// gen.h: procedural map generator headers
+
+#ifndef __GEN_H
+#define __GEN_H
+
+
+/**
+ *  Generator parameters. Densities are in per mille of cells outside caves,
+ *  whatever remains is left empty.
+ */
+typedef struct
+{
+	int width;
+	int height;
+	unsigned int seed;
+	int boulders;
+	int diamonds;
+	int walls;
+	int sand;
+	int caves;          // cave threshold (0 no caves, 1000 all caves)
+	int creatures;      // per mille of cave cells
+} GENPARAMS;
+
+
+/**
+ *  Seeded procedural map generator. Every cell is pure function of seed and
+ *  its coordinates so map is the same regardless of number of threads. Map
+ *  is written in plaintext format read by Map::load() with player in top left
+ *  and exit in bottom right corner joined by sand tunnel. Creatures live in
+ *  caves and keep away from player start.
+ */
+class Generator
+{
+private:
+	GENPARAMS params;
+	int threads;
+
+	static void job(void* batch, int index);
+	static unsigned int hash(unsigned int seed, int x, int y);
+	void noiseRow(int y, int scale, int weight, int* acc);
+	char cell(int x, int y, bool cave);
+public:
+	Generator(const GENPARAMS* params, int threads);
+	static void defaults(GENPARAMS* params);
+	void generateRows(int y, int rows, char* buffer);
+	bool write(const char* filename);
+};
+
+
+#endif /* __GEN_H */
@@ -0,0 +1,256 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// host.cpp: multi-instance game host
+
+using namespace std;
+
+#include <cstdio>
+#include <cassert>
+#include "host.h"
+#include "map.h"
+#include "ui.h"
+#include "game.h"
+#include "pool.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+// instances ticked by one pool job
+#define HOST_JOB_SIZE 16
+
+
+/**
+ *  Constructor.
+ *  \param threads      number of worker threads (0 means one per CPU)
+ */
+Host::Host(int threads)
+{
+	this->instances = NULL;
+	this->count = 0;
+	this->capacity = 0;
+	this->due = NULL;
+	this->ndue = 0;
+	this->round = 0;
+	this->threads = threads;
+}
+
+/**
+ *  Destructor. Deletes all hosted maps and UIs.
+ */
+Host::~Host()
+{
+	int i;
+
+	for(i = 0; i < this->count; i++)
+	{
+		delete this->instances[i].ui;
+		delete this->instances[i].map;
+	}
+	delete[] this->instances;
+	delete[] this->due;
+}
+
+/**
+ *  Adds game to host. Host takes ownership of map and UI. First ticks of
+ *  games with the same period are spread over period rounds.
+ *  \param map          loaded map
+ *  \param ui           UI providing input of game
+ *  \param period       game is ticked every period rounds
+ *  \return             index of game
+ */
+int Host::add(Map* map, UI* ui, int period)
+{
+	assert(map && ui);
+
+	if(period < 1)
+		period = 1;
+
+	if(this->count == this->capacity)
+	{
+		int i;
+		HOSTINSTANCE* instances;
+
+		this->capacity = this->capacity ? this->capacity * 2 : 64;
+		instances = new HOSTINSTANCE[this->capacity];
+		for(i = 0; i < this->count; i++)
+			instances[i] = this->instances[i];
+		delete[] this->instances;
+		this->instances = instances;
+
+		delete[] this->due;
+		this->due = new int[this->capacity];
+	}
+
+	HOSTINSTANCE* instance = &this->instances[this->count];
+	instance->map = map;
+	instance->ui = ui;
+	instance->period = period;
+	instance->next = this->round + this->count % period;
+	instance->ticks = 0;
+	instance->done = false;
+
+	return this->count++;
+}
+
+/**
+ *  Runs given number of rounds (or less if all games end).
+ *  \param rounds       number of rounds
+ *  \return             number of games still running
+ */
+int Host::run(long long rounds)
+{
+	Pool pool(this->threads);
+	long long end = this->round + rounds;
+	int running = this->count;
+	int i;
+
+	for(; this->round < end && running; this->round++)
+	{
+		// collect due games
+		this->ndue = 0;
+		running = 0;
+		for(i = 0; i < this->count; i++)
+		{
+			HOSTINSTANCE* instance = &this->instances[i];
+
+			if(instance->done)
+				continue;
+			running++;
+
+			if(instance->next <= this->round)
+			{
+				this->due[this->ndue++] = i;
+				instance->next += instance->period;
+			}
+		}
+
+		TRACE_COUNTER("due", this->ndue);
+		pool.run(Host::job, this,
+			(this->ndue + HOST_JOB_SIZE - 1) / HOST_JOB_SIZE);
+	}
+
+	// games finished in last round
+	running = 0;
+	for(i = 0; i < this->count; i++)
+		if(!this->instances[i].done)
+			running++;
+
+	return running;
+}
+
+/**
+ *  Returns number of hosted games.
+ *  \return             number of games
+ */
+int Host::getCount()
+{
+	return this->count;
+}
+
+/**
+ *  Returns total number of ticks done by all games.
+ *  \return             number of ticks
+ */
+long long Host::getTicks()
+{
+	long long ticks = 0;
+	int i;
+
+	for(i = 0; i < this->count; i++)
+		ticks += this->instances[i].ticks;
+
+	return ticks;
+}
+
+/**
+ *  Writes aggregate statistics.
+ *  \param f            output stream
+ *  \param seconds      time spent in run()
+ */
+void Host::report(FILE* f, double seconds)
+{
+	int won = 0, lost = 0, quit = 0;
+	long long ticks = this->getTicks();
+	int i;
+
+	for(i = 0; i < this->count; i++)
+	{
+		if(!this->instances[i].done)
+			continue;
+
+		switch(this->instances[i].map->getState())
+		{
+		case MAP_WON:
+			won++;
+			break;
+		case MAP_LOST:
+			lost++;
+			break;
+		default:
+			quit++;
+		}
+	}
+
+	fprintf(f, "%d games, %lld rounds, %lld ticks in %.3f s (%.0f ticks/s)\n"
+		"won %d, lost %d, quit %d, running %d\n",
+		this->count, this->round, ticks, seconds,
+		seconds > 0 ? ticks / seconds : 0.0,
+		won, lost, quit, this->count - won - lost - quit);
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Pool job ticking HOST_JOB_SIZE due games.
+ *  \param host         pointer to Host
+ *  \param index        index of job in round
+ */
+void Host::job(void* host, int index)
+{
+	Host* self = (Host*)host;
+	int i = index * HOST_JOB_SIZE;
+	int end = i + HOST_JOB_SIZE;
+
+	if(end > self->ndue)
+		end = self->ndue;
+
+	for(; i < end; i++)
+		self->tick(&self->instances[self->due[i]]);
+}
+
+/**
+ *  Runs one tick of game (same as one iteration of main loop).
+ *  \param instance     game
+ */
+void Host::tick(HOSTINSTANCE* instance)
+{
+	if(!gameInput(instance->map, instance->ui->input()))
+		instance->done = true;
+
+	instance->map->doGravity();
+	instance->map->moveCreatures();
+	instance->ui->draw(instance->map);
+	instance->ticks++;
+
+	if(instance->map->getState() != MAP_NONE)
+		instance->done = true;
+}
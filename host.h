@@ -0,0 +1,74 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// host.h: multi-instance game host headers
+
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <cstdio>
+
+class Map;      // map.h
+class UI;       // ui.h
+
+
+/**
+ *  One hosted game.
+ */
+typedef struct
+{
+	Map* map;
+	UI* ui;
+	int period;             // tick every period rounds
+	long long next;         // round of next tick
+	long long ticks;        // ticks done so far
+	bool done;              // won, lost or quit
+} HOSTINSTANCE;
+
+
+/**
+ *  Host running many independent games in one process. Games are ticked in
+ *  rounds, each game in rounds given by its period, due games of round are
+ *  ticked in parallel on worker pool.
+ */
+class Host
+{
+private:
+	HOSTINSTANCE* instances;
+	int count;
+	int capacity;
+	int* due;               // instances due in current round
+	int ndue;
+	long long round;
+	int threads;
+
+	static void job(void* host, int index);
+	void tick(HOSTINSTANCE* instance);
+public:
+	Host(int threads);
+	~Host();
+	int add(Map* map, UI* ui, int period);
+	int run(long long rounds);
+	int getCount();
+	long long getTicks();
+	void report(FILE* f, double seconds);
+};
+
+
+#endif /* __HOST_H */
@@ -0,0 +1,604 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// log.cpp: asynchronous logger
+
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cstddef>
+#include <stdint.h>
+#include <sys/types.h>
+#include <SDL/SDL.h>
+#include "log.h"
+#include "config.h"
+
+// records in queue (power of two), records are dropped when queue is full
+#define LOG_QUEUE_SIZE 1024
+// maximal length of formatted message (longer messages are truncated)
+#define LOG_MESSAGE_SIZE 224
+// arguments formatted by writer (message with more is formatted by caller)
+#define LOG_ARGS 8
+// maximal length of one conversion of format (e.g. "%-08.3lld")
+#define LOG_SPEC_SIZE 32
+// maximal time spent waiting for writer in logFlush() (ms)
+#define LOG_FLUSH_TIMEOUT 1000
+
+
+/**
+ *  Argument of queued record. Integers are widened by caller, strings are
+ *  copied to data of record (they may not live until writer comes).
+ */
+typedef union
+{
+	long long i;                        // signed integer, character
+	unsigned long long u;               // unsigned integer
+	double d;
+	const void* p;
+	int s;                              // string offset in data (-1 if NULL)
+} LOGARG;
+
+/**
+ *  Queued log record. Caller only copies arguments, message and prefix are
+ *  formatted by writer. Format writer can't handle (see logSpec()) is
+ *  formatted by caller.
+ */
+typedef struct
+{
+	volatile unsigned int sequence;     // slot state (see logWrite())
+	int level;
+	const char* file;
+	int line;
+	const char* func;
+	int err;                            // errno (0 if none)
+	const char* format;                 // NULL if data is formatted message
+	LOGARG args[LOG_ARGS];
+	char data[LOG_MESSAGE_SIZE];        // strings of args or message
+} LOGRECORD;
+
+
+static const char* levels[] = { "debug", "info", "warning", "error" };
+
+static LOGRECORD queue[LOG_QUEUE_SIZE];
+static volatile unsigned int tail = 0;      // next slot claimed by callers
+static volatile unsigned int head = 0;      // next slot printed by writer
+static volatile unsigned int dropped = 0;
+static unsigned int reported = 0;
+static SDL_sem* ready = NULL;
+static SDL_Thread* writer = NULL;
+static volatile bool quit = false;
+static bool registered = false;
+static LOGSINK volatile sink = NULL;        // replaces stderr if set
+
+
+/**
+ *  Prints one record to stderr in format of old debug() and error() macros
+ *  or hands it to sink as one line without source location.
+ *  \param level        log level
+ *  \param file         source file
+ *  \param line         source line
+ *  \param func         function name
+ *  \param err          errno (0 if none)
+ *  \param message      formatted message
+ */
+static void logPrint(int level, const char* file, int line, const char* func,
+	int err, const char* message)
+{
+	LOGSINK to = sink;
+
+	if(to)
+	{
+		char text[LOG_MESSAGE_SIZE + 64];
+
+		if(err)
+			snprintf(text, sizeof(text), "%s: %s (%s)", levels[level], message,
+				strerror(err));
+		else
+			snprintf(text, sizeof(text), "%s: %s", levels[level], message);
+		to((LOGLEVEL)level, text);
+		return;
+	}
+
+	fprintf(stderr, "%s: [%s:%.4d] %s(): %s\n", levels[level], file, line, func,
+		message);
+	if(err)
+		fprintf(stderr, "%s: %s\n", levels[level], strerror(err));
+}
+
+/**
+ *  Parses conversion of printf format.
+ *  \param spec         conversion (after '%')
+ *  \param kind         pointer to kind of argument (filled in): 'i' signed
+ *                      integer, 'u' unsigned, 'c' character, 'f' double, 's'
+ *                      string, 'p' pointer, '%' none or 0 if writer can't
+ *                      format it (e.g. '*' width, long double, wide string)
+ *  \param size         pointer to length modifier (filled in): 0, 'H' (hh),
+ *                      'h', 'l', 'q' (ll), 'z', 'j', 't' or 'L'
+ *  \param modifier     pointer to start of length modifier (filled in)
+ *  \return             end of conversion
+ */
+static const char* logSpec(const char* spec, char* kind, char* size,
+	const char** modifier)
+{
+	*kind = 0;
+	*size = 0;
+
+	while(*spec && strchr("-+ #0", *spec))
+		spec++;
+	while(*spec >= '0' && *spec <= '9')
+		spec++;
+	if(*spec == '.')
+		for(spec++; *spec >= '0' && *spec <= '9'; spec++);
+
+	*modifier = spec;
+	if(spec[0] == 'h' && spec[1] == 'h')
+	{
+		*size = 'H';
+		spec += 2;
+	}
+	else if(spec[0] == 'l' && spec[1] == 'l')
+	{
+		*size = 'q';
+		spec += 2;
+	}
+	else if(*spec && strchr("hlqzjtL", *spec))
+		*size = *spec++;
+
+	switch(*spec)
+	{
+	case 'd':
+	case 'i':
+		*kind = *size == 'L' ? 0 : 'i';
+		break;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		*kind = *size == 'L' ? 0 : 'u';
+		break;
+	case 'c':
+		*kind = *size ? 0 : 'c';
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		*kind = *size == 'L' ? 0 : 'f';
+		break;
+	case 's':
+		*kind = *size ? 0 : 's';
+		break;
+	case 'p':
+		*kind = 'p';
+		break;
+	case '%':
+		*kind = '%';
+		break;
+	}
+
+	return *spec ? spec + 1 : spec;
+}
+
+/**
+ *  Copies arguments of format to record. Called by caller of logWrite().
+ *  \param r            record
+ *  \param format       message format
+ *  \param ap           arguments
+ *  \return             false if writer can't format message (record is
+ *                      left for caller to format it)
+ */
+static bool logDefer(LOGRECORD* r, const char* format, va_list ap)
+{
+	const char* spec = format;
+	const char* modifier;
+	const char* s;
+	char kind, size;
+	int n = 0, used = 0;
+
+	while((spec = strchr(spec, '%')))
+	{
+		const char* end = logSpec(spec + 1, &kind, &size, &modifier);
+
+		if(!kind || end - spec > LOG_SPEC_SIZE - 3)
+			return false;
+		spec = end;
+		if(kind == '%')
+			continue;
+		if(n == LOG_ARGS)
+			return false;
+
+		// integers are converted as printf would do, writer prints them
+		// as long long
+		LOGARG* a = &r->args[n++];
+		switch(kind)
+		{
+		case 'i':
+			switch(size)
+			{
+			case 'H':
+				a->i = (signed char)va_arg(ap, int);
+				break;
+			case 'h':
+				a->i = (short)va_arg(ap, int);
+				break;
+			case 'l':
+				a->i = va_arg(ap, long);
+				break;
+			case 'q':
+				a->i = va_arg(ap, long long);
+				break;
+			case 'z':
+				a->i = va_arg(ap, ssize_t);
+				break;
+			case 'j':
+				a->i = va_arg(ap, intmax_t);
+				break;
+			case 't':
+				a->i = va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				a->i = va_arg(ap, int);
+				break;
+			}
+			break;
+		case 'u':
+			switch(size)
+			{
+			case 'H':
+				a->u = (unsigned char)va_arg(ap, unsigned int);
+				break;
+			case 'h':
+				a->u = (unsigned short)va_arg(ap, unsigned int);
+				break;
+			case 'l':
+				a->u = va_arg(ap, unsigned long);
+				break;
+			case 'q':
+				a->u = va_arg(ap, unsigned long long);
+				break;
+			case 'z':
+				a->u = va_arg(ap, size_t);
+				break;
+			case 'j':
+				a->u = va_arg(ap, uintmax_t);
+				break;
+			case 't':
+				a->u = (size_t)va_arg(ap, ptrdiff_t);
+				break;
+			default:
+				a->u = va_arg(ap, unsigned int);
+				break;
+			}
+			break;
+		case 'c':
+			a->i = va_arg(ap, int);
+			break;
+		case 'f':
+			a->d = va_arg(ap, double);
+			break;
+		case 'p':
+			a->p = va_arg(ap, void*);
+			break;
+		case 's':
+			// strings share data, last of them may be cut short
+			if(!(s = va_arg(ap, const char*)))
+			{
+				a->s = -1;
+				break;
+			}
+			a->s = used < LOG_MESSAGE_SIZE ? used : LOG_MESSAGE_SIZE - 1;
+			while(*s && used < LOG_MESSAGE_SIZE - 1)
+				r->data[used++] = *s++;
+			if(used < LOG_MESSAGE_SIZE)
+				r->data[used++] = '\0';
+			break;
+		}
+	}
+
+	r->format = format;
+	return true;
+}
+
+/**
+ *  Formats message of record from its format and copied arguments. Called
+ *  only by writer thread.
+ *  \param r            record (see logDefer())
+ *  \param message      buffer of LOG_MESSAGE_SIZE bytes
+ */
+static void logFormat(LOGRECORD* r, char* message)
+{
+	const char* format = r->format;
+	const char* modifier;
+	char spec[LOG_SPEC_SIZE];
+	char kind, size;
+	int length = 0, n = 0;
+
+	while(*format && length < LOG_MESSAGE_SIZE - 1)
+	{
+		if(*format != '%')
+		{
+			message[length++] = *format++;
+			continue;
+		}
+
+		// same conversion, integers as long long
+		const char* end = logSpec(format + 1, &kind, &size, &modifier);
+		int m = modifier - format;
+		memcpy(spec, format, m);
+		if(kind == 'i' || kind == 'u')
+		{
+			spec[m++] = 'l';
+			spec[m++] = 'l';
+		}
+		spec[m++] = end[-1];
+		spec[m] = '\0';
+		format = end;
+
+		char* out = message + length;
+		size_t room = LOG_MESSAGE_SIZE - length;
+		LOGARG* a = &r->args[n];
+		int w;
+		switch(kind)
+		{
+		case 'i':
+		case 'c':
+			w = kind == 'c' ? snprintf(out, room, spec, (int)a->i) :
+				snprintf(out, room, spec, a->i);
+			break;
+		case 'u':
+			w = snprintf(out, room, spec, a->u);
+			break;
+		case 'f':
+			w = snprintf(out, room, spec, a->d);
+			break;
+		case 'p':
+			w = snprintf(out, room, spec, a->p);
+			break;
+		case 's':
+			w = snprintf(out, room, spec, a->s < 0 ? "(null)" :
+				r->data + a->s);
+			break;
+		default:
+			message[length++] = '%';
+			continue;
+		}
+		n++;
+		if(w < 0)
+			break;
+		length += w < (int)room ? w : room - 1;
+	}
+	message[length] = '\0';
+}
+
+/**
+ *  Prints all published records. Called only by writer thread.
+ */
+static void logDrain()
+{
+	char message[LOG_MESSAGE_SIZE];
+
+	for(;;)
+	{
+		LOGRECORD* r = &queue[head & (LOG_QUEUE_SIZE - 1)];
+
+		if(__atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE) != head + 1)
+			break;
+
+		if(r->format)
+			logFormat(r, message);
+		logPrint(r->level, r->file, r->line, r->func, r->err,
+			r->format ? message : r->data);
+
+		// hand slot back to callers for next lap
+		__atomic_store_n(&r->sequence, head + LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+		__atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+	}
+
+	if(dropped != reported)
+	{
+		LOGSINK to = sink;
+
+		snprintf(message, sizeof(message), "warning: log queue full, %u "
+			"records dropped", dropped - reported);
+		if(to)
+			to(LOG_WARNING, message);
+		else
+			fprintf(stderr, "%s\n", message);
+		reported = dropped;
+	}
+}
+
+/**
+ *  Writer thread. Sleeps until some record is published.
+ *  \param unused       unused
+ *  \return             0
+ */
+static int logWriter(void* unused)
+{
+	do
+	{
+		SDL_SemWait(ready);
+		logDrain();
+	}
+	while(!quit);
+
+	return 0;
+}
+
+/**
+ *  Starts background writer. Until then (and after logStop()) records are
+ *  printed synchronously. Writer is stopped at exit.
+ */
+void logStart()
+{
+	unsigned int i;
+
+	if(writer)
+		return;
+
+	for(i = 0; i < LOG_QUEUE_SIZE; i++)
+		queue[(tail + i) & (LOG_QUEUE_SIZE - 1)].sequence = tail + i;
+	head = tail;
+	quit = false;
+
+	ready = SDL_CreateSemaphore(0);
+	writer = SDL_CreateThread(logWriter, NULL);
+	if(!writer)
+	{
+		SDL_DestroySemaphore(ready);
+		ready = NULL;
+		fprintf(stderr, "warning: couldn't start log writer, logging "
+			"synchronously\n");
+		return;
+	}
+
+	if(!registered)
+		atexit(logStop);
+	registered = true;
+}
+
+/**
+ *  Prints all queued records and stops background writer.
+ */
+void logStop()
+{
+	if(!writer)
+		return;
+
+	quit = true;
+	SDL_SemPost(ready);
+	SDL_WaitThread(writer, NULL);
+	writer = NULL;
+
+	SDL_DestroySemaphore(ready);
+	ready = NULL;
+}
+
+/**
+ *  Waits until writer prints records queued so far (at most
+ *  LOG_FLUSH_TIMEOUT). Meant for fatal errors, not for game loop.
+ */
+void logFlush()
+{
+	unsigned int last = tail;
+	int waited = 0;
+
+	if(!writer)
+		return;
+
+	while((int)(last - head) > 0 && waited++ < LOG_FLUSH_TIMEOUT)
+		SDL_Delay(1);
+}
+
+/**
+ *  Sets where records go instead of stderr (e.g. UI that owns terminal).
+ *  Sink is called by writer thread (or by caller of logWrite() while there
+ *  is no writer), so it must be thread safe.
+ *  \param to           sink (NULL prints to stderr again)
+ */
+void logSink(LOGSINK to)
+{
+	sink = to;
+}
+
+/**
+ *  Returns number of records dropped because queue was full.
+ *  \return             number of dropped records
+ */
+unsigned int logDropped()
+{
+	return dropped;
+}
+
+/**
+ *  Queues log record. Never blocks: arguments are copied into queue slot
+ *  and formatted by writer, record is dropped if queue is full. Usually
+ *  called through debug(), info(), warning() and error() macros (debug.h).
+ *  \param level        log level
+ *  \param file         source file (must live forever, e.g. __FILE__)
+ *  \param line         source line
+ *  \param func         function name (must live forever, e.g. __func__)
+ *  \param err          errno to describe (0 if none)
+ *  \param format       message format (must live forever, e.g. literal)
+ */
+void logWrite(LOGLEVEL level, const char* file, int line, const char* func,
+	int err, const char* format, ...)
+{
+	LOGRECORD* r;
+	unsigned int pos;
+	va_list ap;
+
+	if(!writer)
+	{
+		char message[LOG_MESSAGE_SIZE];
+
+		va_start(ap, format);
+		vsnprintf(message, sizeof(message), format, ap);
+		va_end(ap);
+		logPrint(level, file, line, func, err, message);
+		return;
+	}
+
+	// claim slot: free slot of current lap has sequence equal to position
+	pos = tail;
+	for(;;)
+	{
+		r = &queue[pos & (LOG_QUEUE_SIZE - 1)];
+		int diff = (int)(__atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE) - pos);
+
+		if(diff == 0)
+		{
+			if(__sync_bool_compare_and_swap(&tail, pos, pos + 1))
+				break;
+		}
+		else if(diff < 0)
+		{
+			// writer is one lap behind
+			__sync_fetch_and_add(&dropped, 1);
+			return;
+		}
+		pos = tail;
+	}
+
+	r->level = level;
+	r->file = file;
+	r->line = line;
+	r->func = func;
+	r->err = err;
+	va_start(ap, format);
+	if(!logDefer(r, format, ap))
+	{
+		va_end(ap);
+		va_start(ap, format);
+		vsnprintf(r->data, sizeof(r->data), format, ap);
+		r->format = NULL;
+	}
+	va_end(ap);
+
+	// publish record
+	__atomic_store_n(&r->sequence, pos + 1, __ATOMIC_RELEASE);
+	SDL_SemPost(ready);
+}
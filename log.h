@@ -0,0 +1,55 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// log.h: asynchronous logger headers
+
+#ifndef __LOG_H
+#define __LOG_H
+
+
+/**
+ *  Log levels. Levels below LOG_LEVEL (config.h) are compiled out.
+ */
+typedef enum
+{
+	LOG_DEBUG       = 0,
+	LOG_INFO        = 1,
+	LOG_WARNING     = 2,
+	LOG_ERROR       = 3
+} LOGLEVEL;
+
+/**
+ *  Receiver of log records (see logSink()).
+ *  \param level        log level
+ *  \param line         record as one line (level, message, errno text)
+ */
+typedef void (*LOGSINK)(LOGLEVEL level, const char* line);
+
+
+void logStart();
+void logStop();
+void logFlush();
+unsigned int logDropped();
+void logSink(LOGSINK to);
+void logWrite(LOGLEVEL level, const char* file, int line, const char* func,
+	int err, const char* format, ...)
+	__attribute__((format(printf, 6, 7)));
+
+
+#endif /* __LOG_H */
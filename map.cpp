@@ -22,27 +22,130 @@
 using namespace std;
 
 #include <cstdio>
+#include <cstring>
 #include <cctype>
 #include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "map.h"
 #include "tile.h"
+#include "pack.h"
+#include "rules.h"
+#include "rewind.h"
+#include "path.h"
+#include "pool.h"
+#include "mem.h"
+#include "trace.h"
 #include "config.h"
 #include "debug.h"
 
-// buffer size for map file loading
-#define MAX_BUF_SIZE 255
+// cells visited by local connectivity check before giving up (see
+// reachSplit())
+#define REACH_SPLIT_BUDGET 1024
+// map file bytes parsed by one job, smaller maps than this many cells are
+// built by calling thread alone
+#define MAP_PARSE_BYTES (1 << 20)
+#define MAP_BUILD_CELLS (1 << 20)
+
+
+/**
+ *  Part of map file parsed by one job. Parts begin at line starts, they are
+ *  measured first and parsed into their rows once rows of all parts before
+ *  are known. Lines and columns are numbered from 1.
+ */
+typedef struct
+{
+	long begin;         // first byte
+	long end;           // byte after last one
+	int lines;          // newline terminated lines before first empty one
+	int width;          // widest of them
+	bool empty;         // empty line (end of map) is in part
+	int row;            // row of first line
+	int players;
+	int playerLine[2];  // first two players
+	int playerColumn[2];
+	int exits;
+	int unknown;        // glyphs of no tile or creature (cells left empty)
+	char unknownGlyph;  // first of them
+	int unknownLine;
+	int unknownColumn;
+} MAPPART;
+
+/**
+ *  Map file parsed in parallel.
+ */
+typedef struct
+{
+	const char* data;
+	MAPPART* parts;
+	char* grid;
+	int width;
+} MAPPARSE;
+
+/**
+ *  Row of chunks built by one job (see Map::build()).
+ */
+typedef struct
+{
+	int uniform;        // uniform chunks
+	int diamonds;
+	int creatures;
+	int playerX;        // first player and exit (-1 if none)
+	int playerY;
+	int exitX;
+	int exitY;
+} MAPBAND;
+
+/**
+ *  Rows of chunks built in parallel.
+ */
+typedef struct
+{
+	Map* map;
+	const char* grid;
+	MAPBAND* bands;
+} MAPBUILD;
+
+
+// shared tiles of uniform chunks
+Tile Map::fillWall(TILE_WALL, false, false);
+Tile Map::fillSand(TILE_SAND, true, false);
 
 /**
  *  Constructor.
  */
 Map::Map()
 {
-	this->tiles = NULL;
+	this->chunks = NULL;
+	this->fills = NULL;
+	this->rounds = NULL;
+	this->filled = NULL;
+	this->chunksX = 0;
+	this->chunksY = 0;
+	this->source = NULL;
 
 	this->width = 0;
 	this->height = 0;
 	this->diamonds = 0;
 	this->loaded = false;
+	this->playerX = -1;
+	this->playerY = -1;
+	this->exitX = -1;
+	this->exitY = -1;
+
+	this->rules = RuleSet::classic();
+	this->classes = NULL;
+
+	this->reach = NULL;
+	this->reachQueue = NULL;
+	this->reachDirty = true;
+	this->reachDiamonds = 0;
+
+	this->settled = false;
+	this->history = NULL;
+	this->path = NULL;
 
 	this->state = MAP_NONE;
 }
@@ -63,183 +166,150 @@ Map::~Map()
  */
 int Map::load(const char* filename)
 {
-	FILE* f = fopen(filename, "r");
-	int i;
-	int total;
-	char buffer[MAX_BUF_SIZE];  // line buffer
-	int done = 0;
+	int width, height;
 
 	this->free();
 
-	if(!f)
-	{
-		error(false, "couldn't open map file: %s", filename);
+	char* grid = Map::readGrid(filename, &width, &height);
+	if(!grid)
 		return -1;
-	}
 	debug("map file opened: %s", filename);
 
-	// read file through buffer and decide map size
-	int line_width = 0;
-	int check[2] = {0, 0};
-	while(fgets(buffer, MAX_BUF_SIZE, f) != NULL && !done)
-	{
-		i = 0;
-		while(buffer[i] != '\0' && i < MAX_BUF_SIZE)
-		{
-			// skip non-printable characters
-			if(!isprint(buffer[i]) && buffer[i] != '\n')
-			{
-				i++;
-				continue;
-			}
-
-			if(buffer[i] == '\n')
-			{
-				if(line_width != 0)
-				{
-					// ordinary end of map line
-					this->height++;
-					if(this->width < line_width)
-						this->width = line_width;
+	return this->build(grid, width, height);
+}
 
-					line_width = 0;
-					i++;
-					continue;
-				}
-				else
-				{
-					done = 1;
-					i++;
-					continue;
-				}
-			}
+/**
+ *  Loads level of level pack. Level is decompressed directly into grid map
+ *  is built from.
+ *  \param pack         opened level pack
+ *  \param level        level number (from 0)
+ *  \return             number of read tiles or -1 for error
+ */
+int Map::load(LevelPack* pack, int level)
+{
+	int width, height;
 
-			// entrance/exit check
-			if(buffer[i] == '~' && !check[0])
-				check[0]++;
-			if(buffer[i] == ';')
-				check[1]++;
+	assert(pack);
 
-			line_width++;
-			i++;
-		}
-	}
-	debug("map rectangle size: %ix%i", this->width, this->height);
+	this->free();
 
-	// failed checks
-	if(check[0] != 1)
+	if(!pack->getSize(level, &width, &height))
+		return -1;
+	char* grid = new char[width * height];
+	if(!pack->unpack(level, grid))
 	{
-		error(false, "map must have exactly one player symbol!");
+		delete[] grid;
 		return -1;
 	}
-	if(!check[1])
+	debug("level %d unpacked: %s", level + 1, pack->getName(level));
+	if(!Map::checkGrid(grid, width, height))
 	{
-		error(false, "map must have at least one exit symbol!");
+		delete[] grid;
 		return -1;
 	}
 
-	// load map data into memory
-	int x = 0;
-	int y = 0;
+	return this->build(grid, width, height);
+}
 
-	this->tiles = new Tile** [this->height];    // alloc pointers to rows
-	this->tiles[y] = new Tile* [this->width];   // alloc first row
-	// initialize
-	for(i = 0; i < this->width; i++)
-		this->tiles[y][i] = NULL;
+/**
+ *  Reloads map from file in place. Only rows which differ from the file as
+ *  it was loaded last time are reparsed, other rows keep their state (fallen
+ *  objects, collected diamonds, creatures). Player stays where he is unless
+ *  player symbol moved in file. Map of different size is loaded whole.
+ *  \param filename     map filename
+ *  \return             number of reparsed rows or -1 for error (map is kept
+ *                      as it was)
+ */
+int Map::reload(const char* filename)
+{
+	assert(this->loaded);
 
-	rewind(f);
-	done = 0;
-	total = 0;
+	int width, height;
+	int x, y, i;
+	char* grid = Map::readGrid(filename, &width, &height);
+	if(!grid)
+	{
+		warning("map not reloaded");
+		return -1;
+	}
 
-	// read file through buffer and fill tiles structure
-	while(fgets(buffer, MAX_BUF_SIZE, f) != NULL && !done)
+	if(width != this->width || height != this->height)
 	{
-		i = 0;
-		while(buffer[i] != '\0' && i < MAX_BUF_SIZE)
-		{
-			// skip non-printable characters
-			if(!isprint(buffer[i]) && buffer[i] != '\n')
-			{
-				i++;
-				continue;
-			}
+		delete[] grid;
+		info("map size changed, loading whole map");
+		return this->load(filename) < 0 ? -1 : this->height;
+	}
 
-			if(buffer[i] == '\n')
+	// player symbol in file as loaded last time and as it is now
+	size_t cells = (size_t)width * height;
+	char* symbol = (char*)memchr(this->source, '~', cells);
+	int oldSymbol = symbol ? symbol - this->source : -1;
+	symbol = (char*)memchr(grid, '~', cells);
+	int newSymbol = symbol ? symbol - grid : -1;
+
+	int rows = 0;
+	int oldX = this->playerX, oldY = this->playerY;
+	bool moved = false;
+	for(y = 0; y < height; y++)
+	{
+		char* row = grid + y * width;
+		if(!memcmp(row, this->source + y * width, width))
+			continue;
+		rows++;
+
+		// creatures of row are replaced by those of file (removing from
+		// the end moves only visited creatures)
+		for(i = this->entities.getCount() - 1; i >= 0; i--)
+			if(this->entities.getY(i) == y)
 			{
-				if(y < this->height)
-				{
-					y++;
-					if(y < this->height)
-					{
-						// allocate and initialize next row
-						this->tiles[y] = new Tile* [this->width];
-						int j;
-						for(j = 0; j < this->width; j++)
-							this->tiles[y][j] = NULL;
-					}
-
-					x = 0;
-					i++;
-					continue;
-				}
-				else
-				{
-					// end of map tile data
-					done = 1;
-					i++;
-					continue;
-				}
+				x = this->entities.getX(i);
+				this->entities.remove(i);
+				this->putTile(x, y, NULL);
 			}
 
-			switch(buffer[i])
-			{
-			case '#':
-				this->tiles[y][x] = new Tile(TILE_WALL, false, false);
-				break;
-			case '.':
-				this->tiles[y][x] = new Tile(TILE_SAND, true, false);
-				break;
-			case '@':
-				this->tiles[y][x] = new Tile(TILE_BOULDER, false, false);
-				break;
-			case '$':
-				this->diamonds++;
-				this->tiles[y][x] = new Tile(TILE_DIAMOND, true, false);
-				break;
-			case '~':
-				this->tiles[y][x] = new Tile(TILE_PLAYER, false, false);
-				break;
-			case ';':
-				this->tiles[y][x] = new Tile(TILE_EXIT, true, false);
-				break;
-			default:
-				// unknown tile is same as empty tile
-#ifdef DEBUG
-				if(buffer[i] != ' ')
-					debug("unknown tile type '%c'", buffer[i]);
-#endif /* DEBUG */
-				this->tiles[y][x] = NULL;
-			}
-			x++;
-			i++;
-			total++;
+		for(x = 0; x < width; x++)
+		{
+			int cell = y * width + x;
+
+			// player is moved only by moving his symbol
+			if((x == oldX && y == oldY) ||
+				(cell == newSymbol && newSymbol == oldSymbol))
+				continue;
+			if(cell == newSymbol)
+				moved = true;
+			this->reloadCell(x, y, row[x]);
 		}
 	}
 
-	this->loaded = true;
-	debug("%i map tiles loaded", total);
+	// player symbol moved, old player gives way to what file has there
+	if(moved && oldX >= 0)
+		this->reloadCell(oldX, oldY, grid[oldY * width + oldX]);
 
-	this->state = MAP_NONE;
+	// grid of same size replaces source, accounted bytes stay (see build())
+	delete[] this->source;
+	this->source = grid;
 
-	// if there are any diamonds, be sure to lock exit
-	x = 0;
-	y = 0;
-	if(this->findTileType(TILE_EXIT, &x, &y) && this->diamonds > 0)
-		this->tiles[y][x]->setLocked(true);
+	if(rows)
+	{
+		// exit may have moved, it's locked while there are diamonds
+		x = 0;
+		y = 0;
+		this->exitX = -1;
+		this->exitY = -1;
+		if(this->findTileType(TILE_EXIT, &x, &y))
+		{
+			this->exitX = x;
+			this->exitY = y;
+			this->getTileXY(x, y)->setLocked(this->diamonds > 0);
+		}
+
+		// edits are not rewound
+		if(this->history)
+			this->historyStart();
+		info("map reloaded: %d rows changed", rows);
+	}
 
-	fclose(f);
-	return total;
+	return rows;
 }
 
 /**
@@ -272,6 +342,21 @@ int Map::getDiamonds()
 	return this->diamonds;
 }
 
+/**
+ *  Returns player position.
+ *  \param x            pointer to x coordinate (filled in)
+ *  \param y            pointer to y coordinate (filled in)
+ *  \return             false if there is no player
+ */
+bool Map::getPlayerXY(int* x, int* y)
+{
+	assert(this->loaded);
+
+	*x = this->playerX;
+	*y = this->playerY;
+	return this->playerX >= 0;
+}
+
 /**
  *  Returns current map state.
  *  \return             map state
@@ -282,15 +367,20 @@ MAPSTATE Map::getState()
 }
 
 /**
- *  Returns pointer to Tile object at coordinates x,y.
- *  \return             pointer to Tile object at x,y
+ *  Returns glyph all cells of chunk containing given cell are made of.
+ *  Renderers use it to skip or draw whole chunk at once.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             ' ', '#' or '.' for uniform chunk, '\0' if chunk holds
+ *                      tiles
  */
-Tile* Map::getTileXY(int x, int y)
+char Map::getFill(int x, int y)
 {
 	assert(this->loaded);
-	assert(this->tiles && this->width > x && this->height > y);
+	assert(this->chunks && this->width > x && this->height > y);
 
-	return this->tiles[y][x];
+	int chunk = (y >> MAP_CHUNK_SHIFT) * this->chunksX + (x >> MAP_CHUNK_SHIFT);
+	return this->chunks[chunk] ? '\0' : this->fills[chunk];
 }
 
 /**
@@ -304,15 +394,18 @@ Tile* Map::getTileXY(int x, int y)
 void Map::setTileXY(int srcX, int srcY, int dstX, int dstY)
 {
 	assert(this->loaded);
-	assert(this->tiles);
+	assert(this->chunks);
 	assert(srcX >= 0 && this->width > srcX && srcY >= 0 && this->height > srcY);
 	assert(dstX >= 0 && this->width > dstX && dstY >= 0 && this->height > dstY);
 
-	if(this->tiles[dstY][dstX] != NULL)
-		delete this->tiles[dstY][dstX];
+	Tile* old = *this->cell(dstX, dstY);
 
-	this->tiles[dstY][dstX] = this->tiles[srcY][srcX];
-	this->tiles[srcY][srcX] = NULL;
+	// destination first so moving object never passes through free cell
+	this->putTile(dstX, dstY, this->getTileXY(srcX, srcY));
+	this->putTile(srcX, srcY, NULL);
+
+	if(old != NULL)
+		delete old;
 }
 
 /**
@@ -327,10 +420,11 @@ void Map::setTileXY(int srcX, int srcY, int dstX, int dstY)
 bool Map::movePlayer(int xStep, int yStep)
 {
 	assert(this->loaded);
-	assert(this->tiles);
+	assert(this->chunks);
+	TRACE_SCOPE("Map::movePlayer");
 
-	int x = 0, y = 0;
-	if(!findTileType(TILE_PLAYER, &x, &y))
+	int x = this->playerX, y = this->playerY;
+	if(x < 0)
 	{
 		debug("oops! TILE_PLAYER not found!");
 		return false;
@@ -339,35 +433,40 @@ bool Map::movePlayer(int xStep, int yStep)
 	assert(x+xStep >= 0 && this->width > x+xStep &&
 		y+yStep >= 0 && this->height > y+yStep);
 
-	debug("from x=%d y=%d to x=%d y=%d", x, y, x+xStep, y+yStep);
+	Tile* target = this->getTileXY(x+xStep, y+yStep);
 
-	// empty tile
-	if(this->tiles[y+yStep][x+xStep] == NULL)
+	// empty tile (unless there is creature)
+	if(target == NULL)
 	{
+		if(this->entities.find(x+xStep, y+yStep) >= 0)
+		{
+			debug("invalid move (creature in the way)");
+			return false;
+		}
+
 		this->setTileXY(x, y, x+xStep, y+yStep);
 		return true;
 	}
 	// non-empty tile
 	else
-		if(this->tiles[y+yStep][x+xStep]->isSteppable() == false)
+		if(target->isSteppable() == false)
 		{
 			// non-steppable tile. Move cannot be performed.
 			debug("invalid move (tile not steppable)");
 			return false;
 		}
 
-		switch(this->tiles[y+yStep][x+xStep]->getType())
+		switch(target->getType())
 		{
 		case TILE_DIAMOND:
 			this->diamonds--;
 			debug("diamonds left: %d", this->diamonds);
 
 			// unlock exit in case all diamonds has been collected
-			if(this->diamonds == 0)
+			if(this->diamonds == 0 && this->exitX >= 0)
 			{
-				int ex = 0, ey = 0;
-				this->findTileType(TILE_EXIT, &ex, &ey);
-				this->tiles[ey][ex]->setLocked(false);
+				this->getTileXY(this->exitX, this->exitY)->setLocked(false);
+				this->touch(this->exitX, this->exitY);
 				debug("exit unlocked");
 			}
 
@@ -380,12 +479,15 @@ bool Map::movePlayer(int xStep, int yStep)
 
 		case TILE_EXIT:
 			// if exit tile is steppable, it's also unlocked
-			assert(this->tiles[y+yStep][x+xStep]->isLocked() == false);
+			assert(target->isLocked() == false);
 
 			// vanish player (this may cause oops in this method unless handled
 			// by lifecycle through map->status == MAP_WON
-			delete this->tiles[y][x];
-			this->tiles[y][x] = NULL;
+			{
+				Tile* player = this->getTileXY(x, y);
+				this->putTile(x, y, NULL);
+				delete player;
+			}
 
 			this->state = MAP_WON;
 			break;
@@ -399,55 +501,367 @@ bool Map::movePlayer(int xStep, int yStep)
 }
 
 /**
- *  Applies game-based gravity rules to entire map.
+ *  Applies game rules (see RuleSet) to entire map. Map is scanned top to
+ *  bottom so falling object falls all the way down in one tick, object
+ *  rolled right is skipped not to move twice.
  */
 void Map::doGravity()
 {
 	assert(this->loaded);
-	assert(this->tiles);
+	assert(this->chunks);
+	TRACE_SCOPE("Map::doGravity");
 
-	int x, y;
+	int stride = this->width + 2;
+	int x, y, chunk;
+	int falling = 0;
+
+	// every change of pass unsettles map (see putTile() and touch())
+	this->settled = true;
 	for(y = 0; y < this->height; y++)
-		for(x = 0; x < this->width; x++)
+	{
+		unsigned char* row = this->classes + (y + 1) * stride + 1;
+		int* rounds = this->rounds + (y >> MAP_CHUNK_SHIFT) * this->chunksX;
+
+		// x carries over to next chunk (object rolled right is skipped)
+		x = 0;
+		for(chunk = 0; chunk < this->chunksX; chunk++)
 		{
-			if(this->tiles[y][x] == NULL)
+			int end = (chunk + 1) << MAP_CHUNK_SHIFT;
+			if(end > this->width)
+				end = this->width;
+
+			// chunk without round objects has nothing to do (counts are
+			// exact at any moment, objects moved earlier are counted)
+			if(!rounds[chunk])
+			{
+				if(x < end)
+					x = end;
 				continue;
+			}
 
-			switch(this->tiles[y][x]->getType())
+			// chunk with round object holds tiles (it is released only when
+			// its last tile leaves, then there is nothing left to do in it)
+			Tile** cells = this->chunks[(y >> MAP_CHUNK_SHIFT) *
+				this->chunksX + chunk] +
+				((y & (MAP_CHUNK - 1)) << MAP_CHUNK_SHIFT) -
+				(chunk << MAP_CHUNK_SHIFT);
+			unsigned char* last = row + end;
+			unsigned char* c;
+			for(c = row + x; c < last; c++)
 			{
-			case TILE_BOULDER:
-			case TILE_DIAMOND:
-				if(y+1 < this->height)
-				{
-					// fall into empty space
-					if(this->tiles[y+1][x] == NULL)
-					{
-						this->tiles[y][x]->setFalling(true);
-						this->setTileXY(x, y, x, y+1);
+				if(*c != CLASS_ROUND)
+					continue;
 
-						debug("falling object from x=%d y=%d to x=%d y=%d",
-							x, y, x, y+1);
-					}
+				x = c - row;
+				int code = RuleSet::column(c - 1, stride) |
+					RuleSet::column(c, stride) << 6 |
+					RuleSet::column(c + 1, stride) << 12;
+				Tile* tile = cells[x];
+				switch(this->rules->lookup(code, tile->isFalling()))
+				{
+				case RULE_FALL:
+					tile->setFalling(true);
+					this->setTileXY(x, y, x, y+1);
+					falling++;
+					break;
+				case RULE_KILL:
 					// fall on player and kill him
-					else if(this->tiles[y+1][x]->getType() == TILE_PLAYER &&
-						this->tiles[y][x]->isFalling())
-					{
-						this->setTileXY(x, y, x, y+1);
-						this->state = MAP_LOST;
-
-						debug("player killed by object at x=%d y=%d", x, y+1);
-					}
-					// stop falling
-					else if(this->tiles[y][x]->isFalling())
+					this->setTileXY(x, y, x, y+1);
+					this->state = MAP_LOST;
+					break;
+				case RULE_STOP:
+					if(tile->isFalling())
 					{
-						this->tiles[y][x]->setFalling(false);
-
-						debug("object stopped falling at x=%d y=%d", x, y);
+						tile->setFalling(false);
+						this->touch(x, y);
 					}
+					// landing on creature crushes it
+					if(c[stride] == CLASS_SOLID && y + 1 < this->height)
+						this->crush(x, y+1);
+					break;
+				case RULE_ROLL_LEFT:
+					this->setTileXY(x, y, x-1, y);
+					break;
+				case RULE_ROLL_RIGHT:
+					this->setTileXY(x, y, x+1, y);
+					c++;
+					break;
+				default:
+					break;
 				}
-				break;
 			}
+			x = c - row;
+		}
+	}
+
+	TRACE_COUNTER("falling", falling);
+}
+
+/**
+ *  Returns whether map stands still until player moves: last doGravity()
+ *  changed nothing and nothing changed since, there are no creatures and
+ *  player doesn't travel. Ticks of settled map change nothing, so game loop
+ *  can skip them and wait for input.
+ *  \return             true if map is settled
+ */
+bool Map::isSettled()
+{
+	return this->settled && !this->entities.getCount() &&
+		!(this->path && this->path->getTarget() >= 0);
+}
+
+/**
+ *  Moves all creatures by one cell. Firefly turns left if it can, otherwise
+ *  goes straight on or turns right without moving, butterfly does the same
+ *  the other way round, so both follow walls. Creature next to player kills
+ *  him. Creatures are swept in order of their index and collide with
+ *  everything through class grid.
+ */
+void Map::moveCreatures()
+{
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+
+	assert(this->loaded);
+	TRACE_SCOPE("Map::moveCreatures");
+
+	int stride = this->width + 2;
+	int offset[4] = { -stride, 1, stride, -1 };
+	int count = this->entities.getCount();
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		int x = this->entities.getX(i), y = this->entities.getY(i);
+		unsigned char* c = this->classes + (y + 1) * stride + x + 1;
+
+		if(c[-stride] == CLASS_PLAYER || c[stride] == CLASS_PLAYER ||
+			c[-1] == CLASS_PLAYER || c[1] == CLASS_PLAYER)
+		{
+			this->state = MAP_LOST;
+			continue;
+		}
+
+		int dir = this->entities.getDir(i);
+		int turn = this->entities.getType(i) == ENTITY_FIREFLY ? 3 : 1;
+		if(c[offset[(dir + turn) & 3]] == CLASS_EMPTY)
+			dir = (dir + turn) & 3;
+		else if(c[offset[dir]] != CLASS_EMPTY)
+		{
+			this->entities.setDir(i, (DIRECTION)((dir + 4 - turn) & 3));
+			continue;
+		}
+
+		c[0] = CLASS_EMPTY;
+		c[offset[dir]] = CLASS_SOLID;
+		this->entities.move(i, x + dx[dir], y + dy[dir]);
+		this->entities.setDir(i, (DIRECTION)dir);
+	}
+
+	TRACE_COUNTER("creatures", count);
+}
+
+/**
+ *  Returns creatures of map.
+ *  \return             creatures
+ */
+Entities* Map::getEntities()
+{
+	return &this->entities;
+}
+
+/**
+ *  Sets rules applied by doGravity().
+ *  \param rules        rules (not owned by map, e.g. RuleSet::classic())
+ */
+void Map::setRules(RuleSet* rules)
+{
+	assert(rules);
+	this->rules = rules;
+}
+
+/**
+ *  Starts recording ticks for rewinding. Map keeps recording until
+ *  setRewind(NULL), loading map or reloading it starts history over.
+ *  \param history      history (not owned by map, NULL stops recording)
+ */
+void Map::setRewind(Rewind* history)
+{
+	this->history = history;
+	if(history && this->loaded)
+		this->historyStart();
+}
+
+/**
+ *  Records changes made since last call as one tick of history. Called once
+ *  per tick, after player, gravity and creatures moved.
+ */
+void Map::record()
+{
+	assert(this->loaded);
+
+	if(!this->history)
+		return;
+
+	TRACE_SCOPE("Map::record");
+
+	int n = this->history->getTouched();
+	int k;
+
+	this->history->begin();
+	for(k = 0; k < n; k++)
+	{
+		int i = this->history->getTouched(k);
+		this->history->putCell(i, Map::tileCode(this->getTileXY(
+			i % this->width, i / this->width)));
+	}
+	this->history->end(this->diamonds, this->state, &this->entities);
+	TRACE_COUNTER("recorded", n);
+}
+
+/**
+ *  Returns map to state it had given number of ticks ago (as far as history
+ *  reaches).
+ *  \param ticks        number of ticks
+ *  \return             number of ticks rewound
+ */
+int Map::rewind(int ticks)
+{
+	assert(this->loaded);
+
+	if(!this->history)
+		return 0;
+
+	TRACE_SCOPE("Map::rewind");
+
+	// changes since last record (e.g. player entered exit) are tick of their
+	// own
+	if(this->history->getTouched())
+		this->record();
+
+	// restoring is not recorded
+	Rewind* history = this->history;
+	int stride = this->width + 2;
+	int t, i, x, y;
+	this->history = NULL;
+
+	for(t = 0; t < ticks && history->back(); t++)
+	{
+		// creatures leave their cells first (cells they are in have no tile)
+		if(history->creaturesRestored())
+			for(i = this->entities.getCount() - 1; i >= 0; i--)
+			{
+				x = this->entities.getX(i);
+				y = this->entities.getY(i);
+				this->entities.remove(i);
+				this->classes[(y + 1) * stride + x + 1] =
+					RuleSet::classify(this->getTileXY(x, y));
+			}
+
+		for(i = 0; i < history->getRestored(); i++)
+		{
+			int c = history->getRestored(i);
+			x = c % this->width;
+			y = c / this->width;
+
+			Tile* old = *this->cell(x, y);
+			this->putTile(x, y, Map::codeTile(history->getCode(c)));
+			delete old;
 		}
+
+		if(history->creaturesRestored())
+			for(i = 0; i < history->getCreatures(); i++)
+			{
+				DIRECTION dir;
+				ENTITYTYPE type = history->getCreature(i, &x, &y, &dir);
+				this->entities.add(type, x, y, dir);
+				this->classes[(y + 1) * stride + x + 1] = CLASS_SOLID;
+			}
+
+		this->diamonds = history->getDiamonds();
+		this->state = (MAPSTATE)history->getState();
+	}
+
+	this->history = history;
+	debug("rewound %d ticks, %d left", t, history->getTicks());
+	return t;
+}
+
+/**
+ *  Attaches travel distance field. Map keeps field in step with passable
+ *  cells from then on, loading or reloading map starts it over.
+ *  \param path         field (not owned by map, NULL stops travel for good)
+ */
+void Map::setPath(Path* path)
+{
+	this->path = path;
+	if(path && this->loaded)
+		this->pathStart();
+}
+
+/**
+ *  Starts player travel to given cell, travelStep() then moves player one
+ *  step closer on every tick.
+ *  \param x            x coordinate of target (negative stops travel)
+ *  \param y            y coordinate of target
+ *  \return             true if player has way to target
+ */
+bool Map::travel(int x, int y)
+{
+	assert(this->loaded);
+
+	if(!this->path)
+		return false;
+	if(x < 0 || y < 0 || x >= this->width || y >= this->height)
+	{
+		this->path->setTarget(-1);
+		return false;
+	}
+
+	TRACE_SCOPE("Map::travel");
+
+	this->path->setTarget(y * this->width + x);
+	if(this->playerX < 0 || this->path->getDistance(
+		this->playerY * this->width + this->playerX) == PATH_FAR)
+	{
+		debug("no way to %d,%d", x, y);
+		this->path->setTarget(-1);
+		return false;
+	}
+
+	debug("travel to %d,%d", x, y);
+	return true;
+}
+
+/**
+ *  Moves travelling player one step closer to target. Field doesn't know
+ *  about creatures, so travel stops once one is in the way (as it does when
+ *  target is reached or there is no way left).
+ *  \return             true if player moved
+ */
+bool Map::travelStep()
+{
+	if(!this->path || this->path->getTarget() < 0 || this->playerX < 0)
+		return false;
+
+	TRACE_SCOPE("Map::travelStep");
+
+	int w = this->width;
+	int next = this->path->next(this->playerY * w + this->playerX);
+
+	if(next < 0 || !this->movePlayer(next % w - this->playerX,
+		next / w - this->playerY))
+	{
+		debug("travel stopped");
+		this->path->setTarget(-1);
+		return false;
+	}
+
+	if(this->playerX < 0 ||
+		this->playerY * w + this->playerX == this->path->getTarget())
+		this->path->setTarget(-1);
+	TRACE_COUNTER("travel repairs", this->path->getVisited());
+
+	return true;
 }
 
 /**
@@ -467,59 +881,1179 @@ void Map::doGravity()
 bool Map::findTileType(TILETYPE type, int* x, int* y)
 {
 	assert(this->loaded);
-	assert(this->tiles);
+	assert(this->chunks);
 	assert((*x) >= 0 && (*x) < this->width && (*y) >= 0 && (*y) < this->height);
 
+	TRACE_SCOPE("Map::findTileType");
+
 	int ix, iy;
 	for(iy = (*y); iy < this->height; iy++)
-		for(ix = (*x); ix < this->width; ix++)
+		for(ix = (*x); ix < this->width; )
 		{
-			if(this->tiles[iy][ix] == NULL)
+			// row of chunk at once
+			Tile** cells = this->chunks[(iy >> MAP_CHUNK_SHIFT) *
+				this->chunksX + (ix >> MAP_CHUNK_SHIFT)];
+			int end = (ix | (MAP_CHUNK - 1)) + 1;
+			if(end > this->width)
+				end = this->width;
+
+			if(!cells)
+			{
+				// uniform chunk, the first cell or none
+				Tile* tile = this->getTileXY(ix, iy);
+				if(tile && tile->getType() == type)
+				{
+					(*x) = ix;
+					(*y) = iy;
+					return true;
+				}
+				ix = end;
 				continue;
+			}
 
-			if(this->tiles[iy][ix]->getType() == type)
+			cells += (iy & (MAP_CHUNK - 1)) << MAP_CHUNK_SHIFT;
+			for(; ix < end; ix++)
 			{
-				// found, set references to new coordinates
-				(*x) = ix;
-				(*y) = iy;
-				debug("tile '%c' found at coords x=%d y=%d", type, ix, iy);
-				return true;
-			}
+				Tile* tile = cells[ix & (MAP_CHUNK - 1)];
+				if(tile == NULL)
+					continue;
+
+				if(tile->getType() == type)
+				{
+					// found, set references to new coordinates
+					(*x) = ix;
+					(*y) = iy;
+					return true;
+				}
+			}
 		}
 
 	// not found
 	return false;
 }
 
+/**
+ *  Returns whether player can walk to cell through empty, sand and diamond
+ *  cells as map is now (objects that will fall later are not considered).
+ *  Exit is reachable if player can step on it once it's unlocked.
+ *  Reachable region is maintained incrementally by tile changes, so query is
+ *  O(1) unless region had to be invalidated.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             true if player can reach cell
+ */
+bool Map::isReachable(int x, int y)
+{
+	assert(this->loaded);
+	assert(x >= 0 && x < this->width && y >= 0 && y < this->height);
+
+	if(x == this->exitX && y == this->exitY)
+		return this->exitReachable();
+
+	this->reachUpdate();
+	return this->reach[y * this->width + x];
+}
+
+/**
+ *  Returns whether player can reach exit (locked or not).
+ *  \return             true if exit is reachable
+ */
+bool Map::exitReachable()
+{
+	assert(this->loaded);
+
+	int x = this->exitX, y = this->exitY;
+	if(x < 0)
+		return false;
+
+	this->reachUpdate();
+	return (x > 0 && this->reach[y * this->width + x - 1]) ||
+		(x < this->width - 1 && this->reach[y * this->width + x + 1]) ||
+		(y > 0 && this->reach[(y - 1) * this->width + x]) ||
+		(y < this->height - 1 && this->reach[(y + 1) * this->width + x]);
+}
+
+/**
+ *  Returns number of diamonds player can reach.
+ *  \return             number of reachable diamonds
+ */
+int Map::getReachableDiamonds()
+{
+	assert(this->loaded);
+
+	this->reachUpdate();
+	return this->reachDiamonds;
+}
+
+/**
+ *  Returns whether map can still be won as it is now, i.e. player can reach
+ *  all remaining diamonds and exit.
+ *  \return             false if map can't be won without objects moving
+ */
+bool Map::isWinnable()
+{
+	assert(this->loaded);
+
+	if(this->state != MAP_NONE)
+		return this->state == MAP_WON;
+
+	return this->getReachableDiamonds() == this->diamonds &&
+		this->exitReachable();
+}
+
 /**
  *  Cleanup all map information.
  */
 void Map::free()
 {
-	int x, y;
+	int i, x;
 
-	// free tiles and pointer arrays
-	if(this->tiles)
+	// free tiles and chunks
+	if(this->chunks)
 	{
 		debug("freeing map data");
 
-		for(y = 0; y < this->height; y++)
+		for(i = 0; i < this->chunksX * this->chunksY; i++)
 		{
-			// delete row if exists
-			if(this->tiles[y])
+			// uniform chunks have no tiles
+			if(!this->chunks[i])
+				continue;
+			for(x = 0; x < MAP_CHUNK * MAP_CHUNK; x++)
+				delete this->chunks[i][x];
+			MEM_DELETE(MEM_GRID, this->chunks[i], MAP_CHUNK * MAP_CHUNK);
+		}
+		i = this->chunksX * this->chunksY;
+		MEM_DELETE(MEM_GRID, this->chunks, i);
+		MEM_DELETE(MEM_GRID, this->fills, i);
+		MEM_DELETE(MEM_GRID, this->rounds, i);
+		MEM_DELETE(MEM_GRID, this->filled, i);
+		this->chunks = NULL;
+		this->fills = NULL;
+		this->rounds = NULL;
+		this->filled = NULL;
+	}
+
+	MEM_DELETE(MEM_GRID, this->classes, (this->width + 2) *
+		(this->height + 2));
+	this->classes = NULL;
+	this->entities.free();
+	MEM_DELETE(MEM_GRID, this->source, this->width * this->height);
+	this->source = NULL;
+
+	MEM_DELETE(MEM_GRID, this->reach, this->width * this->height);
+	MEM_DELETE(MEM_GRID, this->reachQueue, this->width * this->height);
+	this->reach = NULL;
+	this->reachQueue = NULL;
+	this->reachDirty = true;
+	this->reachDiamonds = 0;
+	this->playerX = -1;
+	this->playerY = -1;
+	this->exitX = -1;
+	this->exitY = -1;
+
+	this->width = 0;
+	this->height = 0;
+	this->chunksX = 0;
+	this->chunksY = 0;
+	this->diamonds = 0;
+	this->loaded = false;
+}
+
+/**
+ *  Reads map file into grid of glyphs the same way as load() does (rows
+ *  padded by spaces to the widest one) and checks it is playable like
+ *  checkGrid() does, errors are reported with line and column. Big files are
+ *  split at line starts and parts are parsed in parallel.
+ *  \param filename     map filename
+ *  \param width        pointer to map width (filled in)
+ *  \param height       pointer to map height (filled in)
+ *  \return             grid (width * height glyphs, delete[] by caller) or
+ *                      NULL for error
+ */
+char* Map::readGrid(const char* filename, int* width, int* height)
+{
+	struct stat st;
+	int i;
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		error(false, "couldn't open map file: %s", filename);
+		return NULL;
+	}
+	if(fstat(fd, &st) < 0 || !st.st_size)
+	{
+		close(fd);
+		error(false, "map file is empty: %s", filename);
+		return NULL;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+	{
+		error(false, "couldn't read map file: %s", filename);
+		return NULL;
+	}
+
+	// parts end after first newline past their share of file
+	MAPPARSE parse;
+	long size = st.st_size;
+	int count = size / MAP_PARSE_BYTES + 1;
+	long begin = 0;
+	parse.data = (const char*)p;
+	parse.parts = new MAPPART[count];
+	for(i = 0; i < count; i++)
+	{
+		long end = size / count * (i + 1);
+		if(end < begin)
+			end = begin;
+		const char* newline = i < count - 1 ?
+			(const char*)memchr(parse.data + end, '\n', size - end) : NULL;
+
+		parse.parts[i].begin = begin;
+		parse.parts[i].end = newline ? newline - parse.data + 1 : size;
+		begin = parse.parts[i].end;
+	}
+
+	Pool pool(count < Pool::cpuCount() ? count : Pool::cpuCount());
+	pool.run(Map::parseMeasure, &parse, count);
+
+	// rectangle, first empty line ends map
+	int w = 0, h = 0;
+	bool ended = false;
+	for(i = 0; i < count; i++)
+	{
+		if(ended)
+			parse.parts[i].lines = 0;
+		parse.parts[i].row = h;
+		h += parse.parts[i].lines;
+		if(w < parse.parts[i].width)
+			w = parse.parts[i].width;
+		if(parse.parts[i].empty)
+			ended = true;
+	}
+	if(!w || !h)
+	{
+		error(false, "map file is empty: %s", filename);
+		delete[] parse.parts;
+		munmap(p, size);
+		return NULL;
+	}
+
+	parse.grid = new char[(size_t)w * h];
+	parse.width = w;
+	pool.run(Map::parseRows, &parse, count);
+	munmap(p, size);
+
+	// merge counts of parts
+	MAPPART all;
+	memset(&all, 0, sizeof(all));
+	for(i = 0; i < count; i++)
+	{
+		MAPPART* part = parse.parts + i;
+		int j;
+
+		for(j = 0; j < part->players && all.players + j < 2; j++)
+		{
+			all.playerLine[all.players + j] = part->playerLine[j];
+			all.playerColumn[all.players + j] = part->playerColumn[j];
+		}
+		all.players += part->players;
+		all.exits += part->exits;
+		if(part->unknown && !all.unknown)
+		{
+			all.unknownGlyph = part->unknownGlyph;
+			all.unknownLine = part->unknownLine;
+			all.unknownColumn = part->unknownColumn;
+		}
+		all.unknown += part->unknown;
+	}
+	delete[] parse.parts;
+
+	if(all.unknown)
+		warning("%s:%d:%d: unknown tile type '%c' (%d unknown tiles are "
+			"empty)", filename, all.unknownLine, all.unknownColumn,
+			all.unknownGlyph, all.unknown);
+	if(all.players != 1)
+	{
+		if(all.players)
+		{
+			error(false, "%s:%d:%d: map must have exactly one player symbol! "
+				"(first one is at %d:%d)", filename, all.playerLine[1],
+				all.playerColumn[1], all.playerLine[0], all.playerColumn[0]);
+		}
+		else
+		{
+			error(false, "%s: map must have exactly one player symbol!",
+				filename);
+		}
+		delete[] parse.grid;
+		return NULL;
+	}
+	if(!all.exits)
+	{
+		error(false, "%s: map must have at least one exit symbol!", filename);
+		delete[] parse.grid;
+		return NULL;
+	}
+
+	*width = w;
+	*height = h;
+	return parse.grid;
+}
+
+/**
+ *  Checks that grid of glyphs is playable map: there must be exactly one
+ *  player and at least one exit.
+ *  \param grid         grid of glyphs
+ *  \param width        map width
+ *  \param height       map height
+ *  \return             true if map is playable
+ */
+bool Map::checkGrid(const char* grid, int width, int height)
+{
+	int players = 0;
+	int exits = 0;
+	int i;
+
+	for(i = 0; i < width * height; i++)
+	{
+		if(grid[i] == '~')
+			players++;
+		if(grid[i] == ';')
+			exits++;
+	}
+
+	if(players != 1)
+	{
+		error(false, "map must have exactly one player symbol!");
+		return false;
+	}
+	if(!exits)
+	{
+		error(false, "map must have at least one exit symbol!");
+		return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Returns whether player can walk through tile. Exit is not passable, it
+ *  ends the game.
+ *  \param tile         tile (NULL is empty cell)
+ *  \return             true if tile is passable
+ */
+bool Map::isPassable(Tile* tile)
+{
+	if(!tile)
+		return true;
+
+	switch(tile->getType())
+	{
+	case TILE_SAND:
+	case TILE_DIAMOND:
+	case TILE_PLAYER:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ *  Creates tile of map file glyph.
+ *  \param glyph        map file glyph
+ *  \return             new tile or NULL for empty cell (or unknown glyph)
+ */
+Tile* Map::newTile(char glyph)
+{
+	switch(glyph)
+	{
+	case '#':
+		return new Tile(TILE_WALL, false, false);
+	case '.':
+		return new Tile(TILE_SAND, true, false);
+	case '@':
+		return new Tile(TILE_BOULDER, false, false);
+	case '$':
+		return new Tile(TILE_DIAMOND, true, false);
+	case '~':
+		return new Tile(TILE_PLAYER, false, false);
+	case ';':
+		return new Tile(TILE_EXIT, true, false);
+	default:
+		return NULL;
+	}
+}
+
+/**
+ *  Returns code of tile for rewind history: index of type in glyphs of
+ *  codeTile() with falling (8) and locked (16) flags.
+ *  \param tile         tile (NULL for empty cell)
+ *  \return             code
+ */
+unsigned char Map::tileCode(Tile* tile)
+{
+	if(!tile)
+		return 0;
+
+	unsigned char code;
+	switch(tile->getType())
+	{
+	case TILE_WALL:
+		code = 1;
+		break;
+	case TILE_SAND:
+		code = 2;
+		break;
+	case TILE_BOULDER:
+		code = 3;
+		break;
+	case TILE_DIAMOND:
+		code = 4;
+		break;
+	case TILE_PLAYER:
+		code = 5;
+		break;
+	default:
+		code = 6;
+		break;
+	}
+
+	return code | (tile->isFalling() ? 8 : 0) | (tile->isLocked() ? 16 : 0);
+}
+
+/**
+ *  Creates tile of rewind history code (see tileCode()).
+ *  \param code         code
+ *  \return             new tile or NULL for empty cell
+ */
+Tile* Map::codeTile(unsigned char code)
+{
+	static const char glyphs[] = " #.@$~;";
+
+	Tile* tile = Map::newTile(glyphs[code & 7]);
+	if(!tile)
+		return NULL;
+
+	tile->setFalling(code & 8);
+	if(code & 16)
+		tile->setLocked(true);
+	return tile;
+}
+
+/**
+ *  Returns cell for writing. Uniform chunk gets tiles of its own first.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \return             pointer to tile pointer of cell
+ */
+Tile** Map::cell(int x, int y)
+{
+	int chunk = (y >> MAP_CHUNK_SHIFT) * this->chunksX + (x >> MAP_CHUNK_SHIFT);
+	int i;
+
+	if(!this->chunks[chunk])
+	{
+		int x0 = x & ~(MAP_CHUNK - 1);
+		int y0 = y & ~(MAP_CHUNK - 1);
+		Tile** cells = MEM_NEW(MEM_GRID, Tile*, MAP_CHUNK * MAP_CHUNK);
+
+		// cells outside of map stay empty
+		for(i = 0; i < MAP_CHUNK * MAP_CHUNK; i++)
+			cells[i] = x0 + (i & (MAP_CHUNK - 1)) < this->width &&
+				y0 + (i >> MAP_CHUNK_SHIFT) < this->height ?
+				Map::newTile(this->fills[chunk]) : NULL;
+
+		this->filled[chunk] = 0;
+		if(this->fills[chunk] != ' ')
+			for(i = 0; i < MAP_CHUNK * MAP_CHUNK; i++)
+				this->filled[chunk] += cells[i] != NULL;
+		this->chunks[chunk] = cells;
+		this->fills[chunk] = '\0';
+	}
+
+	return this->chunks[chunk] + ((y & (MAP_CHUNK - 1)) << MAP_CHUNK_SHIFT |
+		(x & (MAP_CHUNK - 1)));
+}
+
+/**
+ *  Pool job measuring one part of map file.
+ *  \param parse        pointer to MAPPARSE
+ *  \param index        index of part
+ */
+void Map::parseMeasure(void* parse, int index)
+{
+	MAPPARSE* p = (MAPPARSE*)parse;
+	MAPPART* part = p->parts + index;
+	long i;
+	int x = 0;
+
+	part->lines = 0;
+	part->width = 0;
+	part->empty = false;
+	for(i = part->begin; i < part->end; i++)
+	{
+		if(p->data[i] == '\n')
+		{
+			if(!x)
 			{
-				for(x = 0; x < this->width; x++)
+				part->empty = true;
+				break;
+			}
+			part->lines++;
+			if(part->width < x)
+				part->width = x;
+			x = 0;
+		}
+		else if(isprint((unsigned char)p->data[i]))
+			x++;
+	}
+}
+
+/**
+ *  Pool job parsing lines of one part of map file into its rows of grid and
+ *  counting players, exits and unknown glyphs.
+ *  \param parse        pointer to MAPPARSE
+ *  \param index        index of part
+ */
+void Map::parseRows(void* parse, int index)
+{
+	MAPPARSE* p = (MAPPARSE*)parse;
+	MAPPART* part = p->parts + index;
+	long i = part->begin;
+	int r;
+
+	part->players = 0;
+	part->exits = 0;
+	part->unknown = 0;
+	for(r = 0; r < part->lines; r++)
+	{
+		char* row = p->grid + (size_t)(part->row + r) * p->width;
+		long start = i;
+		int x = 0;
+
+		memset(row, ' ', p->width);
+		for(; p->data[i] != '\n'; i++)
+		{
+			char glyph = p->data[i];
+			if(!isprint((unsigned char)glyph))
+				continue;
+			row[x++] = glyph;
+
+			switch(glyph)
+			{
+			case '~':
+				if(part->players < 2)
 				{
-					if(this->tiles[y][x])
-						delete this->tiles[y][x];
+					part->playerLine[part->players] = part->row + r + 1;
+					part->playerColumn[part->players] = i - start + 1;
+				}
+				part->players++;
+				break;
+			case ';':
+				part->exits++;
+				break;
+			case ' ':
+			case '#':
+			case '.':
+			case '@':
+			case '$':
+			case '*':
+			case '%':
+				break;
+			default:
+				if(!part->unknown++)
+				{
+					part->unknownGlyph = glyph;
+					part->unknownLine = part->row + r + 1;
+					part->unknownColumn = i - start + 1;
 				}
 			}
-			delete[] this->tiles[y];
 		}
-		delete[] this->tiles;
+		i++;
 	}
+}
 
-	this->width = 0;
-	this->height = 0;
-	this->loaded = false;
+/**
+ *  Builds tiles, creatures, class grid and the rest of map state of grid of
+ *  glyphs. Map has to be freed and grid checked before (see checkGrid()).
+ *  Rows of chunks of big map are built in parallel.
+ *  \param grid         grid of glyphs (kept as source, see reload())
+ *  \param width        map width
+ *  \param height       map height
+ *  \return             number of read tiles
+ */
+int Map::build(char* grid, int width, int height)
+{
+	int x, y, c;
+
+	debug("map rectangle size: %ix%i", width, height);
+
+	this->width = width;
+	this->height = height;
+	this->source = grid;
+	this->entities.reset(width, height);
+
+	this->chunksX = (width + MAP_CHUNK - 1) >> MAP_CHUNK_SHIFT;
+	this->chunksY = (height + MAP_CHUNK - 1) >> MAP_CHUNK_SHIFT;
+	this->chunks = MEM_NEW(MEM_GRID, Tile**, this->chunksX * this->chunksY);
+	this->fills = MEM_NEW(MEM_GRID, char, this->chunksX * this->chunksY);
+	this->rounds = MEM_NEW(MEM_GRID, int, this->chunksX * this->chunksY);
+	this->filled = MEM_NEW(MEM_GRID, int, this->chunksX * this->chunksY);
+	// source is allocated by caller, accounted from now on (see free())
+	MEM_ALLOC(MEM_GRID, (size_t)width * height);
+
+	// class grid for rules (one cell border of CLASS_SOLID)
+	int stride = width + 2;
+	this->classes = MEM_NEW(MEM_GRID, unsigned char, stride * (height + 2));
+	memset(this->classes, CLASS_SOLID, stride);
+	memset(this->classes + (height + 1) * stride, CLASS_SOLID, stride);
+
+	MAPBUILD b;
+	b.map = this;
+	b.grid = grid;
+	b.bands = new MAPBAND[this->chunksY];
+	{
+		int threads = Pool::cpuCount();
+		if(threads > this->chunksY)
+			threads = this->chunksY;
+		Pool pool(width * height >= MAP_BUILD_CELLS ? threads : 1);
+		pool.run(Map::buildBand, &b, this->chunksY);
+	}
+
+	// merge bands, first player and exit are those of first band with any
+	int uniform = 0;
+	for(c = 0; c < this->chunksY; c++)
+	{
+		MAPBAND* band = b.bands + c;
+
+		uniform += band->uniform;
+		this->diamonds += band->diamonds;
+		if(this->playerX < 0 && band->playerX >= 0)
+		{
+			this->playerX = band->playerX;
+			this->playerY = band->playerY;
+		}
+		if(this->exitX < 0 && band->exitX >= 0)
+		{
+			this->exitX = band->exitX;
+			this->exitY = band->exitY;
+		}
+
+		// creatures are added in row order (they move in order they were
+		// added), uniform chunks have none
+		for(y = c << MAP_CHUNK_SHIFT; band->creatures &&
+			y < ((c + 1) << MAP_CHUNK_SHIFT) && y < height; y++)
+			for(x = 0; x < width; x++)
+			{
+				if(this->fills[(y >> MAP_CHUNK_SHIFT) * this->chunksX +
+					(x >> MAP_CHUNK_SHIFT)])
+				{
+					x |= MAP_CHUNK - 1;
+					continue;
+				}
+				if(grid[y * width + x] == '*')
+					this->entities.add(ENTITY_FIREFLY, x, y, DIR_LEFT);
+				else if(grid[y * width + x] == '%')
+					this->entities.add(ENTITY_BUTTERFLY, x, y, DIR_DOWN);
+			}
+	}
+	delete[] b.bands;
+
+	this->loaded = true;
+	debug("%i map tiles loaded, %d of %d chunks uniform", width * height,
+		uniform, this->chunksX * this->chunksY);
+
+	this->state = MAP_NONE;
+
+	// if there are any diamonds, be sure to lock exit
+	if(this->exitX >= 0 && this->diamonds > 0)
+		this->getTileXY(this->exitX, this->exitY)->setLocked(true);
+
+	// reachable region is computed on first query
+	this->reach = MEM_NEW(MEM_GRID, unsigned char, width * height);
+	this->reachQueue = MEM_NEW(MEM_GRID, int, width * height);
+	this->reachDirty = true;
+	this->settled = false;
+
+	if(this->history)
+		this->historyStart();
+	if(this->path)
+		this->pathStart();
+
+	return width * height;
+}
+
+/**
+ *  Pool job building one row of chunks: finds uniform chunks, creates tiles
+ *  of the others and fills rows of class grid.
+ *  \param build        pointer to MAPBUILD
+ *  \param index        row of chunks
+ */
+void Map::buildBand(void* build, int index)
+{
+	MAPBUILD* b = (MAPBUILD*)build;
+	MAPBAND* band = b->bands + index;
+	Map* map = b->map;
+	const char* grid = b->grid;
+	int width = map->width;
+	int x, y, i, c;
+
+	band->uniform = 0;
+	band->diamonds = 0;
+	band->creatures = 0;
+	band->playerX = -1;
+	band->playerY = -1;
+	band->exitX = -1;
+	band->exitY = -1;
+
+	int y0 = index << MAP_CHUNK_SHIFT;
+	int y1 = y0 + MAP_CHUNK < map->height ? y0 + MAP_CHUNK : map->height;
+	for(c = index * map->chunksX; c < (index + 1) * map->chunksX; c++)
+	{
+		int x0 = (c % map->chunksX) << MAP_CHUNK_SHIFT;
+		int x1 = x0 + MAP_CHUNK < width ? x0 + MAP_CHUNK : width;
+		char fill = grid[y0 * width + x0];
+
+		map->chunks[c] = NULL;
+		map->fills[c] = fill;
+		map->rounds[c] = 0;
+		map->filled[c] = 0;
+
+		// chunk of empty cells, walls or sand needs no tiles
+		for(y = y0; y < y1 && (fill == ' ' || fill == '#' || fill == '.'); y++)
+			for(x = x0; x < x1; x++)
+				if(grid[y * width + x] != fill)
+				{
+					fill = '\0';
+					break;
+				}
+		if(fill == ' ' || fill == '#' || fill == '.')
+		{
+			band->uniform++;
+			continue;
+		}
+
+		map->chunks[c] = MEM_NEW(MEM_GRID, Tile*, MAP_CHUNK * MAP_CHUNK);
+		map->fills[c] = '\0';
+		for(i = 0; i < MAP_CHUNK * MAP_CHUNK; i++)
+			map->chunks[c][i] = NULL;
+	}
+
+	// tiles are allocated row by row (as rows are scanned), creatures are
+	// added once all bands are done
+	int stride = width + 2;
+	for(y = y0; y < y1; y++)
+	{
+		unsigned char* classes = map->classes + (y + 1) * stride;
+
+		classes[0] = CLASS_SOLID;
+		classes[width + 1] = CLASS_SOLID;
+		for(x = 0; x < width; x++)
+		{
+			c = (y >> MAP_CHUNK_SHIFT) * map->chunksX + (x >> MAP_CHUNK_SHIFT);
+			// uniform chunk (map isn't loaded yet for getTileXY())
+			if(!map->chunks[c])
+			{
+				classes[x + 1] = RuleSet::classify(map->fills[c] == '#' ?
+					&Map::fillWall : map->fills[c] == '.' ? &Map::fillSand :
+					NULL);
+				continue;
+			}
+
+			Tile** cell = map->chunks[c] + ((y & (MAP_CHUNK - 1)) <<
+				MAP_CHUNK_SHIFT | (x & (MAP_CHUNK - 1)));
+			char glyph = grid[y * width + x];
+			switch(glyph)
+			{
+			case '$':
+				band->diamonds++;
+				*cell = Map::newTile(glyph);
+				break;
+			case '*':
+			case '%':
+				// cells of creatures are solid
+				band->creatures++;
+				break;
+			case '~':
+				if(band->playerX < 0)
+				{
+					band->playerX = x;
+					band->playerY = y;
+				}
+				*cell = Map::newTile(glyph);
+				break;
+			case ';':
+				if(band->exitX < 0)
+				{
+					band->exitX = x;
+					band->exitY = y;
+				}
+				*cell = Map::newTile(glyph);
+				break;
+			default:
+				// unknown tile is same as empty tile
+				*cell = Map::newTile(glyph);
+			}
+			if(*cell)
+				map->filled[c]++;
+			classes[x + 1] = glyph == '*' || glyph == '%' ? CLASS_SOLID :
+				RuleSet::classify(*cell);
+			if(classes[x + 1] == CLASS_ROUND)
+				map->rounds[c]++;
+		}
+	}
+}
+
+/**
+ *  Replaces cell content (tile or creature) by map file glyph, keeping count
+ *  of diamonds.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \param glyph        map file glyph
+ */
+void Map::reloadCell(int x, int y, char glyph)
+{
+	Tile* old = *this->cell(x, y);
+	Tile* tile = Map::newTile(glyph);
+
+	if(old && old->getType() == TILE_DIAMOND)
+		this->diamonds--;
+	if(tile && tile->getType() == TILE_DIAMOND)
+		this->diamonds++;
+
+	int i = this->entities.find(x, y);
+	if(i >= 0)
+		this->entities.remove(i);
+
+	this->putTile(x, y, tile);
+	delete old;
+
+	if(glyph == '*' || glyph == '%')
+	{
+		this->entities.add(glyph == '*' ? ENTITY_FIREFLY : ENTITY_BUTTERFLY,
+			x, y, glyph == '*' ? DIR_LEFT : DIR_DOWN);
+		this->classes[(y + 1) * (this->width + 2) + x + 1] = CLASS_SOLID;
+	}
+}
+
+/**
+ *  Places tile to cell without deleting previous one. Every change of map
+ *  after loading goes through here so cached player position and reachable
+ *  region stay up to date: cell becoming passable next to region grows it,
+ *  reachable cell becoming blocked is checked locally for splitting region
+ *  and only if that fails region is recomputed on next query.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ *  \param tile         new tile (NULL for empty cell)
+ */
+void Map::putTile(int x, int y, Tile* tile)
+{
+	int i = y * this->width + x;
+	int chunk = (y >> MAP_CHUNK_SHIFT) * this->chunksX + (x >> MAP_CHUNK_SHIFT);
+	Tile** cell = this->chunks[chunk] ? this->chunks[chunk] +
+		((y & (MAP_CHUNK - 1)) << MAP_CHUNK_SHIFT | (x & (MAP_CHUNK - 1))) :
+		this->cell(x, y);
+	Tile* old = *cell;
+	bool was = Map::isPassable(old);
+	bool now = Map::isPassable(tile);
+	CELLCLASS c = RuleSet::classify(tile);
+
+	// shared tile of uniform chunks can't become tile of cell
+	assert(tile != &Map::fillWall && tile != &Map::fillSand);
+
+	*cell = tile;
+	this->settled = false;
+	if(this->history)
+		this->history->touch(i);
+	if(this->path && was != now)
+		this->path->setOpen(i, now);
+	this->filled[chunk] += (tile != NULL) - (old != NULL);
+	this->rounds[chunk] += (c == CLASS_ROUND) -
+		(RuleSet::classify(old) == CLASS_ROUND);
+	this->classes[(y + 1) * (this->width + 2) + x + 1] = c;
+
+	// chunk left empty is released
+	if(!this->filled[chunk])
+	{
+		MEM_DELETE(MEM_GRID, this->chunks[chunk], MAP_CHUNK * MAP_CHUNK);
+		this->chunks[chunk] = NULL;
+		this->fills[chunk] = ' ';
+	}
+
+	if(old && old->getType() == TILE_PLAYER &&
+		x == this->playerX && y == this->playerY)
+	{
+		// player vanished, so did region
+		this->playerX = -1;
+		this->playerY = -1;
+		this->reachDirty = true;
+	}
+	if(tile && tile->getType() == TILE_PLAYER)
+	{
+		// player came back (rewound), so did region
+		if(this->playerX < 0)
+			this->reachDirty = true;
+		this->playerX = x;
+		this->playerY = y;
+	}
+
+	if(this->reachDirty)
+		return;
+
+	if(this->reach[i])
+	{
+		if(old && old->getType() == TILE_DIAMOND)
+			this->reachDiamonds--;
+		if(tile && tile->getType() == TILE_DIAMOND)
+			this->reachDiamonds++;
+	}
+
+	if(was && !now && this->reach[i])
+	{
+		this->reach[i] = 0;
+		if(!this->reachSplit(x, y))
+			this->reachDirty = true;
+	}
+	else if(!was && now &&
+		((x > 0 && this->reach[i - 1]) ||
+		(x < this->width - 1 && this->reach[i + 1]) ||
+		(y > 0 && this->reach[i - this->width]) ||
+		(y < this->height - 1 && this->reach[i + this->width])))
+		this->reachGrow(x, y);
+}
+
+/**
+ *  Kills creature crushed by falling object. Butterfly turns into diamond.
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ */
+void Map::crush(int x, int y)
+{
+	int i = this->entities.find(x, y);
+	if(i < 0)
+		return;
+
+	ENTITYTYPE type = this->entities.getType(i);
+	this->entities.remove(i);
+	debug("creature '%c' crushed at %d,%d", type, x, y);
+
+	if(type == ENTITY_BUTTERFLY)
+	{
+		// exit is locked again until new diamond is collected
+		this->diamonds++;
+		if(this->exitX >= 0)
+		{
+			this->getTileXY(this->exitX, this->exitY)->setLocked(true);
+			this->touch(this->exitX, this->exitY);
+		}
+		this->putTile(x, y, new Tile(TILE_DIAMOND, true, false));
+	}
+	else
+		this->putTile(x, y, NULL);
+}
+
+/**
+ *  Marks cell changed where tile changes in place, for rewind history and
+ *  settled map (putTile() marks cells itself).
+ *  \param x            x coordinate
+ *  \param y            y coordinate
+ */
+void Map::touch(int x, int y)
+{
+	this->settled = false;
+	if(this->history)
+		this->history->touch(y * this->width + x);
+}
+
+/**
+ *  Starts history over from map as it is now.
+ */
+void Map::historyStart()
+{
+	int x, y;
+
+	this->history->start(this->width * this->height, this->diamonds,
+		this->state, &this->entities);
+	for(y = 0; y < this->height; y++)
+		for(x = 0; x < this->width; x++)
+			this->history->setCode(y * this->width + x,
+				Map::tileCode(this->getTileXY(x, y)));
+}
+
+/**
+ *  Starts travel field over from map as it is now (travel stops).
+ */
+void Map::pathStart()
+{
+	int x, y;
+
+	this->path->start(this->width, this->height);
+	for(y = 0; y < this->height; y++)
+		for(x = 0; x < this->width; x++)
+			if(Map::isPassable(this->getTileXY(x, y)))
+				this->path->setOpen(y * this->width + x, true);
+}
+
+/**
+ *  Adds passable cells connected to given cell to reachable region (flood
+ *  fill limited to cells not in region yet).
+ *  \param x            x coordinate of first cell
+ *  \param y            y coordinate of first cell
+ */
+void Map::reachGrow(int x, int y)
+{
+	int* queue = this->reachQueue;
+	int head = 0, tail = 0;
+	int w = this->width;
+
+	queue[tail++] = y * w + x;
+	this->reach[y * w + x] = 1;
+	while(head < tail)
+	{
+		int c = queue[head++];
+		int cx = c % w;
+		int cy = c / w;
+		int n[4];
+		int k;
+
+		Tile* tile = this->getTileXY(cx, cy);
+		if(tile && tile->getType() == TILE_DIAMOND)
+			this->reachDiamonds++;
+
+		n[0] = cx > 0 ? c - 1 : -1;
+		n[1] = cx < w - 1 ? c + 1 : -1;
+		n[2] = cy > 0 ? c - w : -1;
+		n[3] = cy < this->height - 1 ? c + w : -1;
+		for(k = 0; k < 4; k++)
+		{
+			if(n[k] < 0 || this->reach[n[k]] ||
+				!Map::isPassable(this->getTileXY(n[k] % w, n[k] / w)))
+				continue;
+
+			this->reach[n[k]] = 1;
+			queue[tail++] = n[k];
+		}
+	}
+}
+
+/**
+ *  Checks whether region stays connected after given cell was removed from
+ *  it. Reachable neighbours joined around the cell (through its 8 surrounding
+ *  cells) are connected in O(1), otherwise they are searched for by flood
+ *  fill of at most REACH_SPLIT_BUDGET cells.
+ *  \param x            x coordinate of removed cell
+ *  \param y            y coordinate of removed cell
+ *  \return             true if region is still connected, false if unknown
+ */
+bool Map::reachSplit(int x, int y)
+{
+	static const int ring[8][2] =
+	{
+		{ 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 },
+		{ 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }
+	};
+	int w = this->width;
+	int run[8];
+	int targets[4];
+	int ntargets = 0;
+	int runs = 0;
+	int k, t, first = -1;
+
+	// split surrounding ring to runs of reachable cells
+	bool open[8];
+	for(k = 0; k < 8; k++)
+	{
+		int rx = x + ring[k][0], ry = y + ring[k][1];
+		open[k] = rx >= 0 && rx < w && ry >= 0 && ry < this->height &&
+			this->reach[ry * w + rx];
+	}
+	for(k = 0; k < 8; k++)
+		if(!open[k])
+			first = k;
+	if(first < 0)
+		return true;    // whole ring is reachable
+	for(k = 1; k <= 8; k++)
+	{
+		int j = (first + k) % 8;
+
+		if(open[j] && !open[(j + 7) % 8])
+			runs++;
+		run[j] = open[j] ? runs : 0;
+	}
+
+	// orthogonal neighbours (even ring positions) must share one run
+	int joined = -1;
+	bool split = false;
+	for(k = 0; k < 8; k += 2)
+	{
+		if(!open[k])
+			continue;
+		targets[ntargets++] = (y + ring[k][1]) * w + x + ring[k][0];
+		if(joined < 0)
+			joined = run[k];
+		else if(run[k] != joined)
+			split = true;
+	}
+	if(!split)
+		return true;
+
+	// bounded search from first neighbour for the others (visited cells
+	// marked by 2 and restored afterwards)
+	int* queue = this->reachQueue;
+	int head = 0, tail = 0;
+	int found = 1;
+
+	queue[tail++] = targets[0];
+	this->reach[targets[0]] = 2;
+	while(head < tail && found < ntargets && tail < REACH_SPLIT_BUDGET)
+	{
+		int c = queue[head++];
+		int cx = c % w;
+		int cy = c / w;
+		int n[4];
+
+		n[0] = cx > 0 ? c - 1 : -1;
+		n[1] = cx < w - 1 ? c + 1 : -1;
+		n[2] = cy > 0 ? c - w : -1;
+		n[3] = cy < this->height - 1 ? c + w : -1;
+		for(k = 0; k < 4; k++)
+		{
+			if(n[k] < 0 || this->reach[n[k]] != 1)
+				continue;
+
+			for(t = 1; t < ntargets; t++)
+				if(n[k] == targets[t])
+					found++;
+			this->reach[n[k]] = 2;
+			queue[tail++] = n[k];
+		}
+	}
+	for(k = 0; k < tail; k++)
+		this->reach[queue[k]] = 1;
+
+	return found == ntargets;
+}
+
+/**
+ *  Recomputes reachable region by flood fill from player if it was
+ *  invalidated.
+ */
+void Map::reachUpdate()
+{
+	if(!this->reachDirty)
+		return;
+
+	TRACE_SCOPE("Map::reachUpdate");
+
+	memset(this->reach, 0, this->width * this->height);
+	this->reachDiamonds = 0;
+	if(this->playerX >= 0)
+		this->reachGrow(this->playerX, this->playerY);
+	this->reachDirty = false;
 }
@@ -22,9 +22,19 @@
 #ifndef __MAP_H
 #define __MAP_H
 
+#include <cassert>
 #include "tile.h"
+#include "entity.h"
 
 class Tile;
+class RuleSet;  // rules.h
+class LevelPack;  // pack.h
+class Rewind;  // rewind.h
+class Path;  // path.h
+
+// side of map chunk in cells (power of two)
+#define MAP_CHUNK_SHIFT 4
+#define MAP_CHUNK (1 << MAP_CHUNK_SHIFT)
 
 
 /**
@@ -44,27 +54,134 @@ typedef enum
 class Map
 {
 private:
-	Tile*** tiles;
+	// two-level grid of tiles: chunk of MAP_CHUNK x MAP_CHUNK cells either
+	// holds tile pointers or, if all its cells are empty, wall or sand, just
+	// glyph of them (no tiles are allocated for it)
+	Tile*** chunks;     // cells of chunk (row by row) or NULL if uniform
+	char* fills;        // glyph of uniform chunk
+	int* rounds;        // round objects in chunk (gravity skips chunks without)
+	int* filled;        // non-empty cells of chunk (chunk emptied is released)
+	int chunksX;
+	int chunksY;
+	char* source;   // glyphs of map file as loaded (see reload())
 	MAPSTATE state;
 	int width;
 	int height;
 	bool loaded;
 	int diamonds;   // total of diamonds to collect
+	int playerX;    // player position (-1 if there is no player)
+	int playerY;
+	int exitX;      // first exit position (-1 if there is no exit)
+	int exitY;
+
+	// rules and class grid they look at (one cell border of CLASS_SOLID)
+	RuleSet* rules;
+	unsigned char* classes;
+
+	// moving creatures (cells they are in have no tile and are CLASS_SOLID)
+	Entities entities;
+
+	// player reachable region (see reachUpdate())
+	unsigned char* reach;
+	int* reachQueue;
+	bool reachDirty;
+	int reachDiamonds;
+
+	// last doGravity() changed nothing and nothing changed since (gravity
+	// would change nothing again)
+	bool settled;
+
+	// history of ticks (not owned, NULL if not recorded)
+	Rewind* history;
 
+	// distance field of travel (not owned, NULL if player doesn't travel)
+	Path* path;
+
+	static bool isPassable(Tile* tile);
+	// tiles all cells of uniform wall and sand chunks point to (never
+	// changed, deleted or placed to cell, writing to cell gives chunk its
+	// own tiles first, see getTileXY())
+	static Tile fillWall;
+	static Tile fillSand;
+
+	static Tile* newTile(char glyph);
+	static unsigned char tileCode(Tile* tile);
+	static Tile* codeTile(unsigned char code);
+	static void parseMeasure(void* parse, int index);
+	static void parseRows(void* parse, int index);
+	static void buildBand(void* build, int index);
+	Tile** cell(int x, int y);
+	int build(char* grid, int width, int height);
+	void reloadCell(int x, int y, char glyph);
+	void putTile(int x, int y, Tile* tile);
+	void crush(int x, int y);
+	void touch(int x, int y);
+	void historyStart();
+	void pathStart();
+	void reachGrow(int x, int y);
+	bool reachSplit(int x, int y);
+	void reachUpdate();
 public:
 	Map();
 	~Map();
 	int load(const char* filename);
+	int load(LevelPack* pack, int level);
+	int reload(const char* filename);
 	int getWidth();
 	int getHeight();
 	int getDiamonds();
+	bool getPlayerXY(int* x, int* y);
 	MAPSTATE getState();
-	Tile* getTileXY(int x, int y);
+	char getFill(int x, int y);
 	void setTileXY(int srcX, int srcY, int dstX, int dstY);
 	bool movePlayer(int xSteps, int ySteps);
 	void doGravity();
+	bool isSettled();
+	void setRules(RuleSet* rules);
+	void moveCreatures();
+	Entities* getEntities();
+	void setRewind(Rewind* history);
+	void record();
+	int rewind(int ticks);
+	void setPath(Path* path);
+	bool travel(int x, int y);
+	bool travelStep();
 	bool findTileType(TILETYPE type, int* x, int* y);
+	bool isReachable(int x, int y);
+	bool exitReachable();
+	int getReachableDiamonds();
+	bool isWinnable();
 	void free();
+	static char* readGrid(const char* filename, int* width, int* height);
+	static bool checkGrid(const char* grid, int width, int height);
+
+	/**
+	 *  Returns pointer to Tile object at coordinates x,y. Cells of uniform
+	 *  wall and sand chunks share one tile of all maps: it must be only
+	 *  read, never changed, deleted or placed to another cell (map gives
+	 *  chunk its own tiles before it changes them, see cell()).
+	 *  \param x            x coordinate
+	 *  \param y            y coordinate
+	 *  \return             pointer to Tile object at x,y (NULL if empty)
+	 */
+	inline Tile* getTileXY(int x, int y)
+	{
+		assert(this->loaded);
+		assert(x >= 0 && this->width > x && y >= 0 && this->height > y);
+
+		int chunk = (y >> MAP_CHUNK_SHIFT) * this->chunksX +
+			(x >> MAP_CHUNK_SHIFT);
+		Tile** cells = this->chunks[chunk];
+
+		if(cells)
+			return cells[(y & (MAP_CHUNK - 1)) << MAP_CHUNK_SHIFT |
+				(x & (MAP_CHUNK - 1))];
+		if(this->fills[chunk] == '#')
+			return &Map::fillWall;
+		if(this->fills[chunk] == '.')
+			return &Map::fillSand;
+		return NULL;
+	}
 };
 
 #endif /* __MAP_H */
@@ -0,0 +1,185 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// mem.cpp: tagged memory accounting
+
+using namespace std;
+
+#include <cstdio>
+#include <cassert>
+#include "mem.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+
+/**
+ *  Counters of tag. Allocations come from pool threads too (tiles of map
+ *  being built), counters are updated atomically. Entry of all tags keeps
+ *  only bytes and peak, its other counters are sums of tags.
+ */
+typedef struct
+{
+	long long bytes;
+	long long peak;
+	long long allocs;
+	long long frees;
+	long long ticked;           // allocs at last memTick()
+	long long tickAllocs;
+} MEMCOUNTERS;
+
+static MEMCOUNTERS counters[MEM_TAGS + 1];  // last one for all tags
+
+static const char* names[MEM_TAGS + 1] =
+{
+	"grid",
+	"tiles",
+	"sprites",
+	"ui",
+	"history",
+	"total"
+};
+
+
+/**
+ *  Raises peak to value if value is higher.
+ *  \param peak         pointer to peak
+ *  \param value        current value
+ */
+static void raisePeak(long long* peak, long long value)
+{
+	long long old;
+
+	while(value > (old = *peak) &&
+		!__sync_bool_compare_and_swap(peak, old, value));
+}
+
+/**
+ *  Accounts allocation (use MEM_ALLOC() macro, it's compiled out without
+ *  MEMSTATS).
+ *  \param tag          subsystem
+ *  \param bytes        allocated bytes
+ */
+void memAlloc(MEMTAG tag, size_t bytes)
+{
+	assert(tag >= 0 && tag < MEM_TAGS);
+
+	MEMCOUNTERS* c = &counters[tag];
+	MEMCOUNTERS* all = &counters[MEM_TAGS];
+
+	raisePeak(&c->peak, __sync_add_and_fetch(&c->bytes, (long long)bytes));
+	raisePeak(&all->peak, __sync_add_and_fetch(&all->bytes, (long long)bytes));
+	__sync_fetch_and_add(&c->allocs, 1);
+}
+
+/**
+ *  Accounts free (use MEM_FREE() macro, it's compiled out without MEMSTATS).
+ *  \param tag          subsystem
+ *  \param bytes        freed bytes (as allocated)
+ */
+void memFree(MEMTAG tag, size_t bytes)
+{
+	assert(tag >= 0 && tag < MEM_TAGS);
+
+	__sync_fetch_and_sub(&counters[tag].bytes, (long long)bytes);
+	__sync_fetch_and_sub(&counters[MEM_TAGS].bytes, (long long)bytes);
+	__sync_fetch_and_add(&counters[tag].frees, 1);
+}
+
+/**
+ *  Marks end of tick: allocations since previous call become allocations of
+ *  last tick (allocation churn of game loop shows there and in trace).
+ */
+void memTick()
+{
+	long long all = 0;
+	int t;
+
+	for(t = 0; t < MEM_TAGS; t++)
+	{
+		long long allocs = counters[t].allocs;
+
+		counters[t].tickAllocs = allocs - counters[t].ticked;
+		counters[t].ticked = allocs;
+		all += counters[t].tickAllocs;
+	}
+	counters[MEM_TAGS].tickAllocs = all;
+	TRACE_COUNTER("allocs", all);
+}
+
+/**
+ *  Returns counters of tag.
+ *  \param tag          subsystem (MEM_TAGS for all of them)
+ *  \param s            pointer to counters (filled in)
+ */
+void memUsage(MEMTAG tag, MEMUSAGE* s)
+{
+	assert(tag >= 0 && tag <= MEM_TAGS);
+	assert(s);
+
+	s->bytes = counters[tag].bytes;
+	s->peak = counters[tag].peak;
+	s->allocs = counters[tag].allocs;
+	s->frees = counters[tag].frees;
+	s->tickAllocs = counters[tag].tickAllocs;
+	if(tag == MEM_TAGS)
+	{
+		int t;
+
+		for(t = 0; t < MEM_TAGS; t++)
+		{
+			s->allocs += counters[t].allocs;
+			s->frees += counters[t].frees;
+		}
+	}
+}
+
+/**
+ *  Writes table of counters of all tags (bytes left at exit are leaks).
+ *  \param file         output file
+ */
+void memReport(FILE* file)
+{
+	MEMUSAGE s;
+	int t;
+
+#ifndef MEMSTATS
+	fprintf(file, "memory: built without MEMSTATS, nothing was counted\n");
+#endif /* MEMSTATS */
+	fprintf(file, "%-8s %12s %12s %10s %10s %6s\n", "memory", "bytes", "peak",
+		"allocs", "frees", "tick");
+	for(t = 0; t <= MEM_TAGS; t++)
+	{
+		memUsage((MEMTAG)t, &s);
+		fprintf(file, "%-8s %12lld %12lld %10lld %10lld %6lld\n", names[t],
+			s.bytes, s.peak, s.allocs, s.frees, s.tickAllocs);
+	}
+}
+
+/**
+ *  Returns name of tag.
+ *  \param tag          subsystem (MEM_TAGS for all of them)
+ *  \return             name
+ */
+const char* memTagName(MEMTAG tag)
+{
+	assert(tag >= 0 && tag <= MEM_TAGS);
+
+	return names[tag];
+}
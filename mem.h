@@ -0,0 +1,102 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// mem.h: tagged memory accounting headers
+
+#ifndef __MEM_H
+#define __MEM_H
+
+#include <cstddef>
+#include <cstdio>
+#include "config.h"
+
+
+/**
+ *  Subsystems memory is accounted to.
+ */
+typedef enum
+{
+	MEM_GRID = 0,               // map chunks, class grid, region, source glyphs
+	MEM_TILES,                  // Tile objects
+	MEM_SPRITES,                // sprite surfaces and XPM parsing
+	MEM_UI,                     // screen and view buffers of UIs
+	MEM_HISTORY,                // rewind history and travel field
+	MEM_TAGS                    // number of tags (all tags in memUsage())
+} MEMTAG;
+
+
+/**
+ *  Counters of one tag (or of all tags).
+ */
+typedef struct
+{
+	long long bytes;            // allocated now
+	long long peak;             // most bytes allocated at once
+	long long allocs;           // allocations ever
+	long long frees;
+	long long tickAllocs;       // allocations during last tick (see memTick())
+} MEMUSAGE;
+
+
+#ifdef MEMSTATS
+/** Memory allocation macro. Accounts allocated bytes to tag.
+ *  \param tag          subsystem (MEMTAG)
+ *  \param bytes        allocated bytes */
+#define MEM_ALLOC(tag, bytes) \
+	memAlloc(tag, bytes)
+/** Memory free macro. Accounts freed bytes to tag.
+ *  \param tag          subsystem (MEMTAG)
+ *  \param bytes        freed bytes (as allocated) */
+#define MEM_FREE(tag, bytes) \
+	memFree(tag, bytes)
+#else
+	#define MEM_ALLOC(tag, bytes) ((void)(tag), (void)(bytes))
+	#define MEM_FREE(tag, bytes) ((void)(tag), (void)(bytes))
+#endif /* MEMSTATS */
+
+/** Array allocation macro. Allocates array and accounts it to tag.
+ *  \param tag          subsystem (MEMTAG)
+ *  \param type         item type
+ *  \param count        number of items */
+#define MEM_NEW(tag, type, count) \
+	(MEM_ALLOC(tag, sizeof(type) * (count)), new type[count])
+/** Array delete macro. Deletes array allocated by MEM_NEW() (NULL is
+ *  ignored).
+ *  \param tag          subsystem (MEMTAG)
+ *  \param array        array
+ *  \param count        number of items (as allocated) */
+#define MEM_DELETE(tag, array, count) \
+do \
+{ \
+	if(array) \
+		MEM_FREE(tag, sizeof(*(array)) * (count)); \
+	delete[] (array); \
+} \
+while(0)
+
+
+void memAlloc(MEMTAG tag, size_t bytes);
+void memFree(MEMTAG tag, size_t bytes);
+void memTick();
+void memUsage(MEMTAG tag, MEMUSAGE* s);
+void memReport(FILE* file);
+const char* memTagName(MEMTAG tag);
+
+
+#endif /* __MEM_H */
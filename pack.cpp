@@ -0,0 +1,388 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// pack.cpp: level pack
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pack.h"
+#include "map.h"
+#include "config.h"
+#include "debug.h"
+
+// longest run of one run length code
+#define PACK_RUN_MAX (0x7f + 3)
+// largest level (cells)
+#define PACK_MAX_CELLS (1 << 28)
+
+
+/**
+ *  Constructor.
+ */
+LevelPack::LevelPack()
+{
+	this->data = NULL;
+	this->size = 0;
+	this->header = NULL;
+	this->index = NULL;
+}
+
+/**
+ *  Destructor.
+ */
+LevelPack::~LevelPack()
+{
+	this->close();
+}
+
+/**
+ *  Maps pack file and checks its header. Levels are not touched.
+ *  \param filename     pack filename
+ *  \return             true if success
+ */
+bool LevelPack::open(const char* filename)
+{
+	struct stat st;
+
+	assert(filename);
+
+	this->close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		error(false, "couldn't open level pack: %s", filename);
+		return false;
+	}
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(PACKHEADER))
+	{
+		error(false, "not a level pack: %s", filename);
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		error(false, "couldn't map level pack: %s", filename);
+		return false;
+	}
+
+	this->data = (const char*)p;
+	this->size = st.st_size;
+	this->header = (const PACKHEADER*)p;
+	this->index = (const PACKENTRY*)(this->header + 1);
+
+	if(this->header->magic != PACK_MAGIC ||
+		this->header->version != PACK_VERSION ||
+		sizeof(PACKHEADER) + (size_t)this->header->count * sizeof(PACKENTRY) >
+		this->size)
+	{
+		error(false, "not a level pack: %s", filename);
+		this->close();
+		return false;
+	}
+
+	debug("level pack opened: %s (%u levels)", filename, this->header->count);
+	return true;
+}
+
+/**
+ *  Returns number of levels.
+ *  \return             number of levels
+ */
+int LevelPack::getCount()
+{
+	assert(this->header);
+	return this->header->count;
+}
+
+/**
+ *  Returns level name.
+ *  \param level        level number (from 0)
+ *  \return             name or NULL if level doesn't exist
+ */
+const char* LevelPack::getName(int level)
+{
+	const PACKENTRY* e = this->entry(level);
+	return e ? e->name : NULL;
+}
+
+/**
+ *  Finds level by name.
+ *  \param name         level name
+ *  \return             level number or -1 if there is no such level
+ */
+int LevelPack::find(const char* name)
+{
+	assert(this->header && name);
+
+	int i;
+	for(i = 0; i < (int)this->header->count; i++)
+		if(!strncmp(this->index[i].name, name, PACK_NAME))
+			return i;
+
+	return -1;
+}
+
+/**
+ *  Returns level size.
+ *  \param level        level number (from 0)
+ *  \param width        pointer to width (filled in)
+ *  \param height       pointer to height (filled in)
+ *  \return             true if level exists
+ */
+bool LevelPack::getSize(int level, int* width, int* height)
+{
+	const PACKENTRY* e = this->entry(level);
+	if(!e)
+		return false;
+
+	*width = e->width;
+	*height = e->height;
+	return true;
+}
+
+/**
+ *  Decompresses level.
+ *  \param level        level number (from 0)
+ *  \param grid         grid of glyphs (width * height from getSize())
+ *  \return             true if success, false if level is corrupted
+ */
+bool LevelPack::unpack(int level, char* grid)
+{
+	const PACKENTRY* e = this->entry(level);
+	if(!e)
+		return false;
+
+	const unsigned char* p = (const unsigned char*)this->data + e->offset;
+	const unsigned char* end = p + e->size;
+	char* out = grid;
+	char* last = grid + (size_t)e->width * e->height;
+
+	while(p < end)
+	{
+		unsigned int c = *p++;
+		size_t run = 1;
+
+		if(c >= 0x80)
+		{
+			if(p == end)
+				break;
+			run = (c & 0x7f) + 3;
+			c = *p++;
+		}
+		if(c >= 0x80 || run > (size_t)(last - out))
+			break;
+		memset(out, c, run);
+		out += run;
+	}
+
+	if(p != end || out != last)
+	{
+		error(false, "level %d of pack is corrupted", level + 1);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ *  Unmaps pack file.
+ */
+void LevelPack::close()
+{
+	if(!this->data)
+		return;
+
+	munmap((void*)this->data, this->size);
+	this->data = NULL;
+	this->size = 0;
+	this->header = NULL;
+	this->index = NULL;
+}
+
+/**
+ *  Creates pack of map files. Maps are checked the same way as by
+ *  Map::load().
+ *  \param filename     pack filename
+ *  \param maps         map filenames
+ *  \param count        number of maps
+ *  \return             true if success
+ */
+bool LevelPack::build(const char* filename, char** maps, int count)
+{
+	assert(filename && maps);
+
+	FILE* f = fopen(filename, "wb");
+	if(!f)
+	{
+		error(false, "couldn't create level pack: %s", filename);
+		return false;
+	}
+
+	PACKHEADER header;
+	PACKENTRY* index = new PACKENTRY[count];
+	memset(&header, 0, sizeof(header));
+	memset(index, 0, count * sizeof(PACKENTRY));
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.count = count;
+
+	// index is written again once offsets are known
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+		fwrite(index, sizeof(PACKENTRY), count, f) == (size_t)count;
+	long long offset = sizeof(header) + (long long)count * sizeof(PACKENTRY);
+	long long cells = 0;
+	int i;
+
+	for(i = 0; ok && i < count; i++)
+	{
+		int width, height;
+		char* grid = Map::readGrid(maps[i], &width, &height);
+		if(!grid)
+		{
+			error(false, "couldn't pack map file: %s", maps[i]);
+			ok = false;
+			break;
+		}
+
+		// payload is never bigger than grid
+		char* payload = new char[(size_t)width * height];
+		size_t size = LevelPack::encode(grid, (size_t)width * height, payload);
+		delete[] grid;
+
+		if(offset + (long long)size > 0xffffffffLL)
+		{
+			error(false, "level pack is too big: %s", filename);
+			ok = false;
+		}
+		else if(fwrite(payload, 1, size, f) != size)
+			ok = false;
+		delete[] payload;
+
+		// name is file name without directory and extension
+		const char* name = strrchr(maps[i], '/');
+		name = name ? name + 1 : maps[i];
+		const char* dot = strrchr(name, '.');
+		size_t len = dot && dot != name ? dot - name : strlen(name);
+		if(len > PACK_NAME - 1)
+			len = PACK_NAME - 1;
+		memcpy(index[i].name, name, len);
+
+		index[i].offset = offset;
+		index[i].size = size;
+		index[i].width = width;
+		index[i].height = height;
+		offset += size;
+		cells += (long long)width * height;
+	}
+
+	if(ok)
+		ok = fseek(f, sizeof(header), SEEK_SET) == 0 &&
+			fwrite(index, sizeof(PACKENTRY), count, f) == (size_t)count;
+	if(fclose(f) != 0)
+		ok = false;
+	delete[] index;
+
+	if(!ok)
+	{
+		error(false, "couldn't write level pack: %s", filename);
+		remove(filename);
+		return false;
+	}
+
+	info("%d levels packed to %s: %lld cells in %lld bytes", count, filename,
+		cells, offset);
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Returns index entry of level after checking it lies within file.
+ *  \param level        level number (from 0)
+ *  \return             entry or NULL if there is no such level
+ */
+const PACKENTRY* LevelPack::entry(int level)
+{
+	assert(this->header);
+
+	if(level < 0 || level >= (int)this->header->count)
+	{
+		error(false, "there is no level %d in pack", level + 1);
+		return NULL;
+	}
+
+	const PACKENTRY* e = this->index + level;
+	if((size_t)e->offset + e->size > this->size || !e->width || !e->height ||
+		(unsigned long long)e->width * e->height > PACK_MAX_CELLS ||
+		e->name[PACK_NAME - 1] != '\0')
+	{
+		error(false, "level %d of pack is corrupted", level + 1);
+		return NULL;
+	}
+
+	return e;
+}
+
+/**
+ *  Compresses grid by run length encoding (see PACKENTRY).
+ *  \param grid         grid of glyphs (all below 0x80)
+ *  \param cells        number of cells
+ *  \param out          output buffer (at least cells bytes)
+ *  \return             number of bytes written
+ */
+size_t LevelPack::encode(const char* grid, size_t cells, char* out)
+{
+	size_t n = 0;
+	size_t i = 0;
+
+	while(i < cells)
+	{
+		size_t run = 1;
+		while(i + run < cells && run < PACK_RUN_MAX && grid[i + run] == grid[i])
+			run++;
+
+		// run of three takes two bytes, shorter runs are cheaper as glyphs
+		if(run >= 3)
+		{
+			out[n++] = (char)(0x80 | (run - 3));
+			out[n++] = grid[i];
+		}
+		else
+		{
+			out[n++] = grid[i];
+			if(run == 2)
+				out[n++] = grid[i];
+		}
+		i += run;
+	}
+
+	return n;
+}
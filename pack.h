@@ -0,0 +1,93 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// pack.h: level pack headers
+
+#ifndef __PACK_H
+#define __PACK_H
+
+#include <cstddef>
+#include "SDL/SDL.h"        // libSDL
+
+// "cdpk" and format version
+#define PACK_MAGIC 0x6b706463
+#define PACK_VERSION 1
+// level name length (including terminating zero)
+#define PACK_NAME 48
+
+
+/**
+ *  Header at start of pack file, followed by index of count entries. All
+ *  fields are 32 bit (host byte order) so layout is the same for 32 and 64
+ *  bit builds.
+ */
+typedef struct
+{
+	Uint32 magic;
+	Uint32 version;
+	Uint32 count;               // number of levels
+	Uint32 reserved;
+} PACKHEADER;
+
+/**
+ *  Index entry of one level. Payload is grid of glyphs (rows padded by
+ *  spaces, as Map::readGrid() returns it) compressed by run length encoding:
+ *  byte below 0x80 is glyph of one cell, byte n >= 0x80 repeats following
+ *  glyph (n & 0x7f) + 3 times. Runs continue across rows.
+ */
+typedef struct
+{
+	Uint32 offset;              // payload offset from start of file
+	Uint32 size;                // payload bytes
+	Uint32 width;
+	Uint32 height;
+	char name[PACK_NAME];       // map file name without directory/extension
+} PACKENTRY;
+
+
+/**
+ *  Read-only level pack. Opening maps file and checks only header, so it
+ *  doesn't depend on number or size of levels. Level is decompressed when
+ *  selected, straight into grid Map builds tiles from.
+ */
+class LevelPack
+{
+private:
+	const char* data;           // mapped file
+	size_t size;
+	const PACKHEADER* header;
+	const PACKENTRY* index;
+
+	const PACKENTRY* entry(int level);
+	static size_t encode(const char* grid, size_t cells, char* out);
+public:
+	LevelPack();
+	~LevelPack();
+	bool open(const char* filename);
+	int getCount();
+	const char* getName(int level);
+	int find(const char* name);
+	bool getSize(int level, int* width, int* height);
+	bool unpack(int level, char* grid);
+	void close();
+	static bool build(const char* filename, char** maps, int count);
+};
+
+
+#endif /* __PACK_H */
@@ -0,0 +1,376 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// path.cpp: travel distance field
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <algorithm> // STL sort
+#include "path.h"
+#include "mem.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+// initial capacity of seeds
+#define PATH_MIN_CAPACITY 64
+
+
+/**
+ *  Constructor. There are no cells until start().
+ */
+Path::Path()
+{
+	this->open = NULL;
+	this->dist = NULL;
+	this->queue = NULL;
+	this->width = 0;
+	this->height = 0;
+	this->target = -1;
+	this->visited = 0;
+
+	this->seeds = NULL;
+	this->seedsCount = 0;
+	this->seedsCapacity = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Path::~Path()
+{
+	this->free();
+}
+
+/**
+ *  Starts field of map of given size with all cells blocked and no target
+ *  (map opens cells by setOpen()).
+ *  \param width        map width
+ *  \param height       map height
+ */
+void Path::start(int width, int height)
+{
+	this->free();
+	this->width = width;
+	this->height = height;
+	this->open = MEM_NEW(MEM_HISTORY, unsigned char, width * height);
+	memset(this->open, 0, width * height);
+}
+
+/**
+ *  Marks cell open or blocked and repairs field around it.
+ *  \param cell         cell index (y * width + x)
+ *  \param open         true if player can walk through cell
+ */
+void Path::setOpen(int cell, bool open)
+{
+	assert(this->open && cell >= 0 && cell < this->width * this->height);
+
+	if(!(this->open[cell] & PATH_OPEN) == !open)
+		return;
+	this->open[cell] = open ? PATH_OPEN : 0;
+
+	// target is where field starts whatever is there
+	if(this->target < 0 || cell == this->target)
+		return;
+	if(open)
+		this->spread(cell);
+	else
+		this->cut(cell);
+}
+
+/**
+ *  Sets travel target and measures whole field from it.
+ *  \param cell         target cell (-1 stops travel)
+ */
+void Path::setTarget(int cell)
+{
+	assert(this->open && cell < this->width * this->height);
+
+	this->target = cell;
+	this->visited = 0;
+	if(cell < 0)
+		return;
+
+	TRACE_SCOPE("Path::setTarget");
+
+	int cells = this->width * this->height;
+	int head = 0, tail = 0;
+	int n[4];
+	int i, k;
+
+	if(!this->dist)
+	{
+		this->dist = MEM_NEW(MEM_HISTORY, int, cells);
+		this->queue = MEM_NEW(MEM_HISTORY, int, cells);
+	}
+	for(i = 0; i < cells; i++)
+		this->dist[i] = PATH_FAR;
+
+	this->dist[cell] = 0;
+	this->queue[tail++] = cell;
+	while(head < tail)
+	{
+		int c = this->queue[head++];
+		int count = this->neighbours(c, n);
+
+		for(k = 0; k < count; k++)
+			if((this->open[n[k]] & PATH_OPEN) &&
+				this->dist[n[k]] == PATH_FAR)
+			{
+				this->dist[n[k]] = this->dist[c] + 1;
+				this->queue[tail++] = n[k];
+			}
+	}
+}
+
+/**
+ *  Returns neighbour of cell one step closer to target.
+ *  \param cell         cell index (y * width + x)
+ *  \return             neighbour or -1 if cell is target or there is no way
+ */
+int Path::next(int cell)
+{
+	int n[4];
+	int k, count;
+
+	if(this->target < 0 || cell == this->target ||
+		this->dist[cell] == PATH_FAR)
+		return -1;
+
+	count = this->neighbours(cell, n);
+	for(k = 0; k < count; k++)
+		if(this->dist[n[k]] == this->dist[cell] - 1)
+			return n[k];
+
+	return -1;
+}
+
+/**
+ *  Frees field.
+ */
+void Path::free()
+{
+	MEM_DELETE(MEM_HISTORY, this->open, this->width * this->height);
+	MEM_DELETE(MEM_HISTORY, this->dist, this->width * this->height);
+	MEM_DELETE(MEM_HISTORY, this->queue, this->width * this->height);
+	MEM_DELETE(MEM_HISTORY, this->seeds, this->seedsCapacity);
+	this->open = NULL;
+	this->dist = NULL;
+	this->queue = NULL;
+	this->seeds = NULL;
+	this->seedsCount = 0;
+	this->seedsCapacity = 0;
+	this->width = 0;
+	this->height = 0;
+	this->target = -1;
+	this->visited = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Fills orthogonal neighbours of cell within map.
+ *  \param cell         cell index (y * width + x)
+ *  \param n            neighbours (filled in, up to 4)
+ *  \return             number of neighbours
+ */
+int Path::neighbours(int cell, int* n)
+{
+	int x = cell % this->width;
+	int count = 0;
+
+	if(x > 0)
+		n[count++] = cell - 1;
+	if(x < this->width - 1)
+		n[count++] = cell + 1;
+	if(cell >= this->width)
+		n[count++] = cell - this->width;
+	if(cell < (this->height - 1) * this->width)
+		n[count++] = cell + this->width;
+
+	return count;
+}
+
+/**
+ *  Returns distance of neighbour of cell closest to target.
+ *  \param cell         cell index (y * width + x)
+ *  \return             distance (PATH_FAR if no neighbour has way)
+ */
+int Path::closest(int cell)
+{
+	int n[4];
+	int k, count = this->neighbours(cell, n);
+	int d = PATH_FAR;
+
+	for(k = 0; k < count; k++)
+		if(this->dist[n[k]] < d)
+			d = this->dist[n[k]];
+
+	return d;
+}
+
+/**
+ *  Spreads shorter distances from cell that was opened (breadth first
+ *  search that stops at cells which are not closer through it).
+ *  \param cell         cell index (y * width + x)
+ */
+void Path::spread(int cell)
+{
+	int d = this->closest(cell);
+	int head = 0, tail = 0;
+	int n[4];
+	int k;
+
+	if(d == PATH_FAR)
+		return;
+
+	this->dist[cell] = d + 1;
+	this->queue[tail++] = cell;
+	while(head < tail)
+	{
+		int c = this->queue[head++];
+		int count = this->neighbours(c, n);
+
+		for(k = 0; k < count; k++)
+			if((this->open[n[k]] & PATH_OPEN) && n[k] != this->target &&
+				this->dist[n[k]] > this->dist[c] + 1)
+			{
+				this->dist[n[k]] = this->dist[c] + 1;
+				this->queue[tail++] = n[k];
+			}
+	}
+	this->visited += tail;
+}
+
+/**
+ *  Repairs field after cell was blocked. Cells are invalidated level by level
+ *  from the cell while they have no neighbour one step closer, then they are
+ *  measured again from the closest of their neighbours that kept their
+ *  distance (seeds sorted by distance merged with breadth first queue, so
+ *  every cell is finished once).
+ *  \param cell         cell index (y * width + x)
+ */
+void Path::cut(int cell)
+{
+	int old = this->dist[cell];
+	int head = 0, tail = 0;
+	int n[4];
+	int i, k, count;
+
+	if(old == PATH_FAR)
+		return;
+	this->dist[cell] = PATH_FAR;
+
+	// invalidate (queue holds one level after another, so closer cells are
+	// decided before cells they could support)
+	this->seedsCount = 0;
+	count = this->neighbours(cell, n);
+	for(k = 0; k < count; k++)
+		if(this->dist[n[k]] == old + 1)
+		{
+			this->open[n[k]] |= PATH_QUEUED;
+			this->queue[tail++] = n[k];
+		}
+	while(head < tail)
+	{
+		int c = this->queue[head++];
+		int d = this->dist[c];
+
+		if(this->closest(c) < d)
+			continue;
+
+		this->dist[c] = PATH_FAR;
+		if(this->seedsCount == this->seedsCapacity)
+		{
+			int capacity = this->seedsCapacity ?
+				this->seedsCapacity * 2 : PATH_MIN_CAPACITY;
+			unsigned long long* bigger = MEM_NEW(MEM_HISTORY,
+				unsigned long long, capacity);
+
+			if(this->seedsCount)
+				memcpy(bigger, this->seeds,
+					sizeof(unsigned long long) * this->seedsCount);
+			MEM_DELETE(MEM_HISTORY, this->seeds, this->seedsCapacity);
+			this->seeds = bigger;
+			this->seedsCapacity = capacity;
+		}
+		this->seeds[this->seedsCount++] = c;
+
+		count = this->neighbours(c, n);
+		for(k = 0; k < count; k++)
+			if(this->dist[n[k]] == d + 1 &&
+				!(this->open[n[k]] & PATH_QUEUED))
+			{
+				this->open[n[k]] |= PATH_QUEUED;
+				this->queue[tail++] = n[k];
+			}
+	}
+	for(i = 0; i < tail; i++)
+		this->open[this->queue[i]] &= ~PATH_QUEUED;
+	this->visited += tail;
+
+	// seeds by distance through their closest neighbour outside
+	int seeds = 0;
+	for(i = 0; i < this->seedsCount; i++)
+	{
+		int c = (int)this->seeds[i];
+		int d = this->closest(c);
+
+		if(d != PATH_FAR)
+			this->seeds[seeds++] = (unsigned long long)(d + 1) << 32 | c;
+	}
+	sort(this->seeds, this->seeds + seeds);
+
+	head = 0;
+	tail = 0;
+	i = 0;
+	while(i < seeds || head < tail)
+	{
+		int c;
+
+		if(i < seeds && (head == tail ||
+			(int)(this->seeds[i] >> 32) <= this->dist[this->queue[head]]))
+		{
+			int d = (int)(this->seeds[i] >> 32);
+
+			c = (int)(this->seeds[i++] & 0xffffffff);
+			if(this->dist[c] <= d)
+				continue;
+			this->dist[c] = d;
+		}
+		else
+			c = this->queue[head++];
+
+		count = this->neighbours(c, n);
+		for(k = 0; k < count; k++)
+			if((this->open[n[k]] & PATH_OPEN) && n[k] != this->target &&
+				this->dist[n[k]] > this->dist[c] + 1)
+			{
+				this->dist[n[k]] = this->dist[c] + 1;
+				this->queue[tail++] = n[k];
+			}
+	}
+	this->visited += tail;
+}
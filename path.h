@@ -0,0 +1,100 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// path.h: travel distance field headers
+
+#ifndef __PATH_H
+#define __PATH_H
+
+// distance of cell with no way to target
+#define PATH_FAR 0x7fffffff
+// flags of cell
+#define PATH_OPEN 1             // player can walk through
+#define PATH_QUEUED 2           // waits in queue of repair
+
+
+/**
+ *  Distance field of map cells to travel target over cells player can walk
+ *  through (see Map::isPassable()), player travels by stepping to neighbour
+ *  one step closer. Map reports every cell that became open or blocked and
+ *  field is repaired around it: opened cell spreads shorter distances as far
+ *  as they are shorter, blocked cell invalidates only cells whose every
+ *  shortest way went through it and those are measured again from their
+ *  border. Only setTarget() searches whole map.
+ */
+class Path
+{
+private:
+	unsigned char* open;        // cells player can walk through (PATH_OPEN)
+	int* dist;                  // steps to target (PATH_FAR if no way)
+	int* queue;                 // cells to visit (one per cell)
+	int width;
+	int height;
+	int target;                 // target cell (-1 if none)
+	int visited;                // cells visited by repairs since setTarget()
+
+	// cells invalidated by blocked cell, by distance from their border
+	unsigned long long* seeds;
+	int seedsCount;
+	int seedsCapacity;
+
+	int neighbours(int cell, int* n);
+	int closest(int cell);
+	void spread(int cell);
+	void cut(int cell);
+public:
+	Path();
+	~Path();
+	void start(int width, int height);
+	void setOpen(int cell, bool open);
+	void setTarget(int cell);
+	int next(int cell);
+	void free();
+
+	/**
+	 *  Returns travel target.
+	 *  \return             target cell (-1 if there is none)
+	 */
+	inline int getTarget()
+	{
+		return this->target;
+	}
+
+	/**
+	 *  Returns steps from cell to target.
+	 *  \param cell         cell index (y * width + x)
+	 *  \return             steps (PATH_FAR if there is no way)
+	 */
+	inline int getDistance(int cell)
+	{
+		return this->target < 0 ? PATH_FAR : this->dist[cell];
+	}
+
+	/**
+	 *  Returns cells visited by repairs since target was set.
+	 *  \return             number of cells
+	 */
+	inline int getVisited()
+	{
+		return this->visited;
+	}
+};
+
+
+#endif /* __PATH_H */
@@ -0,0 +1,69 @@
+###############################################################################
+#   C++dash                                                                   #
+#   Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>                    #
+#   All rights reserved.                                                      #
+#                                                                             #
+#   Redistribution and use in source and binary forms, with or without        #
+#   modification, are permitted provided that the following conditions        #
+#   are met:                                                                  #
+#                                                                             #
+#   1. Redistributions of source code must retain the above copyright         #
+#      notice, this list of conditions and the following disclaimer.          #
+#   2. Redistributions in binary form must reproduce the above copyright      #
+#      notice, this list of conditions and the following disclaimer in the    #
+#      documentation and/or other materials provided with the distribution.   #
+#   3. Neither the name of the University nor the names of its contributors   #
+#      may be used to endorse or promote products derived from this software  #
+#      without specific prior written permission.                             #
+###############################################################################
+
+# pgo.cmake: trains profile-guided optimization of release build
+#
+# Runs instrumented executable (TRAIN) on headless workload covering map
+# loading, gravity, movement, drawing and thread pool, then copies profiles
+# to object directories of release targets.
+#
+# cmake -DTRAIN=cppdash_train -DSOURCE_DIR=.. -DBINARY_DIR=. -P pgo.cmake
+
+SET(PROFILE_DIR "${BINARY_DIR}/CMakeFiles/cppdash_train.dir")
+SET(MAP "${BINARY_DIR}/pgo_map.txt")
+
+# start from clean profiles
+FILE(GLOB PROFILES "${PROFILE_DIR}/*.gcda")
+IF(PROFILES)
+	FILE(REMOVE ${PROFILES})
+ENDIF(PROFILES)
+
+# no window needed
+SET(ENV{SDL_VIDEODRIVER} "dummy")
+
+MACRO(TRAIN_RUN)
+	EXECUTE_PROCESS(
+		COMMAND ${TRAIN} ${ARGN}
+		RESULT_VARIABLE RESULT
+		OUTPUT_QUIET
+		ERROR_QUIET
+	)
+	IF(NOT RESULT EQUAL 0)
+		MESSAGE(FATAL_ERROR "PGO workload failed: ${ARGN}")
+	ENDIF(NOT RESULT EQUAL 0)
+ENDMACRO(TRAIN_RUN)
+
+TRAIN_RUN(--generate -w 128 -h 128 -s 1 --boulders 40 ${MAP})
+TRAIN_RUN(--replay ${SOURCE_DIR}/replay.txt ${MAP})
+TRAIN_RUN(--host -n 500 -r 500 ${MAP})
+TRAIN_RUN(--batch -b 64 -s 500 ${MAP})
+TRAIN_RUN(--validate ${MAP})
+
+FILE(GLOB PROFILES "${PROFILE_DIR}/*.gcda")
+IF(NOT PROFILES)
+	MESSAGE(FATAL_ERROR "PGO workload wrote no profiles")
+ENDIF(NOT PROFILES)
+FOREACH(TARGET cppdash cppdash_bench)
+	FOREACH(PROFILE ${PROFILES})
+		EXECUTE_PROCESS(COMMAND ${CMAKE_COMMAND} -E copy ${PROFILE}
+			"${BINARY_DIR}/CMakeFiles/${TARGET}.dir")
+	ENDFOREACH(PROFILE)
+ENDFOREACH(TARGET)
+
+FILE(WRITE "${BINARY_DIR}/pgo.stamp" "")
@@ -0,0 +1,224 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// pool.cpp: worker thread pool
+
+using namespace std;
+
+#include <cstdio>
+#include <cassert>
+#include <unistd.h>
+#include "pool.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+
+/**
+ *  Constructor. Starts size-1 worker threads (caller of run() is the last
+ *  worker).
+ *  \param size         number of threads working on batch (0 means one per
+ *                      CPU)
+ */
+Pool::Pool(int size)
+{
+	int i;
+
+	if(size <= 0)
+		size = Pool::cpuCount();
+
+	this->size = size;
+	this->batch = 0;
+	this->quit = false;
+	this->job = NULL;
+	this->data = NULL;
+	this->count = 0;
+	this->next = 0;
+	this->pending = 0;
+	this->active = 0;
+
+	this->lock = SDL_CreateMutex();
+	this->wake = SDL_CreateCond();
+	this->idle = SDL_CreateCond();
+	if(!this->lock || !this->wake || !this->idle)
+		error(true, "pool: couldn't create synchronization primitives");
+
+	this->threads = new SDL_Thread* [this->size];
+	for(i = 0; i < this->size - 1; i++)
+	{
+		this->threads[i] = SDL_CreateThread(Pool::worker, this);
+		if(!this->threads[i])
+			error(true, "pool: couldn't create worker thread");
+	}
+	debug("pool: %d threads", this->size);
+}
+
+/**
+ *  Destructor. Stops and joins worker threads.
+ */
+Pool::~Pool()
+{
+	int i;
+
+	SDL_LockMutex(this->lock);
+	this->quit = true;
+	SDL_CondBroadcast(this->wake);
+	SDL_UnlockMutex(this->lock);
+
+	for(i = 0; i < this->size - 1; i++)
+		SDL_WaitThread(this->threads[i], NULL);
+	delete[] this->threads;
+
+	SDL_DestroyCond(this->idle);
+	SDL_DestroyCond(this->wake);
+	SDL_DestroyMutex(this->lock);
+}
+
+/**
+ *  Returns number of threads working on batch (including caller).
+ *  \return             pool size
+ */
+int Pool::getSize()
+{
+	return this->size;
+}
+
+/**
+ *  Runs batch of count jobs and waits until all of them are done. Jobs are
+ *  claimed one by one so uneven jobs balance themselves.
+ *  \param job          job function
+ *  \param data         data passed to each job
+ *  \param count        number of jobs in batch
+ */
+void Pool::run(POOLJOB job, void* data, int count)
+{
+	assert(job);
+
+	if(count <= 0)
+		return;
+	TRACE_SCOPE("Pool::run");
+
+	// nothing to share, don't bother waking anyone
+	if(this->size == 1 || count == 1)
+	{
+		int i;
+		for(i = 0; i < count; i++)
+			job(data, i);
+		return;
+	}
+
+	SDL_LockMutex(this->lock);
+	// late worker may still hold previous batch
+	while(this->active > 0)
+		SDL_CondWait(this->idle, this->lock);
+
+	this->job = job;
+	this->data = data;
+	this->count = count;
+	this->next = 0;
+	this->pending = count;
+	this->batch++;
+	SDL_CondBroadcast(this->wake);
+	SDL_UnlockMutex(this->lock);
+
+	this->work(job, data, count);
+
+	SDL_LockMutex(this->lock);
+	while(this->pending > 0 || this->active > 0)
+		SDL_CondWait(this->idle, this->lock);
+	SDL_UnlockMutex(this->lock);
+}
+
+/**
+ *  Returns number of online CPUs.
+ *  \return             number of CPUs (at least 1)
+ */
+int Pool::cpuCount()
+{
+	long n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+	return n > 0 ? (int)n : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Claims and runs jobs of current batch until there are none left.
+ *  \param job          job function
+ *  \param data         data passed to each job
+ *  \param count        number of jobs in batch
+ */
+void Pool::work(POOLJOB job, void* data, int count)
+{
+	TRACE_SCOPE("Pool::work");
+	int i;
+
+	while((i = __sync_fetch_and_add(&this->next, 1)) < count)
+	{
+		job(data, i);
+
+		if(__sync_sub_and_fetch(&this->pending, 1) == 0)
+		{
+			SDL_LockMutex(this->lock);
+			SDL_CondBroadcast(this->idle);
+			SDL_UnlockMutex(this->lock);
+		}
+	}
+}
+
+/**
+ *  Worker thread main loop. Sleeps until new batch is started.
+ *  \param pool         pointer to Pool
+ *  \return             0
+ */
+int Pool::worker(void* pool)
+{
+	Pool* self = (Pool*)pool;
+	unsigned int seen = 0;
+
+	SDL_LockMutex(self->lock);
+	for(;;)
+	{
+		while(!self->quit && self->batch == seen)
+			SDL_CondWait(self->wake, self->lock);
+		if(self->quit)
+			break;
+
+		// take snapshot of batch and work on it unlocked
+		seen = self->batch;
+		POOLJOB job = self->job;
+		void* data = self->data;
+		int count = self->count;
+		self->active++;
+		SDL_UnlockMutex(self->lock);
+
+		self->work(job, data, count);
+
+		SDL_LockMutex(self->lock);
+		if(--self->active == 0)
+			SDL_CondBroadcast(self->idle);
+	}
+	SDL_UnlockMutex(self->lock);
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// pool.h: worker thread pool headers
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include "SDL/SDL.h"        // libSDL (threads)
+
+
+/**
+ *  Job function run by pool. Receives shared job data and index of job in
+ *  batch (0 to count-1).
+ */
+typedef void (*POOLJOB)(void* data, int index);
+
+
+/**
+ *  Fixed size pool of worker threads. Runs batches of indexed jobs, calling
+ *  thread takes part in batch as well so pool of size 1 has no threads at all.
+ */
+class Pool
+{
+private:
+	SDL_Thread** threads;
+	int size;
+	SDL_mutex* lock;
+	SDL_cond* wake;         // signals new batch (or quit) to workers
+	SDL_cond* idle;         // signals finished batch to caller
+	unsigned int batch;     // batch generation
+	bool quit;
+
+	// current batch
+	POOLJOB job;
+	void* data;
+	int count;
+	volatile int next;      // next unclaimed job index
+	volatile int pending;   // unfinished jobs
+	int active;             // workers inside batch
+
+	static int worker(void* pool);
+	void work(POOLJOB job, void* data, int count);
+public:
+	Pool(int size);
+	~Pool();
+	int getSize();
+	void run(POOLJOB job, void* data, int count);
+	static int cpuCount();
+};
+
+
+#endif /* __POOL_H */
@@ -0,0 +1,383 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// publish.cpp: shared memory frame publishing
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "publish.h"
+#include "map.h"
+#include "tile.h"
+#include "entity.h"
+#include "config.h"
+#include "debug.h"
+
+// largest published grid (cells, 1024x1024), copying bigger one wouldn't fit
+// frame time, such maps publish frames only
+#define PUBLISH_MAX_GRID (1 << 20)
+// slot size granularity (cache line)
+#define PUBLISH_ALIGN 64
+
+
+/**
+ *  Constructor.
+ */
+Publisher::Publisher()
+{
+	this->name = NULL;
+	this->header = NULL;
+	this->size = 0;
+	this->seq = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Publisher::~Publisher()
+{
+	this->close();
+}
+
+/**
+ *  Creates shared memory segment (replacing stale one of the same name).
+ *  \param name         segment name (e.g. "/cppdash")
+ *  \param frameWidth   frame width in pixels
+ *  \param frameHeight  frame height in pixels
+ *  \param gridWidth    map width
+ *  \param gridHeight   map height
+ *  \return             true if success
+ */
+bool Publisher::open(const char* name, int frameWidth, int frameHeight,
+	int gridWidth, int gridHeight)
+{
+	assert(name);
+	assert(frameWidth > 0 && frameHeight > 0);
+
+	this->close();
+
+	if((long long)gridWidth * gridHeight > PUBLISH_MAX_GRID)
+	{
+		warning("map %dx%d is too big, publishing frames only", gridWidth,
+			gridHeight);
+		gridWidth = 0;
+		gridHeight = 0;
+	}
+
+	size_t slotSize = sizeof(PUBLISHSLOT) + (size_t)frameWidth * frameHeight +
+		(size_t)gridWidth * gridHeight;
+	slotSize = (slotSize + PUBLISH_ALIGN - 1) & ~(size_t)(PUBLISH_ALIGN - 1);
+	size_t size = PUBLISH_ALIGN + PUBLISH_SLOTS * slotSize;
+
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if(fd < 0)
+	{
+		error(false, "couldn't create shared memory: %s", name);
+		return false;
+	}
+	if(ftruncate(fd, size) < 0)
+	{
+		error(false, "couldn't resize shared memory: %s", name);
+		::close(fd);
+		shm_unlink(name);
+		return false;
+	}
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		error(false, "couldn't map shared memory: %s", name);
+		shm_unlink(name);
+		return false;
+	}
+
+	this->name = new char[strlen(name) + 1];
+	strcpy(this->name, name);
+	this->header = (PUBLISHHEADER*)p;
+	this->size = size;
+	this->seq = 0;
+
+	// header is complete before readers can recognize it by magic
+	memset(this->header, 0, PUBLISH_ALIGN);
+	this->header->version = PUBLISH_VERSION;
+	this->header->slots = PUBLISH_SLOTS;
+	this->header->slotSize = slotSize;
+	this->header->frameWidth = frameWidth;
+	this->header->frameHeight = frameHeight;
+	this->header->gridWidth = gridWidth;
+	this->header->gridHeight = gridHeight;
+	__sync_synchronize();
+	this->header->magic = PUBLISH_MAGIC;
+
+	info("publishing frames to shared memory %s (%lu bytes)", name,
+		(unsigned long)size);
+	return true;
+}
+
+/**
+ *  Publishes frame and map snapshot to next slot of ring. Never blocks.
+ *  \param map          map
+ *  \param frame        rendered frame (8 bit surface, locked if needed)
+ */
+void Publisher::publish(Map* map, SDL_Surface* frame)
+{
+	assert(map && frame);
+
+	if(!this->header)
+		return;
+
+	Uint32 seq = ++this->seq;
+	PUBLISHSLOT* s = this->slot(seq);
+	int x, y, i;
+
+	s->seq = 2 * seq - 1;
+	__sync_synchronize();
+
+	s->frame = seq;
+	s->state = map->getState();
+	s->diamonds = map->getDiamonds();
+	if(!map->getPlayerXY(&x, &y))
+		x = y = -1;
+	s->playerX = x;
+	s->playerY = y;
+	s->creatures = map->getEntities()->getCount();
+
+	// frame (palette indices)
+	Uint8* pixels = (Uint8*)(s + 1);
+	int width = this->header->frameWidth;
+	int height = this->header->frameHeight;
+	SDL_Palette* palette = frame->format->palette;
+	if(palette && frame->format->BytesPerPixel == 1 &&
+		frame->w >= width && frame->h >= height)
+	{
+		for(i = 0; i < 256; i++)
+			s->palette[i] = i < palette->ncolors ?
+				palette->colors[i].r << 16 | palette->colors[i].g << 8 |
+				palette->colors[i].b : 0;
+		for(y = 0; y < height; y++)
+			memcpy(pixels + y * width,
+				(Uint8*)frame->pixels + y * frame->pitch, width);
+	}
+
+	// grid of glyphs
+	char* grid = (char*)pixels + width * height;
+	width = this->header->gridWidth;
+	height = this->header->gridHeight;
+	if(width && width == map->getWidth() && height == map->getHeight())
+	{
+		// row of uniform chunk (see Map::getFill()) is set at once, only
+		// chunks holding tiles are read cell by cell
+		for(y = 0; y < height; y++)
+			for(x = 0; x < width; x += MAP_CHUNK)
+			{
+				char* row = grid + y * width + x;
+				int n = width - x < MAP_CHUNK ? width - x : MAP_CHUNK;
+				char fill = map->getFill(x, y);
+				if(fill)
+				{
+					memset(row, fill, n);
+					continue;
+				}
+
+				for(i = 0; i < n; i++)
+				{
+					Tile* tile = map->getTileXY(x + i, y);
+					row[i] = tile ? tile->getType() : ' ';
+				}
+			}
+
+		Entities* entities = map->getEntities();
+		for(i = 0; i < entities->getCount(); i++)
+			grid[entities->getY(i) * width + entities->getX(i)] =
+				entities->getType(i);
+	}
+
+	__sync_synchronize();
+	s->seq = 2 * seq;
+	this->header->latest = seq;
+}
+
+/**
+ *  Marks ring closed and removes segment name (readers keep their mapping).
+ */
+void Publisher::close()
+{
+	if(!this->header)
+		return;
+
+	this->header->closed = 1;
+	munmap(this->header, this->size);
+	shm_unlink(this->name);
+	delete[] this->name;
+
+	this->name = NULL;
+	this->header = NULL;
+	this->size = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Returns slot of sequence number.
+ *  \param seq          sequence number
+ *  \return             slot
+ */
+PUBLISHSLOT* Publisher::slot(Uint32 seq)
+{
+	return (PUBLISHSLOT*)((char*)this->header + PUBLISH_ALIGN +
+		(size_t)(seq % this->header->slots) * this->header->slotSize);
+}
+
+// ---------------------------------------------------------------------------
+// Spectator
+// ---------------------------------------------------------------------------
+
+/**
+ *  Constructor.
+ */
+Spectator::Spectator()
+{
+	this->header = NULL;
+	this->size = 0;
+}
+
+/**
+ *  Destructor.
+ */
+Spectator::~Spectator()
+{
+	this->detach();
+}
+
+/**
+ *  Attaches to ring read-only.
+ *  \param name         segment name given to Publisher::open()
+ *  \return             true if success
+ */
+bool Spectator::attach(const char* name)
+{
+	struct stat st;
+
+	this->detach();
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+	{
+		error(false, "couldn't open shared memory: %s", name);
+		return false;
+	}
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < PUBLISH_ALIGN)
+	{
+		error(false, "shared memory is not published by game: %s", name);
+		::close(fd);
+		return false;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		error(false, "couldn't map shared memory: %s", name);
+		return false;
+	}
+
+	this->header = (const PUBLISHHEADER*)p;
+	this->size = st.st_size;
+	__sync_synchronize();
+
+	if(this->header->magic != PUBLISH_MAGIC ||
+		this->header->version != PUBLISH_VERSION ||
+		PUBLISH_ALIGN + (size_t)this->header->slots * this->header->slotSize >
+		this->size)
+	{
+		error(false, "shared memory is not published by game: %s", name);
+		this->detach();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ *  Returns ring header.
+ *  \return             header
+ */
+const PUBLISHHEADER* Spectator::getHeader()
+{
+	assert(this->header);
+	return this->header;
+}
+
+/**
+ *  Returns newest complete slot. Slot is read in place and has to be checked
+ *  by valid() after reading.
+ *  \param seq          pointer to slot sequence (filled in, pass to valid())
+ *  \return             slot or NULL if there is none (or it is being
+ *                      rewritten right now)
+ */
+const PUBLISHSLOT* Spectator::latest(Uint32* seq)
+{
+	assert(this->header);
+
+	Uint32 n = this->header->latest;
+	if(!n)
+		return NULL;
+
+	const PUBLISHSLOT* s = (const PUBLISHSLOT*)((const char*)this->header +
+		PUBLISH_ALIGN + (size_t)(n % this->header->slots) *
+		this->header->slotSize);
+	*seq = s->seq;
+	__sync_synchronize();
+	if(*seq != 2 * n)
+		return NULL;
+
+	return s;
+}
+
+/**
+ *  Checks that slot wasn't overwritten since latest() returned it.
+ *  \param slot         slot
+ *  \param seq          sequence from latest()
+ *  \return             true if everything read from slot is consistent
+ */
+bool Spectator::valid(const PUBLISHSLOT* slot, Uint32 seq)
+{
+	__sync_synchronize();
+	return slot->seq == seq;
+}
+
+/**
+ *  Detaches from ring.
+ */
+void Spectator::detach()
+{
+	if(!this->header)
+		return;
+
+	munmap((void*)this->header, this->size);
+	this->header = NULL;
+	this->size = 0;
+}
@@ -0,0 +1,139 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// publish.h: shared memory frame publishing headers
+
+#ifndef __PUBLISH_H
+#define __PUBLISH_H
+
+#include "SDL/SDL.h"        // libSDL
+
+class Map;                  // map.h
+
+// "cdsh" and layout version checked by readers
+#define PUBLISH_MAGIC 0x68736463
+#define PUBLISH_VERSION 1
+// slots of ring (reader has slots - 1 frames of time to read slot in place)
+#define PUBLISH_SLOTS 4
+
+
+/**
+ *  Header at start of shared memory segment. All fields are 32 bit so
+ *  layout is the same for 32 and 64 bit processes.
+ */
+typedef struct
+{
+	Uint32 magic;
+	Uint32 version;
+	Uint32 slots;
+	Uint32 slotSize;            // bytes of slot including PUBLISHSLOT
+	Uint32 frameWidth;          // frame of 8 bit palette indices
+	Uint32 frameHeight;
+	Uint32 gridWidth;           // grid of map glyphs (0 if not published)
+	Uint32 gridHeight;
+	volatile Uint32 latest;     // sequence number of newest slot (0 none)
+	volatile Uint32 closed;     // non-zero once game is gone
+	Uint32 reserved[6];
+} PUBLISHHEADER;
+
+/**
+ *  Header of one slot, followed by frame (frameWidth * frameHeight bytes)
+ *  and grid (gridWidth * gridHeight glyphs, row by row). Slot of sequence
+ *  number n is n % slots, its seq is 2n - 1 while being written and 2n once
+ *  complete.
+ */
+typedef struct
+{
+	volatile Uint32 seq;
+	Uint32 frame;               // frame number (sequence number)
+	Uint32 state;               // MAPSTATE
+	Uint32 diamonds;            // diamonds left
+	Sint32 playerX;             // -1 if there is no player
+	Sint32 playerY;
+	Uint32 creatures;
+	Uint32 reserved;
+	Uint32 palette[256];        // 0xRRGGBB of frame indices
+} PUBLISHSLOT;
+
+
+/**
+ *  Publishes rendered frames and map snapshots to POSIX shared memory ring
+ *  for external viewers, recorders and analytics. Writer never waits for
+ *  readers: each slot is guarded by sequence number (seqlock) and reader
+ *  checks it did not change while it read slot in place.
+ */
+class Publisher
+{
+private:
+	char* name;
+	PUBLISHHEADER* header;
+	size_t size;
+	Uint32 seq;
+
+	PUBLISHSLOT* slot(Uint32 seq);
+public:
+	Publisher();
+	~Publisher();
+	bool open(const char* name, int frameWidth, int frameHeight,
+		int gridWidth, int gridHeight);
+	void publish(Map* map, SDL_Surface* frame);
+	void close();
+};
+
+/**
+ *  Read-only side of Publisher ring.
+ */
+class Spectator
+{
+private:
+	const PUBLISHHEADER* header;
+	size_t size;
+public:
+	Spectator();
+	~Spectator();
+	bool attach(const char* name);
+	const PUBLISHHEADER* getHeader();
+	const PUBLISHSLOT* latest(Uint32* seq);
+	bool valid(const PUBLISHSLOT* slot, Uint32 seq);
+	void detach();
+
+	/**
+	 *  Returns frame pixels of slot.
+	 *  \param slot         slot
+	 *  \return             frame (frameWidth * frameHeight palette indices)
+	 */
+	inline const Uint8* getFrame(const PUBLISHSLOT* slot)
+	{
+		return (const Uint8*)(slot + 1);
+	}
+
+	/**
+	 *  Returns map grid of slot.
+	 *  \param slot         slot
+	 *  \return             grid (gridWidth * gridHeight glyphs)
+	 */
+	inline const char* getGrid(const PUBLISHSLOT* slot)
+	{
+		return (const char*)(slot + 1) +
+			this->header->frameWidth * this->header->frameHeight;
+	}
+};
+
+
+#endif /* __PUBLISH_H */
@@ -0,0 +1,518 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// rewind.cpp: rewind history
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "rewind.h"
+#include "mem.h"
+#include "config.h"
+#include "debug.h"
+
+// smallest ring and initial capacity of cell and creature arrays
+#define REWIND_MIN_SIZE 64
+#define REWIND_MIN_CAPACITY 64
+
+
+/**
+ *  Constructor.
+ *  \param size         ring bytes (rounded up to power of two)
+ */
+Rewind::Rewind(size_t size)
+{
+	this->size = REWIND_MIN_SIZE;
+	while(this->size < size)
+		this->size *= 2;
+	this->ring = MEM_NEW(MEM_HISTORY, unsigned char, this->size);
+	this->head = 0;
+	this->tail = 0;
+	this->current = 0;
+	this->overflow = false;
+	this->last = 0;
+	this->ticks = 0;
+
+	this->codes = NULL;
+	this->cells = 0;
+	this->diamonds = 0;
+	this->state = 0;
+	this->creatures = 0;
+	this->creaturesCapacity = 0;
+	this->creatureX = NULL;
+	this->creatureY = NULL;
+	this->creatureType = NULL;
+	this->creatureDir = NULL;
+
+	this->touched = NULL;
+	this->touchedCount = 0;
+	this->touchedCapacity = 0;
+	this->restored = NULL;
+	this->restoredCount = 0;
+	this->restoredCapacity = 0;
+	this->restoredCreatures = false;
+}
+
+/**
+ *  Destructor.
+ */
+Rewind::~Rewind()
+{
+	this->free();
+	MEM_DELETE(MEM_HISTORY, this->ring, this->size);
+}
+
+/**
+ *  Forgets history and starts recording map of given state. Codes of cells
+ *  are set by setCode() afterwards.
+ *  \param cells        number of cells
+ *  \param diamonds     number of diamonds
+ *  \param state        map state (MAPSTATE)
+ *  \param entities     creatures
+ */
+void Rewind::start(int cells, int diamonds, int state, Entities* entities)
+{
+	assert(entities);
+
+	this->free();
+
+	this->head = 0;
+	this->tail = 0;
+	this->current = 0;
+	this->overflow = false;
+	this->ticks = 0;
+
+	this->cells = cells;
+	this->codes = MEM_NEW(MEM_HISTORY, unsigned char, cells);
+	memset(this->codes, 0, cells);
+	this->diamonds = diamonds;
+	this->state = state;
+
+	int i;
+	this->reserve(entities->getCount());
+	for(i = 0; i < entities->getCount(); i++)
+	{
+		this->creatureX[i] = entities->getX(i);
+		this->creatureY[i] = entities->getY(i);
+		this->creatureType[i] = entities->getType(i);
+		this->creatureDir[i] = entities->getDir(i);
+	}
+	this->creatures = entities->getCount();
+}
+
+/**
+ *  Sets code of cell without recording it (see start()).
+ *  \param cell         cell index (y * width + x)
+ *  \param code         cell code
+ */
+void Rewind::setCode(int cell, unsigned char code)
+{
+	assert(cell >= 0 && cell < this->cells);
+	assert(!(code & REWIND_TOUCHED));
+
+	this->codes[cell] = code;
+}
+
+/**
+ *  Starts record of tick. Touched cells are passed by putCell() and record
+ *  is finished by end().
+ */
+void Rewind::begin()
+{
+	assert(this->codes);
+
+	this->current = this->head;
+	this->last = 0;
+
+	// length is filled in by end()
+	this->put(0);
+	this->put(0);
+	this->put(0);
+	this->put(0);
+}
+
+/**
+ *  Records cell of tick if its code differs from code at last record.
+ *  \param cell         cell index (y * width + x)
+ *  \param code         code of cell now
+ */
+void Rewind::putCell(int cell, unsigned char code)
+{
+	assert(cell >= 0 && cell < this->cells);
+
+	unsigned char old = this->codes[cell] & ~REWIND_TOUCHED;
+
+	this->codes[cell] = code;
+	if(code == old)
+		return;
+
+	int delta = cell - this->last;
+	this->putNumber((((unsigned int)delta << 1) ^ (delta >> 31)) + 1);
+	this->put(old);
+	this->last = cell;
+}
+
+/**
+ *  Finishes record of tick. Creatures are recorded only if they changed.
+ *  \param diamonds     number of diamonds now
+ *  \param state        map state now (MAPSTATE)
+ *  \param entities     creatures now
+ */
+void Rewind::end(int diamonds, int state, Entities* entities)
+{
+	assert(entities);
+
+	int i, count = entities->getCount();
+
+	this->put(0);
+	this->putNumber(this->diamonds);
+	this->putNumber(this->state);
+	this->diamonds = diamonds;
+	this->state = state;
+
+	bool changed = count != this->creatures;
+	for(i = 0; i < count && !changed; i++)
+		changed = entities->getX(i) != this->creatureX[i] ||
+			entities->getY(i) != this->creatureY[i] ||
+			entities->getType(i) != this->creatureType[i] ||
+			entities->getDir(i) != this->creatureDir[i];
+	if(changed)
+	{
+		this->putNumber(this->creatures + 1);
+		for(i = 0; i < this->creatures; i++)
+		{
+			this->putNumber(this->creatureX[i]);
+			this->putNumber(this->creatureY[i]);
+			this->put(this->creatureType[i]);
+			this->put(this->creatureDir[i]);
+		}
+
+		this->reserve(count);
+		for(i = 0; i < count; i++)
+		{
+			this->creatureX[i] = entities->getX(i);
+			this->creatureY[i] = entities->getY(i);
+			this->creatureType[i] = entities->getType(i);
+			this->creatureDir[i] = entities->getDir(i);
+		}
+		this->creatures = count;
+	}
+	else
+		this->putNumber(0);
+
+	// trailer to find start of record from its end
+	unsigned int length = this->head - this->current + 4;
+	for(i = 0; i < 4; i++)
+		this->put((unsigned char)(length >> (8 * i)));
+
+	this->touchedCount = 0;
+
+	// record bigger than ring, whole history is lost
+	if(this->overflow)
+	{
+		debug("rewind record of %u bytes doesn't fit, history dropped",
+			length);
+		this->head = this->current;
+		this->tail = this->current;
+		this->overflow = false;
+		this->ticks = 0;
+		return;
+	}
+
+	this->putLength(this->current, length);
+	this->ticks++;
+}
+
+/**
+ *  Removes newest record and restores old values it holds. Map then sets
+ *  cells listed by getRestored() to getCode(), creatures (if
+ *  creaturesRestored()) to getCreature() and diamonds and state.
+ *  \return             false if there is no record
+ */
+bool Rewind::back()
+{
+	assert(this->codes);
+	assert(!this->touchedCount);
+
+	if(!this->ticks)
+		return false;
+
+	unsigned int length = this->getLength(this->head - 4);
+	unsigned long long pos = this->head - length + 4;
+	int cell = 0;
+	unsigned int n;
+
+	this->restoredCount = 0;
+	while((n = this->getNumber(&pos)) != 0)
+	{
+		n--;
+		cell += (int)(n >> 1) ^ -(int)(n & 1);
+		assert(cell >= 0 && cell < this->cells);
+		this->codes[cell] = this->ring[pos++ & (this->size - 1)];
+
+		if(this->restoredCount == this->restoredCapacity)
+			this->restored = Rewind::grow(this->restored, this->restoredCount,
+				&this->restoredCapacity);
+		this->restored[this->restoredCount++] = cell;
+	}
+
+	this->diamonds = this->getNumber(&pos);
+	this->state = this->getNumber(&pos);
+
+	n = this->getNumber(&pos);
+	this->restoredCreatures = n != 0;
+	if(n)
+	{
+		int i;
+
+		this->reserve(n - 1);
+		for(i = 0; i < (int)n - 1; i++)
+		{
+			this->creatureX[i] = this->getNumber(&pos);
+			this->creatureY[i] = this->getNumber(&pos);
+			this->creatureType[i] = this->ring[pos++ & (this->size - 1)];
+			this->creatureDir[i] = this->ring[pos++ & (this->size - 1)];
+		}
+		this->creatures = n - 1;
+	}
+
+	this->head -= length;
+	this->ticks--;
+	return true;
+}
+
+/**
+ *  Returns creature as of last record (or as restored by back()).
+ *  \param i            creature index
+ *  \param x            pointer to x coordinate (filled in)
+ *  \param y            pointer to y coordinate (filled in)
+ *  \param dir          pointer to direction (filled in)
+ *  \return             creature type
+ */
+ENTITYTYPE Rewind::getCreature(int i, int* x, int* y, DIRECTION* dir)
+{
+	assert(i >= 0 && i < this->creatures);
+
+	*x = this->creatureX[i];
+	*y = this->creatureY[i];
+	*dir = (DIRECTION)this->creatureDir[i];
+	return (ENTITYTYPE)this->creatureType[i];
+}
+
+/**
+ *  Returns bytes of history in ring.
+ *  \return             bytes
+ */
+size_t Rewind::getBytes()
+{
+	return this->head - this->tail;
+}
+
+/**
+ *  Frees recorded map (history is kept until start()).
+ */
+void Rewind::free()
+{
+	MEM_DELETE(MEM_HISTORY, this->codes, this->cells);
+	MEM_DELETE(MEM_HISTORY, this->creatureX, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureY, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureType, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureDir, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->touched, this->touchedCapacity);
+	MEM_DELETE(MEM_HISTORY, this->restored, this->restoredCapacity);
+
+	this->codes = NULL;
+	this->cells = 0;
+	this->creatures = 0;
+	this->creaturesCapacity = 0;
+	this->creatureX = NULL;
+	this->creatureY = NULL;
+	this->creatureType = NULL;
+	this->creatureDir = NULL;
+	this->touched = NULL;
+	this->touchedCount = 0;
+	this->touchedCapacity = 0;
+	this->restored = NULL;
+	this->restoredCount = 0;
+	this->restoredCapacity = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Appends byte to record, dropping oldest records to make room.
+ *  \param byte         byte
+ */
+void Rewind::put(unsigned char byte)
+{
+	if(this->overflow)
+		return;
+
+	if(this->head - this->tail == this->size)
+	{
+		if(!this->ticks)
+		{
+			this->overflow = true;
+			return;
+		}
+		this->drop();
+	}
+
+	this->ring[this->head++ & (this->size - 1)] = byte;
+}
+
+/**
+ *  Appends variable length number to record.
+ *  \param n            number
+ */
+void Rewind::putNumber(unsigned int n)
+{
+	while(n >= 0x80)
+	{
+		this->put((unsigned char)(n | 0x80));
+		n >>= 7;
+	}
+	this->put((unsigned char)n);
+}
+
+/**
+ *  Reads variable length number.
+ *  \param pos          pointer to ring position (advanced)
+ *  \return             number
+ */
+unsigned int Rewind::getNumber(unsigned long long* pos)
+{
+	unsigned int n = 0;
+	int shift = 0;
+	unsigned char byte;
+
+	do
+	{
+		byte = this->ring[(*pos)++ & (this->size - 1)];
+		n |= (unsigned int)(byte & 0x7f) << shift;
+		shift += 7;
+	}
+	while(byte & 0x80);
+
+	return n;
+}
+
+/**
+ *  Writes record length over space reserved by begin().
+ *  \param pos          ring position
+ *  \param length       record length
+ */
+void Rewind::putLength(unsigned long long pos, unsigned int length)
+{
+	int i;
+
+	for(i = 0; i < 4; i++)
+		this->ring[(pos + i) & (this->size - 1)] =
+			(unsigned char)(length >> (8 * i));
+}
+
+/**
+ *  Reads record length.
+ *  \param pos          ring position
+ *  \return             record length
+ */
+unsigned int Rewind::getLength(unsigned long long pos)
+{
+	unsigned int length = 0;
+	int i;
+
+	for(i = 0; i < 4; i++)
+		length |= (unsigned int)this->ring[(pos + i) & (this->size - 1)] <<
+			(8 * i);
+
+	return length;
+}
+
+/**
+ *  Drops oldest record.
+ */
+void Rewind::drop()
+{
+	assert(this->ticks > 0);
+
+	this->tail += this->getLength(this->tail);
+	this->ticks--;
+}
+
+/**
+ *  Makes room for creatures as of last record.
+ *  \param creatures    number of creatures
+ */
+void Rewind::reserve(int creatures)
+{
+	if(creatures <= this->creaturesCapacity)
+		return;
+
+	int capacity = this->creaturesCapacity ? this->creaturesCapacity :
+		REWIND_MIN_CAPACITY;
+	while(capacity < creatures)
+		capacity *= 2;
+
+	int* x = MEM_NEW(MEM_HISTORY, int, capacity);
+	int* y = MEM_NEW(MEM_HISTORY, int, capacity);
+	unsigned char* type = MEM_NEW(MEM_HISTORY, unsigned char, capacity);
+	unsigned char* dir = MEM_NEW(MEM_HISTORY, unsigned char, capacity);
+
+	if(this->creatures)
+	{
+		memcpy(x, this->creatureX, sizeof(int) * this->creatures);
+		memcpy(y, this->creatureY, sizeof(int) * this->creatures);
+		memcpy(type, this->creatureType, this->creatures);
+		memcpy(dir, this->creatureDir, this->creatures);
+	}
+	MEM_DELETE(MEM_HISTORY, this->creatureX, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureY, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureType, this->creaturesCapacity);
+	MEM_DELETE(MEM_HISTORY, this->creatureDir, this->creaturesCapacity);
+
+	this->creatureX = x;
+	this->creatureY = y;
+	this->creatureType = type;
+	this->creatureDir = dir;
+	this->creaturesCapacity = capacity;
+}
+
+/**
+ *  Doubles capacity of cell array.
+ *  \param array        array (deleted)
+ *  \param count        cells in array
+ *  \param capacity     pointer to capacity (updated)
+ *  \return             new array
+ */
+int* Rewind::grow(int* array, int count, int* capacity)
+{
+	int size = *capacity ? *capacity * 2 : REWIND_MIN_CAPACITY;
+	int* bigger = MEM_NEW(MEM_HISTORY, int, size);
+
+	if(count)
+		memcpy(bigger, array, sizeof(int) * count);
+	MEM_DELETE(MEM_HISTORY, array, *capacity);
+	*capacity = size;
+
+	return bigger;
+}
@@ -0,0 +1,212 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// rewind.h: rewind history headers
+
+#ifndef __REWIND_H
+#define __REWIND_H
+
+#include <cstddef>
+#include "entity.h"
+
+// cell code flag of cell changed since last record
+#define REWIND_TOUCHED 0x80
+
+
+/**
+ *  Bounded history of map ticks for rewinding. Each record holds old values
+ *  of what one tick changed: codes of changed cells (see Map::tileCode()),
+ *  number of diamonds, map state and creatures (only if they changed).
+ *  Rewinding replays records backwards from live map, so no keyframes are
+ *  needed and memory is proportional to changes, not to map size. Records
+ *  are kept in ring of bytes, the oldest are dropped when it's full:
+ *
+ *  [length:4] [(cell delta + 1, old code)...] [0] [diamonds] [state]
+ *  [creatures + 1 or 0 if unchanged] [(x, y, type, dir)...] [length:4]
+ *
+ *  Numbers are variable length (7 bits per byte, low bits first), cell delta
+ *  is difference to previous cell of record (zigzag encoded).
+ */
+class Rewind
+{
+private:
+	unsigned char* ring;
+	size_t size;                // ring bytes (power of two)
+	unsigned long long head;    // end of newest record (bytes ever written)
+	unsigned long long tail;    // start of oldest record
+	unsigned long long current; // start of record being written
+	bool overflow;              // record doesn't fit ring
+	int last;                   // previous cell of record being written
+	int ticks;                  // records in ring
+
+	// map as of last record
+	unsigned char* codes;       // cell codes (REWIND_TOUCHED if in touched)
+	int cells;
+	int diamonds;
+	int state;
+	int creatures;
+	int creaturesCapacity;
+	int* creatureX;
+	int* creatureY;
+	unsigned char* creatureType;
+	unsigned char* creatureDir;
+
+	// cells changed since last record, cells restored by back()
+	int* touched;
+	int touchedCount;
+	int touchedCapacity;
+	int* restored;
+	int restoredCount;
+	int restoredCapacity;
+	bool restoredCreatures;
+
+	void put(unsigned char byte);
+	void putNumber(unsigned int n);
+	unsigned int getNumber(unsigned long long* pos);
+	void putLength(unsigned long long pos, unsigned int length);
+	unsigned int getLength(unsigned long long pos);
+	void drop();
+	void reserve(int creatures);
+	static int* grow(int* array, int count, int* capacity);
+public:
+	Rewind(size_t size);
+	~Rewind();
+	void start(int cells, int diamonds, int state, Entities* entities);
+	void setCode(int cell, unsigned char code);
+	void begin();
+	void putCell(int cell, unsigned char code);
+	void end(int diamonds, int state, Entities* entities);
+	bool back();
+	ENTITYTYPE getCreature(int i, int* x, int* y, DIRECTION* dir);
+	size_t getBytes();
+	void free();
+
+	/**
+	 *  Marks cell changed since last record (map calls it on every change of
+	 *  cell, its code is compared at end of tick).
+	 *  \param cell         cell index (y * width + x)
+	 */
+	inline void touch(int cell)
+	{
+		if(this->codes[cell] & REWIND_TOUCHED)
+			return;
+
+		this->codes[cell] |= REWIND_TOUCHED;
+		if(this->touchedCount == this->touchedCapacity)
+			this->touched = Rewind::grow(this->touched, this->touchedCount,
+				&this->touchedCapacity);
+		this->touched[this->touchedCount++] = cell;
+	}
+
+	/**
+	 *  Returns number of cells changed since last record.
+	 *  \return             number of cells
+	 */
+	inline int getTouched()
+	{
+		return this->touchedCount;
+	}
+
+	/**
+	 *  Returns i-th cell changed since last record.
+	 *  \param i            index (from 0)
+	 *  \return             cell index (y * width + x)
+	 */
+	inline int getTouched(int i)
+	{
+		return this->touched[i];
+	}
+
+	/**
+	 *  Returns number of cells restored by last back().
+	 *  \return             number of cells
+	 */
+	inline int getRestored()
+	{
+		return this->restoredCount;
+	}
+
+	/**
+	 *  Returns i-th cell restored by last back().
+	 *  \param i            index (from 0)
+	 *  \return             cell index (y * width + x)
+	 */
+	inline int getRestored(int i)
+	{
+		return this->restored[i];
+	}
+
+	/**
+	 *  Returns whether last back() restored creatures.
+	 *  \return             true if creatures differ from those before
+	 */
+	inline bool creaturesRestored()
+	{
+		return this->restoredCreatures;
+	}
+
+	/**
+	 *  Returns code of cell as of last record (or as restored by back()).
+	 *  \param cell         cell index (y * width + x)
+	 *  \return             cell code
+	 */
+	inline unsigned char getCode(int cell)
+	{
+		return this->codes[cell] & ~REWIND_TOUCHED;
+	}
+
+	/**
+	 *  Returns number of diamonds as of last record.
+	 *  \return             number of diamonds
+	 */
+	inline int getDiamonds()
+	{
+		return this->diamonds;
+	}
+
+	/**
+	 *  Returns map state as of last record.
+	 *  \return             map state (MAPSTATE)
+	 */
+	inline int getState()
+	{
+		return this->state;
+	}
+
+	/**
+	 *  Returns number of creatures as of last record.
+	 *  \return             number of creatures
+	 */
+	inline int getCreatures()
+	{
+		return this->creatures;
+	}
+
+	/**
+	 *  Returns number of ticks that can be rewound.
+	 *  \return             number of ticks
+	 */
+	inline int getTicks()
+	{
+		return this->ticks;
+	}
+};
+
+
+#endif /* __REWIND_H */
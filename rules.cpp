@@ -0,0 +1,206 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// rules.cpp: table-driven rule engine
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "rules.h"
+#include "tile.h"
+#include "config.h"
+#include "debug.h"
+
+
+// gravity rules of original game
+static const RULE basicRules[] =
+{
+	{ "???  ?*?  ?_?", RULE_FALL },
+	{ "???  ?O?  ?~?", RULE_KILL },
+	{ "???  ?O?  ???", RULE_STOP }
+};
+
+// gravity rules with round objects rolling off other round objects
+static const RULE classicRules[] =
+{
+	{ "???  ?*?  ?_?", RULE_FALL },
+	{ "???  ?O?  ?~?", RULE_KILL },
+	{ "???  _*?  _o?", RULE_ROLL_LEFT },
+	{ "???  ?*_  ?o_", RULE_ROLL_RIGHT },
+	{ "???  ?O?  ???", RULE_STOP }
+};
+
+
+/**
+ *  Constructor. Compiles rules into lookup table.
+ *  \param rules        rules (first matching rule wins)
+ *  \param count        number of rules
+ */
+RuleSet::RuleSet(const RULE* rules, int count)
+{
+	int code, r, falling;
+
+	this->table = new unsigned char[1 << RULES_CODE_BITS];
+	memset(this->table, RULE_NONE, 1 << RULES_CODE_BITS);
+
+	for(code = 0; code < (1 << RULES_CODE_BITS); code++)
+	{
+		// only round objects are subject to rules
+		if(((code >> 8) & 3) != CLASS_ROUND)
+			continue;
+
+		for(falling = 0; falling < 2; falling++)
+			for(r = 0; r < count; r++)
+			{
+				if(!RuleSet::match(rules[r].pattern, code, falling))
+					continue;
+
+				this->table[code] |= rules[r].action << (falling * 4);
+				break;
+			}
+	}
+
+	debug("%d rules compiled", count);
+}
+
+/**
+ *  Destructor.
+ */
+RuleSet::~RuleSet()
+{
+	delete[] this->table;
+}
+
+/**
+ *  Returns rules of game with rolling objects.
+ *  \return             shared rule set
+ */
+RuleSet* RuleSet::classic()
+{
+	static RuleSet rules(classicRules,
+		sizeof(classicRules) / sizeof(classicRules[0]));
+	return &rules;
+}
+
+/**
+ *  Returns rules of original game (objects only fall).
+ *  \return             shared rule set
+ */
+RuleSet* RuleSet::basic()
+{
+	static RuleSet rules(basicRules,
+		sizeof(basicRules) / sizeof(basicRules[0]));
+	return &rules;
+}
+
+/**
+ *  Returns class of tile.
+ *  \param tile         tile (NULL is empty cell)
+ *  \return             cell class
+ */
+CELLCLASS RuleSet::classify(Tile* tile)
+{
+	if(!tile)
+		return CLASS_EMPTY;
+
+	switch(tile->getType())
+	{
+	case TILE_BOULDER:
+	case TILE_DIAMOND:
+		return CLASS_ROUND;
+	case TILE_PLAYER:
+		return CLASS_PLAYER;
+	default:
+		return CLASS_SOLID;
+	}
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Matches neighbourhood against pattern.
+ *  \param pattern      rule pattern (see RULE)
+ *  \param code         neighbourhood code
+ *  \param falling      true if centre object is falling
+ *  \return             true if neighbourhood matches
+ */
+bool RuleSet::match(const char* pattern, int code, bool falling)
+{
+	int i = 0;
+
+	for(; *pattern; pattern++)
+	{
+		if(*pattern == ' ')
+			continue;
+		assert(i < 9);
+
+		// pattern is row by row, code column by column
+		int c = (code >> (2 * ((i % 3) * 3 + i / 3))) & 3;
+		bool ok;
+
+		if(i == 4)
+		{
+			switch(*pattern)
+			{
+			case 'o':
+				ok = c == CLASS_ROUND && !falling;
+				break;
+			case 'O':
+				ok = c == CLASS_ROUND && falling;
+				break;
+			default:
+				ok = c == CLASS_ROUND;
+			}
+		}
+		else
+		{
+			switch(*pattern)
+			{
+			case '_':
+				ok = c == CLASS_EMPTY;
+				break;
+			case 'o':
+				ok = c == CLASS_ROUND;
+				break;
+			case '#':
+				ok = c == CLASS_SOLID;
+				break;
+			case '~':
+				ok = c == CLASS_PLAYER;
+				break;
+			case 'x':
+				ok = c != CLASS_EMPTY;
+				break;
+			default:
+				ok = true;
+			}
+		}
+
+		if(!ok)
+			return false;
+		i++;
+	}
+	assert(i == 9);
+
+	return true;
+}
@@ -0,0 +1,115 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// rules.h: table-driven rule engine headers
+
+#ifndef __RULES_H
+#define __RULES_H
+
+class Tile;     // tile.h
+
+// bits of neighbourhood code (3x3 cells, 2 bits of class each)
+#define RULES_CODE_BITS 18
+
+
+/**
+ *  Cell classes distinguished by rules.
+ */
+typedef enum
+{
+	CLASS_EMPTY     = 0,
+	CLASS_ROUND     = 1,    // boulder, diamond (falls and rolls)
+	CLASS_SOLID     = 2,    // wall, sand, exit, creature, outside of map
+	CLASS_PLAYER    = 3
+} CELLCLASS;
+
+/**
+ *  Actions applied to round object in centre of neighbourhood.
+ */
+typedef enum
+{
+	RULE_NONE       = 0,
+	RULE_FALL,              // move down, start falling
+	RULE_KILL,              // fall on player
+	RULE_STOP,              // stop falling
+	RULE_ROLL_LEFT,         // move left (falls next tick)
+	RULE_ROLL_RIGHT         // move right (falls next tick)
+} RULEACTION;
+
+/**
+ *  Rule declared as neighbourhood pattern. Pattern is 3x3 cells written row
+ *  by row (spaces are ignored), neighbour cells are:
+ *      ?   anything        _   empty           o   round
+ *      #   solid           ~   player          x   anything but empty
+ *  and centre cell is:
+ *      *   round           o   resting round   O   falling round
+ */
+typedef struct
+{
+	const char* pattern;
+	RULEACTION action;
+} RULE;
+
+
+/**
+ *  Set of rules compiled into lookup table indexed by neighbourhood code.
+ *  Code is made of columns (left, centre, right) of 6 bits, column is made of
+ *  classes of top, middle and bottom cell (2 bits each). Each table entry
+ *  holds action for resting centre in low and for falling centre in high
+ *  nibble. First matching rule wins.
+ */
+class RuleSet
+{
+private:
+	unsigned char* table;
+
+	static bool match(const char* pattern, int code, bool falling);
+public:
+	RuleSet(const RULE* rules, int count);
+	~RuleSet();
+	static RuleSet* classic();
+	static RuleSet* basic();
+	static CELLCLASS classify(Tile* tile);
+
+	/**
+	 *  Returns action for neighbourhood.
+	 *  \param code         neighbourhood code
+	 *  \param falling      true if centre object is falling
+	 *  \return             action
+	 */
+	inline RULEACTION lookup(int code, bool falling)
+	{
+		unsigned char a = this->table[code];
+		return (RULEACTION)(falling ? a >> 4 : a & 15);
+	}
+
+	/**
+	 *  Returns code of neighbourhood column.
+	 *  \param cell         pointer to middle cell in class grid
+	 *  \param stride       class grid row length
+	 *  \return             column code (6 bits)
+	 */
+	static inline int column(const unsigned char* cell, int stride)
+	{
+		return cell[-stride] | cell[0] << 2 | cell[stride] << 4;
+	}
+};
+
+
+#endif /* __RULES_H */
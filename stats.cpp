@@ -0,0 +1,320 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// stats.cpp: frame timing statistics
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "stats.h"
+#include "timer.h"
+#include "config.h"
+#include "debug.h"
+
+// frame longer than this is reported as stall (ns)
+#define STATS_STALL 100000000LL
+// period of metrics dump (ns)
+#define STATS_METRICS_PERIOD 1000000000LL
+
+
+static const char* phaseNames[PHASE_COUNT] =
+{
+	"input",
+	"gravity",
+	"draw",
+	"frame"
+};
+
+
+/**
+ *  Constructor.
+ */
+FrameStats::FrameStats()
+{
+	memset(this->histogram, 0, sizeof(this->histogram));
+	memset(this->samples, 0, sizeof(this->samples));
+	this->frames = 0;
+	this->stalls = 0;
+	this->start = timerNow();
+	this->frameStart = 0;
+	this->phaseStart = 0;
+
+	this->metrics = NULL;
+	this->json = false;
+	this->nextMetrics = 0;
+}
+
+/**
+ *  Destructor. Writes last metrics record.
+ */
+FrameStats::~FrameStats()
+{
+	if(this->metrics)
+	{
+		this->writeMetrics(timerNow());
+		fclose(this->metrics);
+	}
+}
+
+/**
+ *  Marks start of new frame. Time since start of previous frame is recorded
+ *  as PHASE_FRAME, metrics are written if period elapsed.
+ */
+void FrameStats::frame()
+{
+	long long now = timerNow();
+
+	if(this->frameStart)
+	{
+		long long ns = now - this->frameStart;
+
+		this->add(PHASE_FRAME, ns);
+		this->frames++;
+		if(ns > STATS_STALL)
+		{
+			this->stalls++;
+			warning("frame %lld stalled for %.1f ms", this->frames, ns / 1e6);
+		}
+	}
+	this->frameStart = now;
+	this->phaseStart = now;
+
+	if(this->metrics && now >= this->nextMetrics)
+		this->writeMetrics(now);
+}
+
+/**
+ *  Marks frame followed by idle wait, time until next frame() is not
+ *  recorded (game sleeping on purpose is not stalled).
+ */
+void FrameStats::pause()
+{
+	this->frameStart = 0;
+}
+
+/**
+ *  Marks end of phase. Phase lasted since frame() or previous mark().
+ *  \param phase        finished phase
+ */
+void FrameStats::mark(STATSPHASE phase)
+{
+	assert(phase >= 0 && phase < PHASE_FRAME);
+
+	long long now = timerNow();
+	this->add(phase, now - this->phaseStart);
+	this->phaseStart = now;
+}
+
+/**
+ *  Summarizes rolling window of phase. Percentiles have precision of
+ *  histogram bucket (about 3%), maximum is exact.
+ *  \param phase        phase
+ *  \param s            pointer to summary (filled in)
+ */
+void FrameStats::summary(STATSPHASE phase, STATSSUMMARY* s)
+{
+	assert(phase >= 0 && phase < PHASE_COUNT);
+
+	int n = this->samples[phase] < STATS_WINDOW ?
+		this->samples[phase] : STATS_WINDOW;
+	int p50 = (n + 1) / 2;
+	int p99 = n - n / 100;
+	int seen = 0;
+	bool median = false;
+	int i;
+
+	memset(s, 0, sizeof(STATSSUMMARY));
+	s->samples = n;
+
+	for(i = 0; i < n; i++)
+		if(s->max < this->window[phase][i])
+			s->max = this->window[phase][i];
+
+	for(i = 0; i < STATS_BUCKETS && seen < p99; i++)
+	{
+		if(!this->histogram[phase][i])
+			continue;
+
+		seen += this->histogram[phase][i];
+		if(seen >= p50 && !median)
+		{
+			s->p50 = FrameStats::bucketValue(i);
+			median = true;
+		}
+		if(seen >= p99)
+			s->p99 = FrameStats::bucketValue(i);
+	}
+}
+
+/**
+ *  Returns number of finished frames.
+ *  \return             number of frames
+ */
+long long FrameStats::getFrames()
+{
+	return this->frames;
+}
+
+/**
+ *  Returns number of frames longer than STATS_STALL.
+ *  \return             number of stalled frames
+ */
+long long FrameStats::getStalls()
+{
+	return this->stalls;
+}
+
+/**
+ *  Opens metrics file. Summary of all phases is appended to it every
+ *  STATS_METRICS_PERIOD, as JSON lines if filename ends with .json, otherwise
+ *  as CSV.
+ *  \param filename     metrics filename
+ *  \return             true if success
+ */
+bool FrameStats::openMetrics(const char* filename)
+{
+	size_t len = strlen(filename);
+	int p;
+
+	if(this->metrics)
+		fclose(this->metrics);
+
+	if(!(this->metrics = fopen(filename, "w")))
+	{
+		error(false, "couldn't create metrics file: %s", filename);
+		return false;
+	}
+	this->json = len > 5 && !strcmp(filename + len - 5, ".json");
+	this->nextMetrics = timerNow() + STATS_METRICS_PERIOD;
+
+	if(!this->json)
+	{
+		fprintf(this->metrics, "time_s,frames,stalls");
+		for(p = 0; p < PHASE_COUNT; p++)
+			fprintf(this->metrics, ",%s_p50_us,%s_p99_us,%s_max_us",
+				phaseNames[p], phaseNames[p], phaseNames[p]);
+		fprintf(this->metrics, "\n");
+	}
+
+	return true;
+}
+
+/**
+ *  Returns name of phase.
+ *  \param phase        phase
+ *  \return             phase name
+ */
+const char* FrameStats::phaseName(STATSPHASE phase)
+{
+	assert(phase >= 0 && phase < PHASE_COUNT);
+	return phaseNames[phase];
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Returns histogram bucket of duration.
+ *  \param ns           duration (ns)
+ *  \return             bucket index
+ */
+int FrameStats::bucket(long long ns)
+{
+	int e = 6;
+
+	if(ns < 64)
+		return ns < 0 ? 0 : (int)ns;
+
+	while(e < 62 && ns >> (e + 1))
+		e++;
+
+	int b = 64 + (e - 6) * 32 + (int)((ns >> (e - 5)) & 31);
+	return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+/**
+ *  Returns lowest duration falling into histogram bucket.
+ *  \param bucket       bucket index
+ *  \return             duration (ns)
+ */
+long long FrameStats::bucketValue(int bucket)
+{
+	if(bucket < 64)
+		return bucket;
+
+	int e = (bucket - 64) / 32 + 6;
+	return (32LL + (bucket - 64) % 32) << (e - 5);
+}
+
+/**
+ *  Adds sample to rolling window of phase replacing oldest one.
+ *  \param phase        phase
+ *  \param ns           duration (ns)
+ */
+void FrameStats::add(STATSPHASE phase, long long ns)
+{
+	int i = this->samples[phase] % STATS_WINDOW;
+
+	if(this->samples[phase] >= STATS_WINDOW)
+		this->histogram[phase][FrameStats::bucket(this->window[phase][i])]--;
+
+	this->window[phase][i] = ns;
+	this->histogram[phase][FrameStats::bucket(ns)]++;
+
+	// keep counter bounded, only position in window matters once full
+	if(++this->samples[phase] == 2 * STATS_WINDOW)
+		this->samples[phase] = STATS_WINDOW;
+}
+
+/**
+ *  Appends summary of all phases to metrics file.
+ *  \param now          current time
+ */
+void FrameStats::writeMetrics(long long now)
+{
+	STATSSUMMARY s;
+	int p;
+
+	if(this->json)
+		fprintf(this->metrics, "{\"time_s\":%.3f,\"frames\":%lld,"
+			"\"stalls\":%lld", (now - this->start) / 1e9, this->frames,
+			this->stalls);
+	else
+		fprintf(this->metrics, "%.3f,%lld,%lld", (now - this->start) / 1e9,
+			this->frames, this->stalls);
+
+	for(p = 0; p < PHASE_COUNT; p++)
+	{
+		this->summary((STATSPHASE)p, &s);
+		if(this->json)
+			fprintf(this->metrics, ",\"%s\":{\"p50_us\":%.1f,\"p99_us\":%.1f,"
+				"\"max_us\":%.1f}", phaseNames[p], s.p50 / 1e3, s.p99 / 1e3,
+				s.max / 1e3);
+		else
+			fprintf(this->metrics, ",%.1f,%.1f,%.1f", s.p50 / 1e3, s.p99 / 1e3,
+				s.max / 1e3);
+	}
+	fprintf(this->metrics, this->json ? "}\n" : "\n");
+	fflush(this->metrics);
+
+	this->nextMetrics = now + STATS_METRICS_PERIOD;
+}
@@ -0,0 +1,97 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// stats.h: frame timing statistics headers
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <cstdio>
+
+// frames kept in rolling window of every phase
+#define STATS_WINDOW 512
+// histogram buckets (exact below 64 ns, then 32 buckets per power of two)
+#define STATS_BUCKETS 1024
+
+
+/**
+ *  Measured phases of main loop.
+ */
+typedef enum
+{
+	PHASE_INPUT = 0,
+	PHASE_GRAVITY,
+	PHASE_DRAW,
+	PHASE_FRAME,                // whole frame (start to start)
+	PHASE_COUNT
+} STATSPHASE;
+
+
+/**
+ *  Summary of rolling window of one phase (ns).
+ */
+typedef struct
+{
+	long long p50;
+	long long p99;
+	long long max;
+	int samples;
+} STATSSUMMARY;
+
+
+/**
+ *  Frame timing statistics. Every phase keeps rolling window of last
+ *  STATS_WINDOW samples together with histogram of the window, so adding
+ *  sample is O(1) and percentiles are read from histogram.
+ */
+class FrameStats
+{
+private:
+	long long window[PHASE_COUNT][STATS_WINDOW];
+	unsigned short histogram[PHASE_COUNT][STATS_BUCKETS];
+	int samples[PHASE_COUNT];
+	long long frames;
+	long long stalls;
+	long long start;
+	long long frameStart;
+	long long phaseStart;
+
+	FILE* metrics;
+	bool json;
+	long long nextMetrics;
+
+	static int bucket(long long ns);
+	static long long bucketValue(int bucket);
+	void add(STATSPHASE phase, long long ns);
+	void writeMetrics(long long now);
+public:
+	FrameStats();
+	~FrameStats();
+	void frame();
+	void pause();
+	void mark(STATSPHASE phase);
+	void summary(STATSPHASE phase, STATSSUMMARY* s);
+	long long getFrames();
+	long long getStalls();
+	bool openMetrics(const char* filename);
+	static const char* phaseName(STATSPHASE phase);
+};
+
+
+#endif /* __STATS_H */
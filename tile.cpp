@@ -23,6 +23,7 @@ using namespace std;
 
 #include <cstdio>
 #include "tile.h"
+#include "mem.h"
 #include "config.h"
 #include "debug.h"
 
@@ -43,6 +44,29 @@ Tile::Tile(TILETYPE type, bool steppable, bool locked)
 	this->setFalling(false);
 }
 
+/**
+ *  Allocates tile (accounted to MEM_TILES).
+ *  \param size             tile size
+ *  \return                 memory of tile
+ */
+void* Tile::operator new(size_t size)
+{
+	MEM_ALLOC(MEM_TILES, size);
+	return ::operator new(size);
+}
+
+/**
+ *  Frees tile.
+ *  \param p                memory of tile
+ *  \param size             tile size
+ */
+void Tile::operator delete(void* p, size_t size)
+{
+	if(p)
+		MEM_FREE(MEM_TILES, size);
+	::operator delete(p);
+}
+
 /**
  *  Sets tile type.
  *  \param type             desired tile type identifier
@@ -22,6 +22,7 @@
 #ifndef __TILE_H
 #define __TILE_H
 
+#include <cstddef>
 
 /**
  *  Enumeration of available tile types.
@@ -52,6 +53,8 @@ protected:
 
 public:
 	Tile(TILETYPE type, bool steppable, bool locked);
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
 	void setType(TILETYPE type);
 	TILETYPE getType();
 	void setSteppable(bool steppable);
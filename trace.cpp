@@ -0,0 +1,223 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// trace.cpp: low overhead tracing
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+// events per thread ring buffer (power of two), older events are overwritten
+#define TRACE_RING_SIZE 65536
+
+
+/**
+ *  Trace event kinds (Chrome trace event phases).
+ */
+typedef enum
+{
+	TRACE_SPAN      = 'X',
+	TRACE_COUNT     = 'C'
+} TRACEKIND;
+
+/**
+ *  Single trace event.
+ */
+typedef struct
+{
+	const char* name;
+	long long ts;           // start time (ns)
+	long long value;        // span duration (ns) or counter value
+	int kind;               // TRACEKIND
+} TRACEEVENT;
+
+/**
+ *  Per thread ring buffer. Written only by its thread, read by traceWrite().
+ *  Buffers are linked into global list and never freed.
+ */
+typedef struct TRACEBUFFER
+{
+	TRACEEVENT events[TRACE_RING_SIZE];
+	volatile unsigned long long head;   // total events written
+	int tid;
+	struct TRACEBUFFER* next;
+} TRACEBUFFER;
+
+
+volatile bool traceEnabled = false;
+
+static TRACEBUFFER* volatile buffers = NULL;
+static __thread TRACEBUFFER* buffer = NULL;
+static int threads = 0;
+static long long epoch = 0;
+
+
+/**
+ *  Returns ring buffer of calling thread, creates and registers it first
+ *  time.
+ *  \return             thread ring buffer
+ */
+static TRACEBUFFER* traceBuffer()
+{
+	if(buffer)
+		return buffer;
+
+	buffer = new TRACEBUFFER;
+	buffer->head = 0;
+	buffer->tid = __sync_add_and_fetch(&threads, 1);
+
+	// lock-free push to list of buffers
+	do
+		buffer->next = buffers;
+	while(!__sync_bool_compare_and_swap(&buffers, buffer->next, buffer));
+
+	return buffer;
+}
+
+/**
+ *  Appends event to ring buffer of calling thread.
+ *  \param kind         event kind
+ *  \param name         event name
+ *  \param ts           event time
+ *  \param value        span duration or counter value
+ */
+static void traceEvent(TRACEKIND kind, const char* name, long long ts,
+	long long value)
+{
+	TRACEBUFFER* b = traceBuffer();
+	TRACEEVENT* e = &b->events[b->head & (TRACE_RING_SIZE - 1)];
+
+	e->name = name;
+	e->ts = ts;
+	e->value = value;
+	e->kind = kind;
+
+	// publish event to reader
+	__atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ *  Starts recording of trace events.
+ */
+void traceStart()
+{
+	if(!epoch)
+		epoch = timerNow();
+	traceEnabled = true;
+	debug("trace: started");
+}
+
+/**
+ *  Stops recording of trace events. Recorded events are kept.
+ */
+void traceStop()
+{
+	traceEnabled = false;
+	debug("trace: stopped");
+}
+
+/**
+ *  Records finished span. Usually called by TraceScope.
+ *  \param name         span name (must live forever, e.g. literal)
+ *  \param start        span start (timerNow())
+ *  \param end          span end (timerNow())
+ */
+void traceSpan(const char* name, long long start, long long end)
+{
+	traceEvent(TRACE_SPAN, name, start, end - start);
+}
+
+/**
+ *  Records counter value.
+ *  \param name         counter name (must live forever, e.g. literal)
+ *  \param value        counter value
+ */
+void traceCounter(const char* name, long long value)
+{
+	if(traceEnabled)
+		traceEvent(TRACE_COUNT, name, timerNow(), value);
+}
+
+/**
+ *  Writes events kept in ring buffers of all threads in Chrome trace event
+ *  JSON format (loads in chrome://tracing and Perfetto). Can be called while
+ *  other threads are still tracing, events overwritten during copying are
+ *  dropped.
+ *  \param filename     output filename
+ *  \return             true if success
+ */
+bool traceWrite(const char* filename)
+{
+	FILE* f = fopen(filename, "w");
+	TRACEBUFFER* b;
+	TRACEEVENT* copy;
+	bool first = true;
+
+	if(!f)
+	{
+		error(false, "couldn't create trace file: %s", filename);
+		return false;
+	}
+
+	copy = new TRACEEVENT[TRACE_RING_SIZE];
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for(b = buffers; b; b = b->next)
+	{
+		unsigned long long head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+		unsigned long long tail = head > TRACE_RING_SIZE ?
+			head - TRACE_RING_SIZE : 0;
+		unsigned long long i;
+
+		for(i = tail; i < head; i++)
+			copy[i - tail] = b->events[i & (TRACE_RING_SIZE - 1)];
+
+		// skip events overwritten by writer while copying (slot of head
+		// itself may be half written)
+		unsigned long long now = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+		if(now >= TRACE_RING_SIZE && now - TRACE_RING_SIZE + 1 > tail)
+			tail = now - TRACE_RING_SIZE + 1;
+
+		for(i = tail; i < head; i++)
+		{
+			TRACEEVENT* e = &copy[i - (head > TRACE_RING_SIZE ?
+				head - TRACE_RING_SIZE : 0)];
+
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,"
+				"\"ts\":%.3f", first ? "" : ",\n", e->name, e->kind, b->tid,
+				(e->ts - epoch) / 1000.0);
+			if(e->kind == TRACE_SPAN)
+				fprintf(f, ",\"dur\":%.3f}", e->value / 1000.0);
+			else
+				fprintf(f, ",\"args\":{\"value\":%lld}}", e->value);
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	delete[] copy;
+	fclose(f);
+
+	debug("trace: written to %s", filename);
+	return true;
+}
@@ -0,0 +1,78 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// trace.h: low overhead tracing headers
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "config.h"
+#include "timer.h"
+
+
+#ifdef TRACE
+/** Trace scope macro. Records span from here to end of enclosing scope.
+ *  \param name         span name (string literal) */
+#define TRACE_SCOPE(name) \
+	TraceScope __trace_scope(name)
+/** Trace counter macro. Records counter value.
+ *  \param name         counter name (string literal)
+ *  \param value        counter value */
+#define TRACE_COUNTER(name, value) \
+	traceCounter(name, value)
+#else
+	#define TRACE_SCOPE(name)
+	#define TRACE_COUNTER(name, value)
+#endif /* TRACE */
+
+
+extern volatile bool traceEnabled;
+
+void traceStart();
+void traceStop();
+bool traceWrite(const char* filename);
+void traceSpan(const char* name, long long start, long long end);
+void traceCounter(const char* name, long long value);
+
+
+/**
+ *  Scoped trace span. Costs one branch while tracing is stopped.
+ */
+class TraceScope
+{
+private:
+	const char* name;
+	long long start;
+
+public:
+	TraceScope(const char* name)
+	{
+		this->name = name;
+		this->start = traceEnabled ? timerNow() : 0;
+	}
+
+	~TraceScope()
+	{
+		if(this->start && traceEnabled)
+			traceSpan(this->name, this->start, timerNow());
+	}
+};
+
+
+#endif /* __TRACE_H */
@@ -37,6 +37,8 @@ typedef enum
 	INPUT_LEFT      = 2,
 	INPUT_RIGHT     = 3,
 	INPUT_QUIT      = 4,
+	INPUT_REWIND    = 5,
+	INPUT_TRAVEL    = 6,    // travel to target (see UI::getTarget())
 
 	INPUT_UNKNOWN   = -1
 } UIINPUT;
@@ -48,8 +50,11 @@ typedef enum
 class UI
 {
 public:
+	virtual ~UI() {};
 	virtual UIINPUT input() { return INPUT_UNKNOWN; };
 	virtual void draw(Map* map) {};
+	virtual bool getTarget(int* x, int* y) { return false; };
+	virtual void wait(unsigned int timeout) {};
 };
 
 
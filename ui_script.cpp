@@ -0,0 +1,145 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// ui_script.cpp: scripted (headless) user interface class
+
+using namespace std;
+
+#include <cstdio>
+#include <cctype>
+#include <cassert>
+#include "ui_script.h"
+#include "config.h"
+#include "debug.h"
+
+
+/**
+ *  Constructor. UI replays given move script.
+ *  \param script       move script (must outlive UI)
+ */
+ScriptUI::ScriptUI(const char* script)
+{
+	assert(script);
+
+	this->script = script;
+	this->next = script;
+	this->seed = 0;
+}
+
+/**
+ *  Constructor. UI moves randomly.
+ *  \param seed         random bot seed
+ */
+ScriptUI::ScriptUI(unsigned int seed)
+{
+	this->script = NULL;
+	this->next = NULL;
+	this->seed = seed;
+}
+
+/**
+ *  Returns next input command from script or random bot.
+ *  \return         input command
+ *  \see UIINPUT
+ */
+UIINPUT ScriptUI::input()
+{
+	// random bot
+	if(!this->script)
+	{
+		this->seed = this->seed * 1103515245 + 12345;
+		switch((this->seed >> 16) % 5)
+		{
+		case 0:
+			return INPUT_UP;
+		case 1:
+			return INPUT_DOWN;
+		case 2:
+			return INPUT_LEFT;
+		case 3:
+			return INPUT_RIGHT;
+		default:
+			return INPUT_UNKNOWN;
+		}
+	}
+
+	// script
+	while(isspace((unsigned char)*this->next))
+		this->next++;
+
+	switch(toupper((unsigned char)*this->next++))
+	{
+	case '\0':
+		this->next--;
+		return INPUT_QUIT;
+	case 'U':
+		return INPUT_UP;
+	case 'D':
+		return INPUT_DOWN;
+	case 'L':
+		return INPUT_LEFT;
+	case 'R':
+		return INPUT_RIGHT;
+	case 'B':
+		return INPUT_REWIND;
+	case 'Q':
+		return INPUT_QUIT;
+	default:
+		return INPUT_UNKNOWN;
+	}
+}
+
+/**
+ *  Draws nothing.
+ *  \param map      map
+ */
+void ScriptUI::draw(Map* map)
+{
+}
+
+/**
+ *  Reads move script file into memory.
+ *  \param filename     script filename
+ *  \return             script (free with delete[]) or NULL for error
+ */
+char* ScriptUI::load(const char* filename)
+{
+	FILE* f = fopen(filename, "rb");
+	char* script;
+	long size;
+
+	if(!f)
+	{
+		error(false, "couldn't open script file: %s", filename);
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(size < 0)
+		size = 0;
+
+	script = new char[size + 1];
+	size = fread(script, 1, size, f);
+	script[size] = '\0';
+	fclose(f);
+
+	return script;
+}
@@ -0,0 +1,50 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// ui_script.h: scripted (headless) user interface class
+
+#ifndef __SCRIPT_UI_H
+#define __SCRIPT_UI_H
+
+#include "ui.h"
+
+
+/**
+ *  Headless UI class. Input is read from move script (one character per
+ *  tick) or generated by random bot, nothing is drawn. Script characters:
+ *  U D L R (move), . (idle), B (rewind), Q (quit), whitespace is skipped.
+ *  End of script means quit.
+ */
+class ScriptUI : public UI
+{
+private:
+	const char* script;     // not owned, can be shared by more UIs
+	const char* next;
+	unsigned int seed;      // random bot state (if no script)
+
+public:
+	ScriptUI(const char* script);
+	ScriptUI(unsigned int seed);
+	UIINPUT input();
+	void draw(Map* map);
+	static char* load(const char* filename);
+};
+
+
+#endif /* __SCRIPT_UI_H */
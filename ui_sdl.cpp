@@ -23,16 +23,51 @@ using namespace std;
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cctype>
 #include <cassert>
 #include <map> // STL map
 #include <string>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 #include "ui_sdl.h"
 #include "map.h"
 #include "tile.h"
+#include "stats.h"
+#include "publish.h"
+#include "capture.h"
+#include "mem.h"
+#include "trace.h"
 #include "config.h"
 #include "debug.h"
 
+// map sprites (columns of first XPM row)
+#define SDLUI_SPRITES 10
+
+/**
+ *  Animation of map sprites by column: frames (from SDLUI_ANIM_ROW on below
+ *  first one), ticks per frame and whether cells sparkle out of step.
+ */
+static const struct
+{
+	int frames;
+	int period;
+	bool stagger;
+} animations[SDLUI_SPRITES] =
+{
+	{ 1, 1, false },        // empty
+	{ 1, 1, false },        // sand
+	{ 1, 1, false },        // wall
+	{ 1, 1, false },        // boulder
+	{ 4, 6, true },         // diamond
+	{ 2, 16, false },       // player
+	{ 1, 1, false },        // locked exit
+	{ 2, 12, false },       // exit
+	{ 1, 1, false },        // firefly
+	{ 1, 1, false }         // butterfly
+};
+
 
 /**
  *  Constructor. Initializes SDL video and input, creates window and loads
@@ -43,19 +78,41 @@ SDLUI::SDLUI()
 	debug("SDL: init");
 
 	// initialize SDL
-	if(SDL_Init(SDL_INIT_VIDEO) < 0)
+	if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0)
 		error(true, "SDL: couldn't initialize SDL");
 
 	// setup window
-	if(!(this->screen = SDL_SetVideoMode(640, 480, 8, SDL_DOUBLEBUF)))
+	if(!(this->screen = SDL_SetVideoMode(SDLUI_WIDTH, SDLUI_HEIGHT, 8,
+		SDL_DOUBLEBUF)))
 	{
 		SDL_Quit();
 		error(true, "SDL: couldn't initialize video surface");
 	}
+	MEM_ALLOC(MEM_UI, this->screen->pitch * this->screen->h);
 	SDL_WM_SetCaption("C++dash", NULL);
 
-	// load sprites
+	// load sprites (map is not zoomed until setZoom())
 	this->sprite = SDLUI::xpmLoad(ui_sdl_xpm);
+	this->tiles = this->sprite ? SDLUI::xpmScale(this->sprite, 1) : NULL;
+	this->fills = this->tiles ?
+		SDLUI::fillsCreate(this->tiles, SDLUI_SPRITE) : NULL;
+	this->size = SDLUI_SPRITE;
+	this->cameraX = 0;
+	this->cameraY = 0;
+
+	// screen keeps its pixels between frames unless pages are flipped
+	this->sprites = NULL;
+	this->drawn = NULL;
+	this->dirty = NULL;
+	this->flipping = (this->screen->flags & SDL_DOUBLEBUF) != 0;
+	this->viewCreate();
+
+	this->waited = false;
+	this->travelX = -1;
+	this->travelY = -1;
+	this->stats = NULL;
+	this->publisher = NULL;
+	this->capture = NULL;
 }
 
 /**
@@ -66,71 +123,227 @@ SDLUI::~SDLUI()
 	debug("SDL: exit");
 
 	// free surfaces
-	if(this->sprite)
-		SDL_FreeSurface(this->sprite);
+	SDLUI::spritesFree(this->sprite);
+	SDLUI::spritesFree(this->tiles);
+	SDLUI::spritesFree(this->fills);
 	if(this->screen)
+	{
+		MEM_FREE(MEM_UI, this->screen->pitch * this->screen->h);
 		SDL_FreeSurface(this->screen);
+	}
+	this->viewFree();
 
 	SDL_Quit();
 }
 
 /**
- *  Draw entire map to screen surface.
+ *  Draw map to screen surface. Whole view is drawn once camera moves (or
+ *  screen is page flipped), otherwise only cells whose sprite changed and
+ *  animated cells whose frame came are redrawn and updated on screen.
  *  \see Tile
  */
 void SDLUI::draw(Map* map)
 {
 	assert(this->screen);
 	assert(map);
+	TRACE_SCOPE("SDLUI::draw");
 
-	int x, y;
-	Tile* tile = NULL;
+	int x, y, i;
+	int cx, cy;
+	int dirty = 0;
 
-	// blank screen
-	SDL_FillRect(screen, &screen->clip_rect, SDL_MapRGB(screen->format, 0, 0, 0));
+	// camera follows player (stays where it was while there is none), map
+	// smaller than screen stays in top left corner
+	int size = this->size;
+	int width = map->getWidth();
+	int height = map->getHeight();
+	if(map->getPlayerXY(&x, &y))
+	{
+		this->cameraX = x * size + size / 2 - this->screen->w / 2;
+		this->cameraY = y * size + size / 2 - this->screen->h / 2;
+	}
+	if(this->cameraX > width * size - this->screen->w)
+		this->cameraX = width * size - this->screen->w;
+	if(this->cameraY > height * size - this->screen->h)
+		this->cameraY = height * size - this->screen->h;
+	if(this->cameraX < 0)
+		this->cameraX = 0;
+	if(this->cameraY < 0)
+		this->cameraY = 0;
 
-	// FIXME dirty bunch of code. Scrolling will need not-so-tied coordinates.
-	// As long as scrolling isn't supported this will work perfectly.
+	// visible cells
+	int x0 = this->cameraX / size;
+	int y0 = this->cameraY / size;
+	int x1 = (this->cameraX + this->screen->w + size - 1) / size;
+	int y1 = (this->cameraY + this->screen->h + size - 1) / size;
+	if(x1 > width)
+		x1 = width;
+	if(y1 > height)
+		y1 = height;
 
-	// draw map tiles
-	for(y = 0; y < map->getHeight(); y++)
-		for(x = 0; x < map->getWidth(); x++)
-		{
-			tile = map->getTileXY(x, y);
+	this->viewSprites(map, x0, y0, x1, y1);
 
-			if(!tile)
-				continue; // empty tile
+	// cells whose frame comes on this tick are drawn again
+	int changed = this->animator.advance();
+	for(i = 0; i < changed; i++)
+		this->drawn[this->animator.getChanged(i)] = 0xff;
 
-			switch(tile->getType())
+	if(this->flipping || this->cameraX != this->drawnX ||
+		this->cameraY != this->drawnY || width != this->drawnWidth ||
+		height != this->drawnHeight)
+	{
+		// blank screen
+		SDL_FillRect(screen, &screen->clip_rect,
+			SDL_MapRGB(screen->format, 0, 0, 0));
+		this->animator.clear();
+
+		// draw visible map tiles chunk by chunk, uniform chunk is skipped
+		// (empty) or drawn by single blit (walls, sand)
+		for(cy = y0 & ~(MAP_CHUNK - 1); cy < y1; cy += MAP_CHUNK)
+			for(cx = x0 & ~(MAP_CHUNK - 1); cx < x1; cx += MAP_CHUNK)
 			{
-			case TILE_SAND:
-				this->drawSprite(1, 0, x * 16, y * 16);
-				break;
-			case TILE_WALL:
-				this->drawSprite(2, 0, x * 16, y * 16);
-				break;
-			case TILE_BOULDER:
-				this->drawSprite(3, 0, x * 16, y * 16);
-				break;
-			case TILE_DIAMOND:
-				this->drawSprite(4, 0, x * 16, y * 16);
-				break;
-			case TILE_PLAYER:
-				this->drawSprite(5, 0, x * 16, y * 16);
-				break;
-			case TILE_EXIT:
-				if(tile->isLocked())
-					// locked door
-					this->drawSprite(6, 0, x * 16, y * 16);
-				else
-					// unlocked door
-					this->drawSprite(7, 0, x * 16, y * 16);
-				break;
+				char fill = map->getFill(cx, cy);
+				if(fill == ' ')
+					continue;
+				if(fill)
+				{
+					this->drawFill(fill == '#' ? 1 : 0,
+						cx * size - this->cameraX, cy * size - this->cameraY,
+						(width - cx < MAP_CHUNK ? width - cx : MAP_CHUNK) * size,
+						(height - cy < MAP_CHUNK ? height - cy : MAP_CHUNK) *
+						size);
+					continue;
+				}
+
+				for(y = cy > y0 ? cy : y0; y < cy + MAP_CHUNK && y < y1; y++)
+					for(x = cx > x0 ? cx : x0; x < cx + MAP_CHUNK && x < x1; x++)
+					{
+						int cell = (y - y0) * this->viewWidth + x - x0;
+						if(this->sprites[cell])
+							this->drawCell(x, y, cell, NULL);
+					}
 			}
+
+		// draw visible creatures
+		Entities* entities = map->getEntities();
+		for(i = 0; i < entities->getCount(); i++)
+		{
+			x = entities->getX(i);
+			y = entities->getY(i);
+			if(x < x0 || x >= x1 || y < y0 || y >= y1)
+				continue;
+			this->drawCell(x, y, (y - y0) * this->viewWidth + x - x0, NULL);
 		}
 
-	// flip buffers
-	SDL_Flip(this->screen);
+		memcpy(this->drawn, this->sprites, this->viewWidth * this->viewHeight);
+		this->drawnX = this->cameraX;
+		this->drawnY = this->cameraY;
+		this->drawnWidth = width;
+		this->drawnHeight = height;
+		dirty = -1;
+	}
+	else
+	{
+		// redraw changed cells only
+		for(y = y0; y < y1; y++)
+		{
+			int cell = (y - y0) * this->viewWidth;
+			for(x = x0; x < x1; x++, cell++)
+			{
+				if(this->sprites[cell] == this->drawn[cell])
+					continue;
+				this->drawCell(x, y, cell, &this->dirty[dirty++]);
+				this->drawn[cell] = this->sprites[cell];
+			}
+		}
+	}
+
+	if(this->stats)
+		this->drawHud(dirty < 0 ? NULL : &this->dirty[dirty++]);
+
+	// hand frame to sinks before it is flipped away
+	if(this->publisher || this->capture)
+	{
+		if(SDL_MUSTLOCK(this->screen))
+			SDL_LockSurface(this->screen);
+		if(this->publisher)
+			this->publisher->publish(map, this->screen);
+		if(this->capture)
+			this->capture->frame(this->screen);
+		if(SDL_MUSTLOCK(this->screen))
+			SDL_UnlockSurface(this->screen);
+	}
+
+	// flip buffers or update redrawn rects
+	if(dirty < 0)
+		SDL_Flip(this->screen);
+	else if(dirty)
+		SDL_UpdateRects(this->screen, dirty, this->dirty);
+}
+
+/**
+ *  Sets zoom of map. Sprites are scaled once here, frames are then drawn by
+ *  plain blits of scaled sprites and camera follows player. HUD is not
+ *  zoomed.
+ *  \param zoom     integer zoom (1 to SDLUI_MAX_ZOOM)
+ *  \return         true if success (otherwise zoom is kept)
+ */
+bool SDLUI::setZoom(int zoom)
+{
+	if(zoom < 1 || zoom > SDLUI_MAX_ZOOM)
+	{
+		error(false, "SDL: zoom must be 1 to %d", SDLUI_MAX_ZOOM);
+		return false;
+	}
+	if(!this->sprite)
+		return false;
+
+	SDL_Surface* tiles = SDLUI::xpmScale(this->sprite, zoom);
+	SDL_Surface* fills = tiles ?
+		SDLUI::fillsCreate(tiles, SDLUI_SPRITE * zoom) : NULL;
+	if(!fills)
+	{
+		SDLUI::spritesFree(tiles);
+		error(false, "SDL: couldn't scale sprites");
+		return false;
+	}
+
+	SDLUI::spritesFree(this->tiles);
+	SDLUI::spritesFree(this->fills);
+	this->tiles = tiles;
+	this->fills = fills;
+	this->size = SDLUI_SPRITE * zoom;
+	this->viewCreate();
+
+	debug("SDL: zoom %dx", zoom);
+	return true;
+}
+
+/**
+ *  Turns frame timing overlay on or off.
+ *  \param stats        frame statistics to show (NULL turns overlay off)
+ */
+void SDLUI::setHud(FrameStats* stats)
+{
+	this->stats = stats;
+}
+
+/**
+ *  Turns publishing of drawn frames on or off.
+ *  \param publisher    open publisher (NULL turns publishing off)
+ */
+void SDLUI::setPublisher(Publisher* publisher)
+{
+	this->publisher = publisher;
+}
+
+/**
+ *  Turns video capture of drawn frames on or off.
+ *  \param capture      open capture (NULL turns capture off)
+ */
+void SDLUI::setCapture(Capture* capture)
+{
+	this->capture = capture;
 }
 
 /**
@@ -142,8 +355,10 @@ UIINPUT SDLUI::input()
 {
 	UIINPUT r = INPUT_UNKNOWN;
 
-	while(SDL_PollEvent(&this->event))
+	// event that woke wait() comes first
+	while(this->waited || SDL_PollEvent(&this->event))
 	{
+		this->waited = false;
 		switch(this->event.type)
 		{
 		// non-keyboard events
@@ -152,6 +367,18 @@ UIINPUT SDLUI::input()
 			r = INPUT_QUIT;
 			break;
 
+		// mouse events (click sends player to map cell under pointer)
+		case SDL_MOUSEBUTTONDOWN:
+			if(this->event.button.button != SDL_BUTTON_LEFT)
+				break;
+			this->travelX = (this->event.button.x + this->cameraX) /
+				this->size;
+			this->travelY = (this->event.button.y + this->cameraY) /
+				this->size;
+			debug("SDL: click at %d,%d", this->travelX, this->travelY);
+			r = INPUT_TRAVEL;
+			break;
+
 		// keyboard events
 		case SDL_KEYDOWN:
 			debug("SDL: SDL_KEYDOWN event (%x)", this->event.key.keysym.scancode);
@@ -188,15 +415,168 @@ UIINPUT SDLUI::input()
 		}
 	}
 
+	// rewinding goes on while backspace is held
+	if(r == INPUT_UNKNOWN && SDL_GetKeyState(NULL)[SDLK_BACKSPACE])
+		r = INPUT_REWIND;
+
 	return r;
 }
 
+/**
+ *  Returns map cell clicked last (target of INPUT_TRAVEL).
+ *  \param x            pointer to x coordinate (filled in)
+ *  \param y            pointer to y coordinate (filled in)
+ *  \return             false if nothing was clicked yet
+ */
+bool SDLUI::getTarget(int* x, int* y)
+{
+	if(this->travelX < 0)
+		return false;
+
+	*x = this->travelX;
+	*y = this->travelY;
+	return true;
+}
+
+/**
+ *  Sleeps until next event arrives, so game with nothing to do doesn't spin.
+ *  Event is left for next input().
+ *  \param timeout      milliseconds after which timer wakes anyway (0 waits
+ *                      for event only)
+ */
+void SDLUI::wait(unsigned int timeout)
+{
+	SDL_TimerID timer = timeout ?
+		SDL_AddTimer(timeout, SDLUI::wake, NULL) : NULL;
+
+	if(SDL_WaitEvent(&this->event))
+		this->waited = true;
+	// timer that fired already left event in queue, input() ignores it
+	if(timer)
+		SDL_RemoveTimer(timer);
+}
+
 // ---------------------------------------------------------------------------
 // Private methods
 // ---------------------------------------------------------------------------
 
 /**
- *  Draw sprite to specified coords on screen.
+ *  Allocates view cells for current tile size, whole view is drawn by next
+ *  frame.
+ */
+void SDLUI::viewCreate()
+{
+	this->viewFree();
+
+	this->viewWidth = this->screen->w / this->size + 2;
+	this->viewHeight = this->screen->h / this->size + 2;
+	int cells = this->viewWidth * this->viewHeight;
+	this->sprites = MEM_NEW(MEM_UI, unsigned char, cells);
+	this->drawn = MEM_NEW(MEM_UI, unsigned char, cells);
+	this->dirty = MEM_NEW(MEM_UI, SDL_Rect, cells + 1);  // cells and HUD
+	this->drawnX = 0;
+	this->drawnY = 0;
+	this->drawnWidth = 0;
+	this->drawnHeight = 0;
+	this->animator.resize(cells);
+}
+
+/**
+ *  Frees view cells.
+ */
+void SDLUI::viewFree()
+{
+	MEM_DELETE(MEM_UI, this->sprites, this->viewWidth * this->viewHeight);
+	MEM_DELETE(MEM_UI, this->drawn, this->viewWidth * this->viewHeight);
+	MEM_DELETE(MEM_UI, this->dirty, this->viewWidth * this->viewHeight + 1);
+	this->sprites = NULL;
+	this->drawn = NULL;
+	this->dirty = NULL;
+}
+
+/**
+ *  Fill sprites of visible cells (view cell of x0, y0 is 0), creatures are
+ *  over their cells.
+ *  \param map      map
+ *  \param x0       first visible column
+ *  \param y0       first visible row
+ *  \param x1       column after last visible one
+ *  \param y1       row after last visible one
+ */
+void SDLUI::viewSprites(Map* map, int x0, int y0, int x1, int y1)
+{
+	int x, y, i;
+
+	for(y = y0; y < y1; y++)
+	{
+		unsigned char* row = this->sprites + (y - y0) * this->viewWidth;
+		for(x = x0; x < x1; x++)
+			row[x - x0] = SDLUI::tileSprite(map->getTileXY(x, y));
+	}
+
+	Entities* entities = map->getEntities();
+	for(i = 0; i < entities->getCount(); i++)
+	{
+		x = entities->getX(i);
+		y = entities->getY(i);
+		if(x < x0 || x >= x1 || y < y0 || y >= y1)
+			continue;
+		this->sprites[(y - y0) * this->viewWidth + x - x0] =
+			entities->getType(i) == ENTITY_FIREFLY ? 8 : 9;
+	}
+}
+
+/**
+ *  Draw sprite of view cell in its current animation frame (animation of
+ *  cell starts here).
+ *  \param x        map X coord
+ *  \param y        map Y coord
+ *  \param cell     view cell
+ *  \param rect     pointer to rect of cell on screen (filled in, may be NULL)
+ */
+void SDLUI::drawCell(int x, int y, int cell, SDL_Rect* rect)
+{
+	int sprite = this->sprites[cell];
+	int sx = x * this->size - this->cameraX;
+	int sy = y * this->size - this->cameraY;
+
+	if(rect)
+	{
+		// clipped to screen (SDL_UpdateRects() doesn't clip)
+		rect->x = sx < 0 ? 0 : sx;
+		rect->y = sy < 0 ? 0 : sy;
+		rect->w = (sx + this->size > this->screen->w ?
+			this->screen->w : sx + this->size) - rect->x;
+		rect->h = (sy + this->size > this->screen->h ?
+			this->screen->h : sy + this->size) - rect->y;
+	}
+
+	// empty (or transparent) pixels of cell are blank
+	if(!sprite || this->tiles->flags & SDL_SRCCOLORKEY)
+	{
+		SDL_Rect blank;
+
+		blank.x = sx;
+		blank.y = sy;
+		blank.w = this->size;
+		blank.h = this->size;
+		SDL_FillRect(this->screen, &blank,
+			SDL_MapRGB(this->screen->format, 0, 0, 0));
+	}
+	if(!sprite)
+	{
+		this->animator.remove(cell);
+		return;
+	}
+
+	int frame = this->animator.add(cell, animations[sprite].frames,
+		animations[sprite].period,
+		animations[sprite].stagger ? x * 7 + y * 3 : 0);
+	this->drawSprite(sprite, frame ? SDLUI_ANIM_ROW + frame - 1 : 0, sx, sy);
+}
+
+/**
+ *  Draw map sprite (zoomed) to specified coords on screen.
  *  \param spriteX  sprite X in 16x16 grid (0ish indexing)
  *  \param spriteY  sprite Y in 16x16 grid (0ish indexing)
  *  \param x        destination sprite absolute X coord
@@ -205,23 +585,310 @@ UIINPUT SDLUI::input()
  */
 void SDLUI::drawSprite(int spriteX, int spriteY, int x, int y)
 {
-	assert(this->sprite && this->screen);
+	assert(this->tiles && this->screen);
 
 	SDL_Rect clip, offset;
 
 	// clipping
-	clip.x = spriteX * 16;
-	clip.y = spriteY * 16;
-	clip.w = 16;
-	clip.h = 16;
+	clip.x = spriteX * this->size;
+	clip.y = spriteY * this->size;
+	clip.w = this->size;
+	clip.h = this->size;
 
 	// offset
 	offset.x = x;
 	offset.y = y;
 
+	SDL_BlitSurface(this->tiles, &clip, this->screen, &offset);
+}
+
+/**
+ *  Draw sprite as loaded (not zoomed, e.g. font of HUD) to specified coords
+ *  on screen.
+ *  \param spriteX  sprite X in 16x16 grid (0ish indexing)
+ *  \param spriteY  sprite Y in 16x16 grid (0ish indexing)
+ *  \param x        destination sprite absolute X coord
+ *  \param y        destination sprite absolute Y coord
+ */
+void SDLUI::drawGlyph(int spriteX, int spriteY, int x, int y)
+{
+	assert(this->sprite && this->screen);
+
+	SDL_Rect clip, offset;
+
+	clip.x = spriteX * SDLUI_SPRITE;
+	clip.y = spriteY * SDLUI_SPRITE;
+	clip.w = SDLUI_SPRITE;
+	clip.h = SDLUI_SPRITE;
+	offset.x = x;
+	offset.y = y;
+
 	SDL_BlitSurface(this->sprite, &clip, this->screen, &offset);
 }
 
+/**
+ *  Draw uniform map chunk (see Map::getFill()) by single blit.
+ *  \param fill     0 for sand, 1 for walls
+ *  \param x        destination absolute X coord
+ *  \param y        destination absolute Y coord
+ *  \param w        width (chunk at map edge is narrower)
+ *  \param h        height
+ */
+void SDLUI::drawFill(int fill, int x, int y, int w, int h)
+{
+	assert(this->fills && this->screen);
+
+	SDL_Rect clip, offset;
+
+	clip.x = fill * MAP_CHUNK * this->size;
+	clip.y = 0;
+	clip.w = w;
+	clip.h = h;
+	offset.x = x;
+	offset.y = y;
+
+	SDL_BlitSurface(this->fills, &clip, this->screen, &offset);
+}
+
+/**
+ *  Draw text using font sprites (letters and digits only, other characters
+ *  are left blank).
+ *  \param text     text
+ *  \param x        destination absolute X coord of first character
+ *  \param y        destination absolute Y coord
+ */
+void SDLUI::drawText(const char* text, int x, int y)
+{
+	for(; *text; text++, x += 16)
+	{
+		int c = toupper((unsigned char)*text);
+
+		if(c >= 'A' && c <= 'P')
+			this->drawGlyph(c - 'A', 1, x, y);
+		else if(c >= 'Q' && c <= 'Z')
+			this->drawGlyph(c - 'Q', 2, x, y);
+		else if(c >= '0' && c <= '9')
+			this->drawGlyph(c - '0', 3, x, y);
+	}
+}
+
+/**
+ *  Draw frame timing overlay (rolling p50, p99 and max of every phase in
+ *  microseconds, allocated memory and allocations of last tick) to top left
+ *  corner of screen.
+ *  \param rect     pointer to rect of overlay (filled in, may be NULL)
+ */
+void SDLUI::drawHud(SDL_Rect* rect)
+{
+	assert(this->stats);
+
+	STATSSUMMARY s;
+	MEMUSAGE m;
+	SDL_Rect area;
+	char line[64];
+	int p;
+
+	area.x = 0;
+	area.y = 0;
+	area.w = 25 * 16;
+	area.h = (PHASE_COUNT + 3) * 16;
+	if(rect)
+		*rect = area;
+	SDL_FillRect(this->screen, &area, SDL_MapRGB(this->screen->format, 0, 0, 0));
+
+	this->stats->summary(PHASE_FRAME, &s);
+	snprintf(line, sizeof(line), "FPS %lld", s.p50 ? 1000000000LL / s.p50 : 0);
+	this->drawText(line, 0, 0);
+	this->drawText("US        P50   P99   MAX", 0, 16);
+
+	for(p = 0; p < PHASE_COUNT; p++)
+	{
+		this->stats->summary((STATSPHASE)p, &s);
+		snprintf(line, sizeof(line), "%-7s %5lld %5lld %5lld",
+			FrameStats::phaseName((STATSPHASE)p), s.p50 / 1000, s.p99 / 1000,
+			s.max / 1000);
+		this->drawText(line, 0, (p + 2) * 16);
+	}
+
+	memUsage(MEM_TAGS, &m);
+	snprintf(line, sizeof(line), "MEM %7lldK NEW %5lld", m.bytes >> 10,
+		m.tickAllocs);
+	this->drawText(line, 0, (PHASE_COUNT + 2) * 16);
+}
+
+/**
+ *  Returns sprite column of tile.
+ *  \param tile     tile (NULL if empty)
+ *  \return         column in first XPM row (0 is empty)
+ */
+int SDLUI::tileSprite(Tile* tile)
+{
+	if(!tile)
+		return 0;
+
+	switch(tile->getType())
+	{
+	case TILE_SAND:
+		return 1;
+	case TILE_WALL:
+		return 2;
+	case TILE_BOULDER:
+		return 3;
+	case TILE_DIAMOND:
+		return 4;
+	case TILE_PLAYER:
+		return 5;
+	case TILE_EXIT:
+		// locked or unlocked door
+		return tile->isLocked() ? 6 : 7;
+	}
+
+	return 0;
+}
+
+/**
+ *  Timer callback of wait() (runs in timer thread), pushes event that ends
+ *  wait.
+ *  \param interval     timer interval
+ *  \param param        unused
+ *  \return             0 (timer fires once)
+ */
+Uint32 SDLUI::wake(Uint32 interval, void* param)
+{
+	SDL_Event event;
+
+	event.type = SDL_USEREVENT;
+	event.user.code = 0;
+	event.user.data1 = NULL;
+	event.user.data2 = NULL;
+	SDL_PushEvent(&event);
+
+	return 0;
+}
+
+/**
+ *  Create surface with whole chunk of sand and whole chunk of walls side by
+ *  side, made of the same pixels (and transparent color) as their sprites.
+ *  \param tiles    sprites surface (zoomed)
+ *  \param size     sprite size in tiles
+ *  \return         surface or NULL if it couldn't be created
+ */
+SDL_Surface* SDLUI::fillsCreate(SDL_Surface* tiles, int size)
+{
+	SDL_Surface* r = SDL_CreateRGBSurface(SDL_SWSURFACE, 2 * MAP_CHUNK * size,
+		MAP_CHUNK * size, 8, 0, 0, 0, 0);
+	int fill, x, y;
+
+	if(!r)
+		return NULL;
+	MEM_ALLOC(MEM_SPRITES, r->pitch * r->h);
+
+	SDL_SetColors(r, tiles->format->palette->colors, 0,
+		tiles->format->palette->ncolors);
+	if(tiles->flags & SDL_SRCCOLORKEY)
+		SDL_SetColorKey(r, SDL_SRCCOLORKEY, tiles->format->colorkey);
+
+	// sand is sprite (1, 0), wall is sprite (2, 0)
+	for(fill = 0; fill < 2; fill++)
+		for(y = 0; y < MAP_CHUNK * size; y++)
+			for(x = 0; x < MAP_CHUNK; x++)
+				memcpy((Uint8*)r->pixels + y * r->pitch +
+					(fill * MAP_CHUNK + x) * size,
+					(Uint8*)tiles->pixels + (y % size) * tiles->pitch +
+					(fill + 1) * size, size);
+
+	return r;
+}
+
+/**
+ *  Frees sprite surface.
+ *  \param sprites      surface (NULL is ignored)
+ */
+void SDLUI::spritesFree(SDL_Surface* sprites)
+{
+	if(!sprites)
+		return;
+
+	MEM_FREE(MEM_SPRITES, sprites->pitch * sprites->h);
+	SDL_FreeSurface(sprites);
+}
+
+/**
+ *  Scale sprites by integer zoom (nearest neighbour), palette and
+ *  transparent color are kept.
+ *  \param sprite   sprites surface
+ *  \param zoom     zoom
+ *  \return         surface or NULL if it couldn't be created
+ */
+SDL_Surface* SDLUI::xpmScale(SDL_Surface* sprite, int zoom)
+{
+	SDL_Surface* r = SDL_CreateRGBSurface(SDL_SWSURFACE, sprite->w * zoom,
+		sprite->h * zoom, 8, 0, 0, 0, 0);
+	int y, i;
+
+	if(!r)
+		return NULL;
+	MEM_ALLOC(MEM_SPRITES, r->pitch * r->h);
+
+	SDL_SetColors(r, sprite->format->palette->colors, 0,
+		sprite->format->palette->ncolors);
+	if(sprite->flags & SDL_SRCCOLORKEY)
+		SDL_SetColorKey(r, SDL_SRCCOLORKEY, sprite->format->colorkey);
+
+	// row is scaled once and copied to the other rows of its zoom
+	for(y = 0; y < sprite->h; y++)
+	{
+		Uint8* dst = (Uint8*)r->pixels + y * zoom * r->pitch;
+
+		SDLUI::scaleRow((Uint8*)sprite->pixels + y * sprite->pitch, dst,
+			sprite->w, zoom);
+		for(i = 1; i < zoom; i++)
+			memcpy(dst + i * r->pitch, dst, r->w);
+	}
+
+	return r;
+}
+
+/**
+ *  Repeat every pixel of row zoom times. Zoom 2 and 4 interleave 16 pixels
+ *  at once with SSE2 (odd zoom needs byte shuffle SSE2 doesn't have).
+ *  \param src      source row
+ *  \param dst      destination row (width * zoom pixels)
+ *  \param width    pixels of source row
+ *  \param zoom     zoom
+ */
+void SDLUI::scaleRow(const Uint8* src, Uint8* dst, int width, int zoom)
+{
+	int x = 0, i;
+
+#ifdef __SSE2__
+	for(; (zoom == 2 || zoom == 4) && x + 16 <= width; x += 16)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i lo = _mm_unpacklo_epi8(p, p);
+		__m128i hi = _mm_unpackhi_epi8(p, p);
+
+		if(zoom == 2)
+		{
+			_mm_storeu_si128((__m128i*)(dst + x * 2), lo);
+			_mm_storeu_si128((__m128i*)(dst + x * 2 + 16), hi);
+			continue;
+		}
+		_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_unpacklo_epi16(lo, lo));
+		_mm_storeu_si128((__m128i*)(dst + x * 4 + 16),
+			_mm_unpackhi_epi16(lo, lo));
+		_mm_storeu_si128((__m128i*)(dst + x * 4 + 32),
+			_mm_unpacklo_epi16(hi, hi));
+		_mm_storeu_si128((__m128i*)(dst + x * 4 + 48),
+			_mm_unpackhi_epi16(hi, hi));
+	}
+#endif /* __SSE2__ */
+
+	for(; x < width; x++)
+		for(i = 0; i < zoom; i++)
+			dst[x * zoom + i] = src[x];
+}
+
 // XPM
 
 /**
@@ -313,6 +980,7 @@ SDL_Surface* SDLUI::xpmLoad(char** xpm)
 	keystrings = (char*)malloc(ncolors * cpp);
 	if(!keystrings)
 		error(true, "SDL: out of memory!");
+	MEM_ALLOC(MEM_SPRITES, ncolors * cpp);
 	nextkey = keystrings;
 
 	// prepare surface
@@ -321,6 +989,7 @@ SDL_Surface* SDLUI::xpmLoad(char** xpm)
 	r->format->palette->ncolors = ncolors;
 	if(!r)
 		error(true, "SDL: out of memory/can't create surface!");
+	MEM_ALLOC(MEM_SPRITES, r->pitch * r->h);
 
 	// read colors
 	for(i = 0; i < ncolors; i++)
@@ -398,6 +1067,9 @@ SDL_Surface* SDLUI::xpmLoad(char** xpm)
 
 done:
 	if(keystrings)
+	{
+		MEM_FREE(MEM_SPRITES, ncolors * cpp);
 		free(keystrings);
+	}
 	return r;
 }
@@ -24,10 +24,23 @@
 
 #include "SDL/SDL.h"        // libSDL
 #include "ui.h"
+#include "anim.h"
 #include "ui_sdl.xpm"
 
 
 class Tile;                 // tile.h
+class FrameStats;           // stats.h
+class Publisher;            // publish.h
+class Capture;              // capture.h
+
+// window size
+#define SDLUI_WIDTH 640
+#define SDLUI_HEIGHT 480
+// sprite size in XPM and largest zoom of map tiles
+#define SDLUI_SPRITE 16
+#define SDLUI_MAX_ZOOM 4
+// XPM row of second frame of animated sprites (first frame is in row 0)
+#define SDLUI_ANIM_ROW 4
 
 
 /**
@@ -37,18 +50,64 @@ class SDLUI : public UI
 {
 private:
 	SDL_Surface* screen;
-	SDL_Surface* sprite;
+	SDL_Surface* sprite;        // sprites as loaded (HUD font)
+	SDL_Surface* tiles;         // sprites scaled by zoom (map)
+	SDL_Surface* fills;         // uniform chunks of sand and walls (scaled)
+	int size;                   // size of map tile on screen
+	int cameraX;                // top left corner of view in map (pixels)
+	int cameraY;
+
+	// view cells (cells cut by screen edge too) hold sprite column drawn
+	// there, frame redraws just cells whose sprite or animation frame changed
+	unsigned char* sprites;     // sprites of view cells in map
+	unsigned char* drawn;       // sprites of view cells on screen
+	int viewWidth;
+	int viewHeight;
+	int drawnX;                 // camera of drawn frame
+	int drawnY;
+	int drawnWidth;             // map size of drawn frame (0 redraws all)
+	int drawnHeight;
+	bool flipping;              // screen is page flipped (always redraw all)
+	SDL_Rect* dirty;            // screen rects redrawn by frame
+	Animator animator;          // frames of view cells
+
 	SDL_Event event;
+	bool waited;                // event woke wait(), input() takes it first
+	int travelX;                // map cell clicked last (travel target)
+	int travelY;
+	FrameStats* stats;          // HUD source (NULL means no HUD)
+	Publisher* publisher;       // frame sinks (NULL means none)
+	Capture* capture;
 
 	static SDL_Surface* xpmLoad(char** xpm);
 	static int xpmColorToRgb(char* spec, int speclen, Uint32* rgb);
+	static SDL_Surface* xpmScale(SDL_Surface* sprite, int zoom);
+	static void scaleRow(const Uint8* src, Uint8* dst, int width, int zoom);
+	static SDL_Surface* fillsCreate(SDL_Surface* tiles, int size);
+	static void spritesFree(SDL_Surface* sprites);
+	static int tileSprite(Tile* tile);
+	static Uint32 wake(Uint32 interval, void* param);
 
+	void viewCreate();
+	void viewFree();
+	void viewSprites(Map* map, int x0, int y0, int x1, int y1);
+	void drawCell(int x, int y, int cell, SDL_Rect* rect);
 	void drawSprite(int spriteX, int spriteY, int x, int y);
+	void drawGlyph(int spriteX, int spriteY, int x, int y);
+	void drawFill(int fill, int x, int y, int w, int h);
+	void drawText(const char* text, int x, int y);
+	void drawHud(SDL_Rect* rect);
 public:
 	SDLUI();
 	~SDLUI();
 	UIINPUT input();
 	void draw(Map* map);
+	bool getTarget(int* x, int* y);
+	void wait(unsigned int timeout);
+	bool setZoom(int zoom);
+	void setHud(FrameStats* stats);
+	void setPublisher(Publisher* publisher);
+	void setCapture(Capture* capture);
 };
 
 // XPM utils
@@ -0,0 +1,528 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// ui_term.cpp: terminal user interface class
+
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "ui_term.h"
+#include "map.h"
+#include "tile.h"
+#include "entity.h"
+#include "timer.h"
+#include "mem.h"
+#include "trace.h"
+#include "config.h"
+#include "debug.h"
+
+// bytes of input read at once
+#define TERMUI_INPUT 64
+// initial capacity of frame output
+#define TERMUI_MIN_CAPACITY 4096
+// longest status line
+#define TERMUI_STATUS 256
+
+// terminal mode before raw mode (restored by TermUI::restore())
+static struct termios saved;
+
+// last log record and when it came, last error (printed once terminal is
+// restored, fatal error exits before it could be read)
+static char logged[TERMUI_STATUS];
+static long long loggedTime = 0;
+static char failed[TERMUI_STATUS];
+static volatile int loggedLock = 0;
+
+bool TermUI::raw = false;
+volatile int TermUI::resized = 0;
+
+
+/**
+ *  Constructor. Switches terminal to raw mode and clears it.
+ */
+TermUI::TermUI()
+{
+	struct termios mode;
+
+	debug("term: init");
+
+	if(!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) ||
+		tcgetattr(STDIN_FILENO, &saved) < 0)
+		error(true, "term: standard input and output must be terminal");
+
+	// keys come one by one without echo (Ctrl-C too), reads don't block
+	mode = saved;
+	mode.c_iflag &= ~(ICRNL | IXON);
+	mode.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+	mode.c_cc[VMIN] = 0;
+	mode.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+
+	// fatal error exits without destructor, terminal is restored anyway
+	if(!TermUI::raw)
+		atexit(TermUI::restore);
+	TermUI::raw = true;
+	signal(SIGWINCH, TermUI::winch);
+	logSink(TermUI::record);
+
+	this->screen = NULL;
+	this->shadow = NULL;
+	this->cols = 0;
+	this->rows = 0;
+	this->cameraX = 0;
+	this->cameraY = 0;
+	this->pending = false;
+	this->sent = 0;
+	this->out = NULL;
+	this->outLength = 0;
+	this->outCapacity = 0;
+	this->travelX = -1;
+	this->travelY = -1;
+	this->clear();
+}
+
+/**
+ *  Destructor. Leaves last frame on screen with cursor below it.
+ */
+TermUI::~TermUI()
+{
+	debug("term: quit");
+
+	if(this->pending)
+		this->send();
+	this->move(0, this->rows - 1);
+	this->put("\r\n", 2);
+	this->flush();
+	TermUI::restore();
+	signal(SIGWINCH, SIG_DFL);
+
+	MEM_DELETE(MEM_UI, this->screen, this->cols * this->rows);
+	MEM_DELETE(MEM_UI, this->shadow, this->cols * this->rows);
+	MEM_DELETE(MEM_UI, this->out, this->outCapacity);
+}
+
+/**
+ *  Process input keys (all that came since last call, last command wins).
+ *  \return         key identificator
+ *  \see UIINPUT
+ */
+UIINPUT TermUI::input()
+{
+	unsigned char buffer[TERMUI_INPUT];
+	UIINPUT r = INPUT_UNKNOWN;
+	ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+	int i;
+
+	for(i = 0; i < n && r != INPUT_QUIT; i++)
+	{
+		switch(buffer[i])
+		{
+		case 'q':
+		case 'Q':
+		case 3:             // Ctrl-C
+			debug("term: q, Exiting.");
+			r = INPUT_QUIT;
+			break;
+		case 'k':
+			r = INPUT_UP;
+			break;
+		case 'j':
+			r = INPUT_DOWN;
+			break;
+		case 'h':
+			r = INPUT_LEFT;
+			break;
+		case 'l':
+			r = INPUT_RIGHT;
+			break;
+		case 8:
+		case 127:           // backspace (repeats while held)
+			r = INPUT_REWIND;
+			break;
+		case 12:            // Ctrl-L
+			this->clear();
+			break;
+		case 27:
+			// arrows (ESC [ or ESC O and letter) and clicks (ESC [ M and
+			// button, column and row, each plus 32); lone ESC is ignored,
+			// it may be start of sequence split by slow link
+			if(i + 2 >= n || (buffer[i + 1] != '[' && buffer[i + 1] != 'O'))
+				break;
+			switch(buffer[i + 2])
+			{
+			case 'A':
+				r = INPUT_UP;
+				break;
+			case 'B':
+				r = INPUT_DOWN;
+				break;
+			case 'C':
+				r = INPUT_RIGHT;
+				break;
+			case 'D':
+				r = INPUT_LEFT;
+				break;
+			case 'M':
+				if(i + 5 >= n)
+					break;
+				if(((buffer[i + 3] - 32) & 0x43) == 0 &&
+					buffer[i + 5] - 33 < this->rows - 1)
+				{
+					this->travelX = this->cameraX + buffer[i + 4] - 33;
+					this->travelY = this->cameraY + buffer[i + 5] - 33;
+					debug("term: click at %d,%d", this->travelX,
+						this->travelY);
+					r = INPUT_TRAVEL;
+				}
+				i += 3;
+				break;
+			}
+			i += 2;
+			break;
+		}
+	}
+
+	return r;
+}
+
+/**
+ *  Draws map view and status line, sends cells that changed since last
+ *  frame sent (unless it was sent too recently).
+ *  \param map          map
+ */
+void TermUI::draw(Map* map)
+{
+	assert(map);
+	TRACE_SCOPE("TermUI::draw");
+
+	if(TermUI::resized)
+		this->clear();
+
+	int width = map->getWidth();
+	int height = map->getHeight();
+	int view = this->rows - 1;
+	int x, y, i;
+
+	// view keeps still until player comes close to its edge
+	if(!map->getPlayerXY(&x, &y))
+		x = y = -1;
+	this->scroll(x, &this->cameraX, this->cols, width);
+	this->scroll(y, &this->cameraY, view, height);
+
+	// frame: cells of view, creatures in them, status line
+	for(y = 0; y < view; y++)
+	{
+		char* line = this->screen + y * this->cols;
+		int my = this->cameraY + y;
+
+		for(x = 0; x < this->cols; x++)
+		{
+			int mx = this->cameraX + x;
+			Tile* tile = mx < width && my < height ?
+				map->getTileXY(mx, my) : NULL;
+
+			line[x] = tile ? tile->getType() : ' ';
+		}
+	}
+
+	Entities* entities = map->getEntities();
+	for(i = 0; i < entities->getCount(); i++)
+	{
+		x = entities->getX(i) - this->cameraX;
+		y = entities->getY(i) - this->cameraY;
+		if(x >= 0 && x < this->cols && y >= 0 && y < view)
+			this->screen[y * this->cols + x] = entities->getType(i);
+	}
+
+	// last log record is shown for a while after game state
+	char record[TERMUI_STATUS] = "";
+	while(__sync_lock_test_and_set(&loggedLock, 1));
+	if(logged[0] && timerNow() - loggedTime < TERMUI_LOG_TIME)
+		strcpy(record, logged);
+	__sync_lock_release(&loggedLock);
+
+	char status[TERMUI_STATUS];
+	int length = snprintf(status, sizeof(status), " %c %d  %s  %s",
+		TILE_DIAMOND, map->getDiamonds(), map->getState() == MAP_WON ?
+		"PERFECT!" : map->getState() == MAP_LOST ? "BAD LUCK!" :
+		!map->isWinnable() ? "NO WAY OUT!" : "", record);
+	char* line = this->screen + view * this->cols;
+
+	// last cell of terminal is never written (some terminals scroll)
+	if(length > (int)sizeof(status) - 1)
+		length = sizeof(status) - 1;
+	if(length > this->cols - 1)
+		length = this->cols - 1;
+	memcpy(line, status, length);
+	memset(line + length, ' ', this->cols - length);
+
+	this->pending = true;
+	if(timerNow() - this->sent >= TERMUI_PERIOD)
+		this->send();
+}
+
+/**
+ *  Returns map cell clicked last (target of INPUT_TRAVEL).
+ *  \param x            pointer to x coordinate (filled in)
+ *  \param y            pointer to y coordinate (filled in)
+ *  \return             false if nothing was clicked yet
+ */
+bool TermUI::getTarget(int* x, int* y)
+{
+	if(this->travelX < 0)
+		return false;
+
+	*x = this->travelX;
+	*y = this->travelY;
+	return true;
+}
+
+/**
+ *  Sends frame held back by draw() and sleeps until key arrives or terminal
+ *  is resized.
+ *  \param timeout      milliseconds after which it wakes anyway (0 waits
+ *                      for key only)
+ */
+void TermUI::wait(unsigned int timeout)
+{
+	struct pollfd fd;
+
+	// frame held back by draw() is shown before sleeping
+	if(this->pending)
+		this->send();
+
+	fd.fd = STDIN_FILENO;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	poll(&fd, 1, timeout ? (int)timeout : -1);
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Returns terminal to mode it had before TermUI (mouse reports off, cursor
+ *  shown). Called by destructor and at exit, only first call counts.
+ */
+void TermUI::restore()
+{
+	if(!TermUI::raw)
+		return;
+
+	TermUI::raw = false;
+	fputs("\033[?1000l\033[?25h", stdout);
+	fflush(stdout);
+	tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+
+	logSink(NULL);
+	while(__sync_lock_test_and_set(&loggedLock, 1));
+	if(failed[0])
+		fprintf(stderr, "%s\n", failed);
+	failed[0] = '\0';
+	__sync_lock_release(&loggedLock);
+}
+
+/**
+ *  Log sink while terminal is in raw mode, keeps record for status line.
+ *  Called by log writer thread.
+ *  \param level        log level
+ *  \param line         record
+ */
+void TermUI::record(LOGLEVEL level, const char* line)
+{
+	while(__sync_lock_test_and_set(&loggedLock, 1));
+	snprintf(logged, sizeof(logged), "%s", line);
+	loggedTime = timerNow();
+	if(level == LOG_ERROR)
+		snprintf(failed, sizeof(failed), "%s", line);
+	__sync_lock_release(&loggedLock);
+}
+
+/**
+ *  SIGWINCH handler, next frame measures terminal again.
+ *  \param signal       signal number
+ */
+void TermUI::winch(int signal)
+{
+	TermUI::resized = 1;
+}
+
+/**
+ *  Starts terminal screen over: measures it, clears it and shadow, so next
+ *  frame sends all cells that aren't blank.
+ */
+void TermUI::clear()
+{
+	static const char reset[] = "\033[?1000h\033[?25l\033[H\033[2J";
+	struct winsize size;
+	int cols = 80, rows = 24;
+
+	TermUI::resized = 0;
+	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 &&
+		size.ws_row > 1)
+	{
+		cols = size.ws_col;
+		rows = size.ws_row;
+	}
+
+	if(cols != this->cols || rows != this->rows)
+	{
+		MEM_DELETE(MEM_UI, this->screen, this->cols * this->rows);
+		MEM_DELETE(MEM_UI, this->shadow, this->cols * this->rows);
+		this->screen = MEM_NEW(MEM_UI, char, cols * rows);
+		this->shadow = MEM_NEW(MEM_UI, char, cols * rows);
+		this->cols = cols;
+		this->rows = rows;
+		memset(this->screen, ' ', cols * rows);
+		this->pending = false;
+	}
+	memset(this->shadow, ' ', cols * rows);
+
+	// report clicks, hide cursor, clear
+	this->put(reset, sizeof(reset) - 1);
+	this->cursorX = 0;
+	this->cursorY = 0;
+}
+
+/**
+ *  Scrolls view along one axis by half of its size once player comes within
+ *  TERMUI_MARGIN cells of its edge, view stays within map.
+ *  \param player       player coordinate (-1 if there is no player)
+ *  \param camera       pointer to first coordinate of view (updated)
+ *  \param view         view size
+ *  \param size         map size
+ */
+void TermUI::scroll(int player, int* camera, int view, int size)
+{
+	int margin = view > 4 * TERMUI_MARGIN ? TERMUI_MARGIN : view / 4;
+
+	if(player >= 0 &&
+		(player < *camera + margin || player >= *camera + view - margin))
+		*camera = player - view / 2;
+	if(*camera > size - view)
+		*camera = size - view;
+	if(*camera < 0)
+		*camera = 0;
+}
+
+/**
+ *  Sends cells of screen that differ from shadow.
+ */
+void TermUI::send()
+{
+	int i;
+
+	for(i = 0; i < this->cols * this->rows; i++)
+	{
+		if(this->screen[i] == this->shadow[i])
+			continue;
+
+		this->move(i % this->cols, i / this->cols);
+		this->put(this->screen + i, 1);
+		this->shadow[i] = this->screen[i];
+		if(++this->cursorX == this->cols)
+		{
+			// cursor waits for wrap, its position depends on terminal
+			this->cursorX = -1;
+			this->cursorY = -1;
+		}
+	}
+	this->flush();
+	this->pending = false;
+	this->sent = timerNow();
+}
+
+/**
+ *  Appends bytes to output of frame.
+ *  \param data         bytes
+ *  \param length       number of bytes
+ */
+void TermUI::put(const char* data, size_t length)
+{
+	if(this->outLength + length > this->outCapacity)
+	{
+		size_t capacity = this->outCapacity ? this->outCapacity :
+			TERMUI_MIN_CAPACITY;
+		while(capacity < this->outLength + length)
+			capacity *= 2;
+
+		char* bigger = MEM_NEW(MEM_UI, char, capacity);
+		if(this->outLength)
+			memcpy(bigger, this->out, this->outLength);
+		MEM_DELETE(MEM_UI, this->out, this->outCapacity);
+		this->out = bigger;
+		this->outCapacity = capacity;
+	}
+
+	memcpy(this->out + this->outLength, data, length);
+	this->outLength += length;
+}
+
+/**
+ *  Moves terminal cursor to cell. Few unchanged cells right of cursor are
+ *  written again, that's shorter than escape sequence.
+ *  \param x            column (from 0)
+ *  \param y            row (from 0)
+ */
+void TermUI::move(int x, int y)
+{
+	char seq[32];
+
+	if(y == this->cursorY && x >= this->cursorX &&
+		x - this->cursorX <= TERMUI_GAP)
+		this->put(this->shadow + y * this->cols + this->cursorX,
+			x - this->cursorX);
+	else
+		this->put(seq, snprintf(seq, sizeof(seq), "\033[%d;%dH", y + 1,
+			x + 1));
+
+	this->cursorX = x;
+	this->cursorY = y;
+}
+
+/**
+ *  Sends output of frame to terminal in one write (unless terminal takes
+ *  just part of it).
+ */
+void TermUI::flush()
+{
+	size_t sent = 0;
+
+	while(sent < this->outLength)
+	{
+		ssize_t n = write(STDOUT_FILENO, this->out + sent,
+			this->outLength - sent);
+
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		sent += n;
+	}
+	this->outLength = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// ui_term.h: terminal user interface class
+
+#ifndef __TERM_UI_H
+#define __TERM_UI_H
+
+#include <cstddef>
+#include "ui.h"
+#include "log.h"
+
+
+class Map;                  // map.h
+
+// cells of player distance from view edge that scroll view
+#define TERMUI_MARGIN 4
+// unchanged cells rewritten rather than skipped by cursor move
+#define TERMUI_GAP 4
+// shortest time between frames sent to terminal (ns)
+#define TERMUI_PERIOD 33000000LL
+// time log record stays in status line (ns)
+#define TERMUI_LOG_TIME 5000000000LL
+
+
+/**
+ *  Terminal UI class. Map is drawn with its own glyphs by ANSI escape
+ *  sequences, bottom line shows diamonds and game state. Screen of every
+ *  frame is compared with shadow of what terminal shows and only changed
+ *  cells are sent (cursor moves and characters, one write per frame), at
+ *  most once per TERMUI_PERIOD: frames drawn meanwhile are just kept, so
+ *  cells that changed many times are sent once. View scrolls by half of its
+ *  size once player comes close to its edge. Log records go to status line
+ *  meanwhile, not over the screen. Keys:
+ *  arrows or h j k l (move), backspace (rewind), Ctrl-L (redraw), q (quit),
+ *  left click (travel).
+ */
+class TermUI : public UI
+{
+private:
+	char* screen;               // glyphs of frame (cols x rows)
+	char* shadow;               // glyphs terminal shows
+	int cols;
+	int rows;                   // terminal rows (last one is status line)
+	int cameraX;                // top left cell of view in map
+	int cameraY;
+	int cursorX;                // terminal cursor (-1 if unknown)
+	int cursorY;
+	bool pending;               // frame in screen wasn't sent yet
+	long long sent;             // time last frame was sent
+	char* out;                  // output of frame
+	size_t outLength;
+	size_t outCapacity;
+	int travelX;                // map cell clicked last (travel target)
+	int travelY;
+
+	static bool raw;            // terminal is in raw mode (see restore())
+	static volatile int resized;
+
+	static void restore();
+	static void winch(int signal);
+	static void record(LOGLEVEL level, const char* line);
+	void clear();
+	void scroll(int player, int* camera, int view, int size);
+	void put(const char* data, size_t length);
+	void move(int x, int y);
+	void send();
+	void flush();
+public:
+	TermUI();
+	~TermUI();
+	UIINPUT input();
+	void draw(Map* map);
+	bool getTarget(int* x, int* y);
+	void wait(unsigned int timeout);
+};
+
+
+#endif /* __TERM_UI_H */
@@ -0,0 +1,444 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// validate.cpp: batch map validator
+
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cassert>
+#include "validate.h"
+#include "pool.h"
+#include "tile.h"
+#include "entity.h"
+#include "config.h"
+#include "debug.h"
+
+// glyph of empty tile
+#define GLYPH_EMPTY ' '
+
+
+/**
+ *  Constructor.
+ *  \param threads      number of validating threads (0 means one per CPU)
+ */
+Validator::Validator(int threads)
+{
+	this->results = NULL;
+	this->count = 0;
+	this->threads = threads;
+}
+
+/**
+ *  Destructor.
+ */
+Validator::~Validator()
+{
+	delete[] this->results;
+}
+
+/**
+ *  Validates all given map files in parallel. Results are kept in the same
+ *  order as files.
+ *  \param filenames    map filenames
+ *  \param count        number of map files
+ *  \return             number of maps with errors (warnings don't count)
+ */
+int Validator::run(char** filenames, int count)
+{
+	int i;
+	int failed = 0;
+
+	delete[] this->results;
+	this->results = new VALIDATION[count];
+	this->count = count;
+	for(i = 0; i < count; i++)
+		this->results[i].filename = filenames[i];
+
+	Pool pool(this->threads);
+	pool.run(Validator::job, this, count);
+
+	for(i = 0; i < count; i++)
+		if(this->results[i].problems & (VALIDATE_WARNINGS - 1))
+			failed++;
+
+	return failed;
+}
+
+/**
+ *  Writes machine readable report. Each map is one JSON object on its own
+ *  line.
+ *  \param f            output stream
+ */
+void Validator::report(FILE* f)
+{
+	static const struct
+	{
+		int problem;
+		const char* name;
+	} names[] =
+	{
+		{ VALIDATE_UNREADABLE,  "unreadable" },
+		{ VALIDATE_EMPTY,       "empty" },
+		{ VALIDATE_PLAYER,      "player_count" },
+		{ VALIDATE_EXIT,        "no_exit" },
+		{ VALIDATE_UNREACHABLE, "exit_unreachable" },
+		{ VALIDATE_DIAMONDS,    "diamonds_unreachable" },
+		{ VALIDATE_BORDER,      "open_border" },
+		{ VALIDATE_TRUNCATED,   "truncated" },
+		{ VALIDATE_RAGGED,      "ragged_rows" },
+		{ VALIDATE_UNKNOWN,     "unknown_glyphs" }
+	};
+	int i;
+	unsigned int j;
+
+	for(i = 0; i < this->count; i++)
+	{
+		VALIDATION* r = &this->results[i];
+		const char* status = "ok";
+		bool first = true;
+
+		if(r->problems & (VALIDATE_WARNINGS - 1))
+			status = "error";
+		else if(r->problems)
+			status = "warning";
+
+		fprintf(f, "{\"file\":");
+		Validator::writeString(f, r->filename);
+		fprintf(f, ",\"status\":\"%s\",\"width\":%d,\"height\":%d,"
+			"\"players\":%d,\"exits\":%d,\"diamonds\":%d,"
+			"\"reachable_diamonds\":%d,\"exit_reachable\":%s,"
+			"\"ragged_rows\":%d,\"unknown_glyphs\":%d",
+			status, r->width, r->height,
+			r->players, r->exits, r->diamonds,
+			r->reachableDiamonds, r->exitReachable ? "true" : "false",
+			r->raggedRows, r->unknownGlyphs);
+		if(r->unknownGlyphs)
+			fprintf(f, ",\"first_unknown\":{\"line\":%d,\"column\":%d}",
+				r->unknownLine, r->unknownColumn);
+
+		fprintf(f, ",\"problems\":[");
+		for(j = 0; j < sizeof(names) / sizeof(names[0]); j++)
+		{
+			if(!(r->problems & names[j].problem))
+				continue;
+			fprintf(f, "%s\"%s\"", first ? "" : ",", names[j].name);
+			first = false;
+		}
+		fprintf(f, "]}\n");
+	}
+}
+
+/**
+ *  Writes human readable summary of last run.
+ *  \param f            output stream
+ */
+void Validator::summary(FILE* f)
+{
+	int i;
+	int ok = 0, warnings = 0, errors = 0;
+
+	for(i = 0; i < this->count; i++)
+	{
+		if(this->results[i].problems & (VALIDATE_WARNINGS - 1))
+			errors++;
+		else if(this->results[i].problems)
+			warnings++;
+		else
+			ok++;
+	}
+
+	fprintf(f, "%d maps: %d ok, %d with warnings, %d with errors\n",
+		this->count, ok, warnings, errors);
+}
+
+/**
+ *  Returns result of i-th validated map.
+ *  \param i            index of map in last run
+ *  \return             pointer to validation result
+ */
+const VALIDATION* Validator::getResult(int i)
+{
+	assert(i >= 0 && i < this->count);
+	return &this->results[i];
+}
+
+/**
+ *  Validates single map file. Map is read the same way as in Map::load()
+ *  (non-printable characters are skipped, first empty line ends map).
+ *  \param filename     map filename
+ *  \param result       pointer to result (filled in)
+ */
+void Validator::validate(const char* filename, VALIDATION* result)
+{
+	FILE* f;
+	char* data;
+	long size;
+	long i;
+
+	memset(result, 0, sizeof(VALIDATION));
+	result->filename = filename;
+
+	// read whole file
+	f = fopen(filename, "rb");
+	if(!f)
+	{
+		result->problems |= VALIDATE_UNREADABLE;
+		return;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(size < 0)
+	{
+		fclose(f);
+		result->problems |= VALIDATE_UNREADABLE;
+		return;
+	}
+	data = new char[size + 1];
+	size = fread(data, 1, size, f);
+	fclose(f);
+
+	// first pass: map rectangle, ragged rows, unterminated last row
+	int width = 0, height = 0;
+	int line = 1, column = 0;
+	int rowWidth = 0;
+	long end = size;
+	for(i = 0; i < size; i++)
+	{
+		unsigned char c = data[i];
+
+		if(c == '\n')
+		{
+			line++;
+			column = 0;
+			if(rowWidth == 0)
+			{
+				end = i;
+				break;
+			}
+			height++;
+			if(width < rowWidth)
+				width = rowWidth;
+			rowWidth = 0;
+			continue;
+		}
+		column++;
+		if(!isprint(c))
+			continue;
+
+		// unknown glyphs are loaded as empty tiles
+		switch(c)
+		{
+		case TILE_WALL:
+		case TILE_SAND:
+		case TILE_BOULDER:
+		case TILE_DIAMOND:
+		case TILE_PLAYER:
+		case TILE_EXIT:
+		case ENTITY_FIREFLY:
+		case ENTITY_BUTTERFLY:
+		case GLYPH_EMPTY:
+			break;
+		default:
+			if(!result->unknownGlyphs)
+			{
+				result->unknownLine = line;
+				result->unknownColumn = column;
+			}
+			result->unknownGlyphs++;
+		}
+		rowWidth++;
+	}
+	// Map::load() only counts rows ended by newline
+	if(rowWidth != 0)
+		result->problems |= VALIDATE_TRUNCATED;
+
+	result->width = width;
+	result->height = height;
+	if(!width || !height)
+	{
+		result->problems |= VALIDATE_EMPTY;
+		delete[] data;
+		return;
+	}
+
+	// second pass: build padded grid
+	char* grid = new char[width * height];
+	int x = 0, y = 0;
+	memset(grid, GLYPH_EMPTY, width * height);
+	for(i = 0; i < end && y < height; i++)
+	{
+		unsigned char c = data[i];
+
+		if(c == '\n')
+		{
+			if(x < width)
+				result->raggedRows++;
+			x = 0;
+			y++;
+			continue;
+		}
+		if(!isprint(c))
+			continue;
+		grid[y * width + x++] = c;
+	}
+	delete[] data;
+
+	if(result->raggedRows)
+		result->problems |= VALIDATE_RAGGED;
+	if(result->unknownGlyphs)
+		result->problems |= VALIDATE_UNKNOWN;
+
+	// count objects
+	int start = -1;
+	for(i = 0; i < width * height; i++)
+	{
+		switch(grid[i])
+		{
+		case TILE_PLAYER:
+			if(start < 0)
+				start = i;
+			result->players++;
+			break;
+		case TILE_EXIT:
+			result->exits++;
+			break;
+		case TILE_DIAMOND:
+			result->diamonds++;
+			break;
+		}
+	}
+	if(result->players != 1)
+		result->problems |= VALIDATE_PLAYER;
+	if(!result->exits)
+		result->problems |= VALIDATE_EXIT;
+
+	// flood fill from player through tiles player can step on (reached
+	// tiles are marked by zero)
+	if(start >= 0)
+	{
+		int* queue = new int[width * height];
+		int head = 0, tail = 0;
+		bool border = false;
+
+		queue[tail++] = start;
+		grid[start] = 0;
+		while(head < tail)
+		{
+			int c = queue[head++];
+			int cx = c % width;
+			int cy = c / width;
+			int n[4];
+			int k;
+
+			if(cx == 0 || cy == 0 || cx == width - 1 || cy == height - 1)
+				border = true;
+
+			n[0] = cx > 0 ? c - 1 : -1;
+			n[1] = cx < width - 1 ? c + 1 : -1;
+			n[2] = cy > 0 ? c - width : -1;
+			n[3] = cy < height - 1 ? c + width : -1;
+			for(k = 0; k < 4; k++)
+			{
+				if(n[k] < 0)
+					continue;
+
+				switch(grid[n[k]])
+				{
+				case TILE_EXIT:
+					// exit ends the game, don't walk through it
+					result->exitReachable = true;
+					break;
+				case TILE_DIAMOND:
+					result->reachableDiamonds++;
+					// fall through
+				case TILE_SAND:
+				case TILE_PLAYER:
+				case ENTITY_FIREFLY:    // creatures move away
+				case ENTITY_BUTTERFLY:
+				case GLYPH_EMPTY:
+					grid[n[k]] = 0;
+					queue[tail++] = n[k];
+					break;
+				case TILE_WALL:
+				case TILE_BOULDER:
+				case 0:
+					break;
+				default:
+					// unknown glyph, loaded as empty
+					grid[n[k]] = 0;
+					queue[tail++] = n[k];
+				}
+			}
+		}
+		delete[] queue;
+
+		if(!result->exitReachable)
+			result->problems |= VALIDATE_UNREACHABLE;
+		if(result->reachableDiamonds < result->diamonds)
+			result->problems |= VALIDATE_DIAMONDS;
+		if(border)
+			result->problems |= VALIDATE_BORDER;
+	}
+
+	delete[] grid;
+	debug("%s: problems=%x", filename, result->problems);
+}
+
+// ---------------------------------------------------------------------------
+// Private methods
+// ---------------------------------------------------------------------------
+
+/**
+ *  Pool job validating one map of batch.
+ *  \param validator    pointer to Validator
+ *  \param index        index of map in batch
+ */
+void Validator::job(void* validator, int index)
+{
+	Validator* self = (Validator*)validator;
+
+	Validator::validate(self->results[index].filename, &self->results[index]);
+}
+
+/**
+ *  Writes string as quoted and escaped JSON string.
+ *  \param f            output stream
+ *  \param s            string
+ */
+void Validator::writeString(FILE* f, const char* s)
+{
+	fputc('"', f);
+	for(; *s; s++)
+	{
+		unsigned char c = *s;
+
+		if(c == '"' || c == '\\')
+			fprintf(f, "\\%c", c);
+		else if(c < 0x20)
+			fprintf(f, "\\u%04x", c);
+		else
+			fputc(c, f);
+	}
+	fputc('"', f);
+}
@@ -0,0 +1,95 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// validate.h: batch map validator headers
+
+#ifndef __VALIDATE_H
+#define __VALIDATE_H
+
+#include <cstdio>
+
+
+/**
+ *  Problems found by validator. Values are bits, one map can have more of
+ *  them. Everything below VALIDATE_WARNINGS makes map unplayable.
+ */
+typedef enum
+{
+	VALIDATE_OK             = 0,
+	VALIDATE_UNREADABLE     = 1 << 0,   // couldn't read file
+	VALIDATE_EMPTY          = 1 << 1,   // no map rows at all
+	VALIDATE_PLAYER         = 1 << 2,   // not exactly one player
+	VALIDATE_EXIT           = 1 << 3,   // no exit
+	VALIDATE_UNREACHABLE    = 1 << 4,   // exit can't be reached by player
+	VALIDATE_DIAMONDS       = 1 << 5,   // some diamonds can't be reached
+	VALIDATE_BORDER         = 1 << 6,   // player can walk off the map
+	VALIDATE_TRUNCATED      = 1 << 7,   // last row not ended by newline
+
+	VALIDATE_WARNINGS       = 1 << 16,
+	VALIDATE_RAGGED         = 1 << 16,  // rows of different width
+	VALIDATE_UNKNOWN        = 1 << 17   // unknown glyphs (loaded as empty)
+} VALIDATEPROBLEM;
+
+
+/**
+ *  Result of single map file validation.
+ */
+typedef struct
+{
+	const char* filename;
+	int problems;           // VALIDATEPROBLEM bits
+	int width;
+	int height;
+	int players;
+	int exits;
+	int diamonds;
+	int reachableDiamonds;
+	bool exitReachable;
+	int raggedRows;
+	int unknownGlyphs;
+	int unknownLine;        // position of first unknown glyph (1-based)
+	int unknownColumn;
+} VALIDATION;
+
+
+/**
+ *  Batch map validator. Checks map files in parallel using the same rules as
+ *  Map::load() plus static playability checks (flood fill from player).
+ */
+class Validator
+{
+private:
+	VALIDATION* results;
+	int count;
+	int threads;
+
+	static void job(void* validator, int index);
+	static void writeString(FILE* f, const char* s);
+public:
+	Validator(int threads);
+	~Validator();
+	int run(char** filenames, int count);
+	void report(FILE* f);
+	void summary(FILE* f);
+	const VALIDATION* getResult(int i);
+	static void validate(const char* filename, VALIDATION* result);
+};
+
+
+#endif /* __VALIDATE_H */
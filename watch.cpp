@@ -0,0 +1,144 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// watch.cpp: file change notification
+
+using namespace std;
+
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include "watch.h"
+#include "config.h"
+#include "debug.h"
+
+// size of buffer for inotify events read at once
+#define WATCH_BUFFER 4096
+
+
+/**
+ *  Constructor.
+ */
+FileWatch::FileWatch()
+{
+	this->fd = -1;
+	this->name = NULL;
+}
+
+/**
+ *  Destructor.
+ */
+FileWatch::~FileWatch()
+{
+	this->close();
+}
+
+/**
+ *  Starts watching file.
+ *  \param filename     file to watch
+ *  \return             true if success
+ */
+bool FileWatch::open(const char* filename)
+{
+	assert(filename);
+
+	this->close();
+
+	// split to directory and name
+	const char* slash = strrchr(filename, '/');
+	char* dir;
+	if(slash)
+	{
+		dir = new char[slash - filename + 2];
+		memcpy(dir, filename, slash - filename + 1);
+		dir[slash - filename + 1] = '\0';
+		slash++;
+	}
+	else
+	{
+		dir = new char[2];
+		strcpy(dir, ".");
+		slash = filename;
+	}
+
+	this->fd = inotify_init();
+	if(this->fd < 0 ||
+		fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) | O_NONBLOCK) < 0 ||
+		inotify_add_watch(this->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		error(false, "couldn't watch directory: %s", dir);
+		delete[] dir;
+		this->close();
+		return false;
+	}
+	delete[] dir;
+
+	this->name = new char[strlen(slash) + 1];
+	strcpy(this->name, slash);
+
+	debug("watching %s", filename);
+	return true;
+}
+
+/**
+ *  Returns whether file was written or replaced since last call.
+ *  \return             true if file changed
+ */
+bool FileWatch::changed()
+{
+	char buffer[WATCH_BUFFER]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+	ssize_t len;
+
+	if(this->fd < 0)
+		return false;
+
+	// drain all pending events (several per save are common)
+	while((len = read(this->fd, buffer, sizeof(buffer))) > 0)
+	{
+		char* p = buffer;
+		while(p < buffer + len)
+		{
+			struct inotify_event* e = (struct inotify_event*)p;
+
+			if(e->len && !strcmp(e->name, this->name))
+				changed = true;
+			p += sizeof(struct inotify_event) + e->len;
+		}
+	}
+
+	return changed;
+}
+
+/**
+ *  Stops watching.
+ */
+void FileWatch::close()
+{
+	if(this->fd >= 0)
+		::close(this->fd);
+	delete[] this->name;
+
+	this->fd = -1;
+	this->name = NULL;
+}
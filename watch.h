@@ -0,0 +1,46 @@
+/*
+ *  C++dash
+ *  Copyright (c) 2008-2009 Ondrej Balaz <ondra@blami.net>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without 
+ *  modification, are permitted provided that the following conditions 
+ *  are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright 
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the University nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ */
+
+// watch.h: file change notification headers
+
+#ifndef __WATCH_H
+#define __WATCH_H
+
+
+/**
+ *  Watches single file for changes using inotify. Directory of file is
+ *  watched, so file replaced by rename (as many editors save) is noticed as
+ *  well as file written in place. Polling never blocks.
+ */
+class FileWatch
+{
+private:
+	int fd;
+	char* name;         // file name within watched directory
+
+public:
+	FileWatch();
+	~FileWatch();
+	bool open(const char* filename);
+	bool changed();
+	void close();
+};
+
+
+#endif /* __WATCH_H */